@@ -1,44 +1,288 @@
 #include "audio_engine.h"
 
 #include "audio_graph.h"
+#include "realtime_guard.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <array>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <atomic>
+#include <chrono>
+#include <format>
 #include <print>
+#include <random>
+#include <semaphore>
+#include <thread>
 #include <vector>
 #define NOMINMAX
 #include <miniaudio.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <emmintrin.h>
+#define AU_SSE2
+#endif
+
+namespace {
+ma_format toMaFormat(AudioSampleFormat format) {
+    switch (format) {
+        case AudioSampleFormat::F32:
+            return ma_format_f32;
+        case AudioSampleFormat::S16:
+            return ma_format_s16;
+        case AudioSampleFormat::S32:
+            return ma_format_s32;
+        default:
+            return ma_format_unknown;  // The device's native format
+    }
+}
+
+AudioSampleFormat fromMaFormat(ma_format format) {
+    switch (format) {
+        case ma_format_f32:
+            return AudioSampleFormat::F32;
+        case ma_format_s16:
+            return AudioSampleFormat::S16;
+        case ma_format_s32:
+            return AudioSampleFormat::S32;
+        default:
+            return AudioSampleFormat::Native;
+    }
+}
+
+template <typename T>
+void deinterleave(const T* in, size_t channels, size_t begin, size_t frames, float scale, float* const* out) {
+    for (size_t i = begin; i < frames; ++i) {
+        for (size_t c = 0; c < channels; ++c) {
+            out[c][i] = in[i * channels + c] * scale;
+        }
+    }
+}
+
+#if defined(AU_SSE2)
+// Mono and stereo four frames at a time. Returns the frames converted.
+size_t convertSse2(const void* input, ma_format format, size_t channels, size_t frames, float* const* out) {
+    if (channels > 2) {
+        return 0;
+    }
+    const size_t n = frames & ~(size_t)3;
+    const __m128 s16_scale = _mm_set1_ps(1.0f / 32768.0f);
+    const __m128 s32_scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    for (size_t i = 0; i < n; i += 4) {
+        // a holds the first four samples, b the next four for stereo.
+        __m128 a, b = _mm_setzero_ps();
+        if (format == ma_format_f32) {
+            const float* in = (const float*)input + i * channels;
+            a = _mm_loadu_ps(in);
+            if (channels == 2) b = _mm_loadu_ps(in + 4);
+        } else if (format == ma_format_s16) {
+            const short* in = (const short*)input + i * channels;
+            __m128i x = channels == 2 ? _mm_loadu_si128((const __m128i*)in) : _mm_loadl_epi64((const __m128i*)in);
+            // Widen by putting each sample in the high half and shifting back.
+            a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16)), s16_scale);
+            b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16)), s16_scale);
+        } else {
+            const int32_t* in = (const int32_t*)input + i * channels;
+            a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)in)), s32_scale);
+            if (channels == 2) b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(in + 4))), s32_scale);
+        }
+        if (channels == 1) {
+            _mm_storeu_ps(out[0] + i, a);
+        } else {
+            _mm_storeu_ps(out[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(out[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+        }
+    }
+    return n;
+}
+#endif
+
+// Splits captured frames into one float buffer per channel.
+void convertCapture(const void* input, ma_format format, size_t channels, size_t frames, float* const* out) {
+    size_t done = 0;
+#if defined(AU_SSE2)
+    done = convertSse2(input, format, channels, frames, out);
+#endif
+    switch (format) {
+        case ma_format_f32:
+            deinterleave((const float*)input, channels, done, frames, 1.0f, out);
+            break;
+        case ma_format_s16:
+            deinterleave((const short*)input, channels, done, frames, 1.0f / 32768.0f, out);
+            break;
+        case ma_format_s32:
+            deinterleave((const int32_t*)input, channels, done, frames, 1.0f / 2147483648.0f, out);
+            break;
+        default:
+            break;
+    }
+}
+}  // namespace
+
 class AudioEngineImpl : public AudioEngine {
    public:
-    AudioEngineImpl();
+    AudioEngineImpl(const AudioEngineOptions& options);
     ~AudioEngineImpl();
     int init() override;
     void setGraph(AuNodeGraphPtr graph) override;
     AuNodeGraphPtr getGraph() override;
+    void setPartGraph(size_t part, AuNodeGraphPtr graph) override;
+    AuNodeGraphPtr getPartGraph(size_t part) override;
+    void setPartSettings(size_t part, const AudioPartSettings& settings) override;
+    AudioPartSettings getPartSettings(size_t part) const override;
+    void update() override;
     float getDb() const override;
     const std::vector<float>& getHistory() const override;
     size_t getHistoryPos() const override;
+    void setInternalRate(float sample_rate, AuResampleQuality quality) override;
+    float getInternalRate() const override;
+    AuResampleQuality getResampleQuality() const override;
+    std::vector<std::string> getDevices() override;
+    std::vector<std::string> getCaptureDevices() override;
+    int openDevice(const AudioDeviceSettings& settings) override;
+    AudioDeviceSettings getDeviceSettings() const override;
+    AudioDeviceStatus getDeviceStatus() const override;
+    AudioTimingStats getTimingStats() const override;
+    void resetTimingStats() override;
+    int startRecording(const AuRecorderSettings& settings, const std::vector<std::pair<AuNodePtr, size_t>>& taps) override;
+    void stopRecording() override;
+    AuRecorderStats getRecorderStats() const override;
 
     static const size_t HISTORY_SIZE = 10 * 48000;
+    // Bounds of the graph block size, which follows the device period.
+    static constexpr size_t MIN_BLOCK_FRAMES = 32;
+    static constexpr size_t MAX_BLOCK_FRAMES = 4096;
    private:
+    using Clock = std::chrono::steady_clock;
+
+    // What the callback reads and writes, taken from the open device or the
+    // simulation.
+    struct StreamFormat {
+        ma_format format = ma_format_unknown;
+        ma_uint32 channels = 0;
+        ma_format capture_format = ma_format_unknown;
+        ma_uint32 capture_channels = 0;  // 0 without capture
+        ma_uint32 sample_rate = 0;
+        ma_uint32 period_frames = 0;
+        ma_uint32 periods = 0;
+        ma_uint32 capture_buffer_frames = 0;
+    };
+
+    struct Part {
+        // The UI thread owns graph, the audio thread only sees audio_graph.
+        AuNodeGraphPtr graph;
+        AudioPartSettings settings;
+        std::atomic<AuNodeGraph*> audio_graph{nullptr};
+        std::atomic<float> gain{1.0f};  // 0 when muted
+        float mixed_gain = 0.0f;  // Audio thread, what the last block ramped to
+    };
+
+    // A part the audio thread renders in this callback.
+    struct PartJob {
+        Part* part;
+        AuNodeGraph* graph;
+        float gain;
+        const float* block;
+    };
+
     static void s_dataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
-    void dataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
+    // due is when the device asked for the block, or when it was due in a
+    // simulation.
+    void dataCallback(void* pOutput, const void* pInput, ma_uint32 frameCount, Clock::time_point due);
+    void recordTiming(Clock::time_point due, ma_uint32 frameCount);
+    void waitForCallback();
+    bool enumerateDevices();
+    int initDevice(const AudioDeviceSettings& settings);
+    void initSimulation(const AudioDeviceSettings& settings);
+    void startDevice();
+    void stopDevice();
+    void closeDevice();
+    void simulate(AudioSimulation simulation);
+    // Sets up the graph rate, block size and resampler for the open device.
+    // Not while the device runs.
+    void configureGraph();
+    AuGraphConfig partConfig(size_t part) const;
+    // Audio thread. Picks the parts to render this callback, returns false if
+    // no part has a graph.
+    bool gatherParts();
+    const float* render(size_t frames, const AuCaptureBlock& capture);
+    // Renders and mixes frames of the gathered parts, at the graph rate.
+    const float* renderParts(size_t frames, const AuCaptureBlock& capture);
+    // Renders jobs until none are left to claim, on the audio thread and the
+    // part threads.
+    void renderJobs();
+    void startPartThreads();
+    void partThread();
+    AudioEngineOptions m_options;
+    AudioDeviceSettings m_settings;
     ma_context m_context;
     ma_device m_device;
-    AuNodeGraphPtr m_node_graph;
-    float m_db;
+    std::vector<ma_device_info> m_devices;
+    std::vector<ma_device_info> m_capture_devices;
+    bool m_context_ready = false;
+    bool m_device_open = false;
+    bool m_started = false;
+    StreamFormat m_format;
+    std::thread m_simulation;
+    std::atomic<bool> m_simulation_stop{false};
+    // setPartGraph() keeps the old graph alive until the audio thread has
+    // finished a callback with the new pointer.
+    std::array<Part, kMaxParts> m_parts;
+    std::atomic<uint64_t> m_callbacks{0};
+    // Jobs of the current block, claimed from the last. m_jobs and the block
+    // arguments are set before m_unclaimed is released.
+    std::array<PartJob, kMaxParts> m_jobs;
+    size_t m_job_count = 0;
+    size_t m_job_frames = 0;
+    AuCaptureBlock m_job_capture;
+    std::atomic<int32_t> m_unclaimed{0};
+    std::atomic<int32_t> m_finished{0};
+    std::vector<float> m_mix;
+    std::vector<std::thread> m_part_threads;
+    std::atomic<size_t> m_part_thread_count{0};
+    std::counting_semaphore<> m_part_wake{0};
+    std::atomic<bool> m_part_stop{false};
+    AuGraphConfig m_graph_config;
+    float m_internal_rate = 0.0f;
+    AuResampleQuality m_quality = AuResampleQuality::Medium;
+    std::unique_ptr<AuSincResampler> m_resampler;
+    std::vector<float> m_block;
+    // Converted capture, one buffer of max_frames per channel.
+    std::vector<float> m_capture;
+    std::vector<float*> m_capture_channels;
+    std::atomic<float> m_db;
     std::vector<float> m_history;
-    size_t m_p_hist;
+    std::atomic<size_t> m_p_hist;
+
+    // Written by the audio thread only.
+    std::atomic<uint64_t> m_timed_callbacks{0};
+    std::atomic<uint64_t> m_deadline_misses{0};
+    std::atomic<int64_t> m_worst_ns{0};
+    std::atomic<int64_t> m_total_ns{0};
+    std::atomic<float> m_worst_load{0.0f};
+    std::atomic<bool> m_reset_timing{false};
+
+    AuDiskRecorder m_recorder;
+    std::atomic<bool> m_recording{false};  // The audio thread writes the output to m_recorder
+    // Probes feeding m_recorder, and their nodes kept alive until it stops.
+    struct Tap {
+        AuNodePtr node;
+        AuProbe* probe;
+        // Probed only for the recording, unprobed again when it stops.
+        AuNodeGraphPtr graph;
+        size_t pin;
+    };
+    std::vector<Tap> m_taps;
 };
 
-std::unique_ptr<AudioEngine> AudioEngine::create() {
-    return std::make_unique<AudioEngineImpl>();
+std::unique_ptr<AudioEngine> AudioEngine::create(const AudioEngineOptions& options) {
+    return std::make_unique<AudioEngineImpl>(options);
 }
 
-AudioEngineImpl::AudioEngineImpl() {
-    m_node_graph = 0;
+AudioEngineImpl::AudioEngineImpl(const AudioEngineOptions& options) : m_options(options), m_settings(options.device) {
+    m_graph_config.max_frames = MAX_BLOCK_FRAMES;
+    m_mix.assign(m_graph_config.max_frames, 0.0f);
     m_db = 0;
     m_device = {};
     m_history.resize(HISTORY_SIZE);
@@ -46,52 +290,220 @@ AudioEngineImpl::AudioEngineImpl() {
 }
 
 AudioEngineImpl::~AudioEngineImpl() {
-    ma_device_uninit(&m_device);
+    closeDevice();
+    stopRecording();
+    m_part_stop.store(true, std::memory_order_release);
+    m_part_wake.release(m_part_threads.size());
+    for (std::thread& thread : m_part_threads) {
+        thread.join();
+    }
+    if (m_context_ready) {
+        ma_context_uninit(&m_context);
+    }
 }
 
 int AudioEngineImpl::init() {
     if (ma_context_init(0, 0, 0, &m_context)) {
         std::print("Error: initalizing context\n");
-        return -1;
+        if (!m_settings.simulation.enabled) {
+            return -1;
+        }
+    } else {
+        m_context_ready = true;
     }
-    ma_device_info* pPlaybackInfos;
-    ma_uint32 playbackCount;
-    ma_device_info* pCaptureInfos;
-    ma_uint32 captureCount;
-    if (ma_context_get_devices(&m_context, &pPlaybackInfos, &playbackCount, &pCaptureInfos, &captureCount) != MA_SUCCESS) {
+    if (!enumerateDevices() && !m_settings.simulation.enabled) {
         std::print("Error: enumerating devices\n");
         return -1;
     }
-    for (int i = 0; i < playbackCount; ++i) {
-        auto& info = pPlaybackInfos[i];
+    for (const auto& info : m_devices) {
         std::print("Device: {}\n", info.name);
         for (int j = 0; j < info.nativeDataFormatCount; ++j) {
             auto& format = info.nativeDataFormats[j];
             std::print("  Format: {}, {} Hz, {} channels, flags: {}\n", (int)format.format, format.sampleRate, format.channels, format.flags);
         }
     }
+    for (const auto& info : m_capture_devices) {
+        std::print("Capture device: {}\n", info.name);
+    }
+
+    if (m_options.lock_memory) {
+        // Everything allocated so far is zero filled and so already faulted
+        // in. Plans and blocks allocated later are locked as they're built.
+        lockMemory();
+    }
+    return openDevice(m_settings);
+}
+
+bool AudioEngineImpl::enumerateDevices() {
+    ma_device_info* pPlaybackInfos;
+    ma_uint32 playbackCount;
+    ma_device_info* pCaptureInfos;
+    ma_uint32 captureCount;
+    if (!m_context_ready ||
+        ma_context_get_devices(&m_context, &pPlaybackInfos, &playbackCount, &pCaptureInfos, &captureCount) != MA_SUCCESS) {
+        return false;
+    }
+    m_devices.assign(pPlaybackInfos, pPlaybackInfos + playbackCount);
+    m_capture_devices.assign(pCaptureInfos, pCaptureInfos + captureCount);
+    return true;
+}
+
+std::vector<std::string> AudioEngineImpl::getDevices() {
+    std::vector<std::string> names;
+    enumerateDevices();
+    for (const auto& info : m_devices) {
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+std::vector<std::string> AudioEngineImpl::getCaptureDevices() {
+    std::vector<std::string> names;
+    enumerateDevices();
+    for (const auto& info : m_capture_devices) {
+        names.push_back(info.name);
+    }
+    return names;
+}
+
+int AudioEngineImpl::openDevice(const AudioDeviceSettings& settings) {
+    closeDevice();
+    int result = settings.simulation.enabled ? 0 : initDevice(settings);
+    if (settings.simulation.enabled) {
+        initSimulation(settings);
+    }
+    if (result == 0) {
+        m_settings = settings;
+    } else {
+        std::print("Error: can't open the audio device, going back to the previous settings\n");
+        if (m_settings.simulation.enabled) {
+            initSimulation(m_settings);
+        } else if (initDevice(m_settings) != 0) {
+            std::print("Error: can't reopen the audio device\n");
+            return -1;
+        }
+    }
+    configureGraph();
+    startDevice();
+    m_started = true;
+    return result;
+}
+
+void AudioEngineImpl::initSimulation(const AudioDeviceSettings& settings) {
+    const AudioSimulation& simulation = settings.simulation;
+    m_format = StreamFormat();
+    m_format.format = ma_format_f32;
+    m_format.channels = std::max<uint32_t>(simulation.channels, 1);
+    m_format.capture_format = ma_format_f32;
+    m_format.capture_channels = settings.duplex ? m_format.channels : 0;
+    m_format.sample_rate = std::max<uint32_t>(simulation.sample_rate, 1);
+    m_format.period_frames = std::max<uint32_t>(settings.period_frames, 1);
+    m_format.periods = std::max<uint32_t>(settings.periods, 1);
+    m_format.capture_buffer_frames = settings.duplex ? m_format.period_frames : 0;
+    std::print("Simulating a device: {} Hz, {} channels, {} x {} frames\n", m_format.sample_rate, m_format.channels, m_format.periods,
+               m_format.period_frames);
+}
+
+void AudioEngineImpl::startDevice() {
+    if (m_settings.simulation.enabled) {
+        m_simulation_stop.store(false, std::memory_order_relaxed);
+        m_simulation = std::thread(&AudioEngineImpl::simulate, this, m_settings.simulation);
+    } else {
+        ma_device_start(&m_device);  // The device is sleeping by default so you'll need to start it manually.
+    }
+}
+
+void AudioEngineImpl::stopDevice() {
+    if (m_simulation.joinable()) {
+        m_simulation_stop.store(true, std::memory_order_relaxed);
+        m_simulation.join();
+    } else if (m_device_open) {
+        ma_device_stop(&m_device);
+    }
+}
+
+void AudioEngineImpl::simulate(AudioSimulation simulation) {
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float variation = std::clamp(simulation.period_variation, 0.0f, 1.0f);
+    const size_t max_frames = (size_t)(m_format.period_frames * (1.0f + variation)) + 1;
+    std::vector<float> output(max_frames * m_format.channels);
+    std::vector<float> input(max_frames * m_format.capture_channels);
+    auto seconds = [](double s) { return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(s)); };
+
+    Clock::time_point due = Clock::now();
+    while (!m_simulation_stop.load(std::memory_order_relaxed)) {
+        const float scale = 1.0f + variation * (2.0f * unit(random) - 1.0f);
+        const ma_uint32 frames = std::max<ma_uint32>(1, (ma_uint32)(m_format.period_frames * scale));
+        // The device asks for the block when it's due, the scheduler wakes the
+        // thread somewhat later and may take the CPU away for a while.
+        std::this_thread::sleep_until(due + seconds(simulation.jitter_ms * unit(random) / 1000.0));
+        if (simulation.preempt_chance > 0.0f && unit(random) < simulation.preempt_chance) {
+            std::this_thread::sleep_for(seconds(simulation.preempt_ms / 1000.0));
+        }
+        dataCallback(output.data(), input.empty() ? nullptr : input.data(), frames, due);
+        due += seconds((double)frames / m_format.sample_rate);
+        // After an underrun a device restarts from now rather than catching up.
+        const Clock::time_point now = Clock::now();
+        if (due < now) {
+            due = now;
+        }
+    }
+}
 
-    ma_device_config config = ma_device_config_init(ma_device_type_playback);
-    config.playback.format = ma_format_unknown;  // Set to ma_format_unknown to use the device's native format.
+int AudioEngineImpl::initDevice(const AudioDeviceSettings& settings) {
+    ma_device_config config = ma_device_config_init(settings.duplex ? ma_device_type_duplex : ma_device_type_playback);
+    config.playback.format = toMaFormat(settings.format);
     config.playback.channels = 0;            // Set to 0 to use the device's native channel count.
-    config.playback.shareMode = ma_share_mode_exclusive;
-    config.playback.pDeviceID = &pPlaybackInfos[0].id;
+    config.playback.shareMode = settings.exclusive ? ma_share_mode_exclusive : ma_share_mode_shared;
+    const bool listed = settings.device >= 0 && (size_t)settings.device < m_devices.size();
+    config.playback.pDeviceID = listed ? &m_devices[settings.device].id : nullptr;
+    if (settings.duplex) {
+        const bool capture_listed = settings.capture_device >= 0 && (size_t)settings.capture_device < m_capture_devices.size();
+        config.capture.pDeviceID = capture_listed ? &m_capture_devices[settings.capture_device].id : nullptr;
+        config.capture.format = ma_format_unknown;  // Converted in the callback if it isn't f32
+        config.capture.channels = 0;
+        config.capture.shareMode = config.playback.shareMode;
+    }
     config.sampleRate = 0;                   // Set to 0 to use the device's native sample rate.
     config.dataCallback = s_dataCallback;    // This function will be called when miniaudio needs more data.
     config.pUserData = this;                 // Can be accessed from the device object (device.pUserData).
     config.noPreSilencedOutputBuffer = true;
     config.noClip = true;
     config.noFixedSizedCallback = true;
-    config.noDisableDenormals = true;
-    config.periods = 2;
-    config.periodSizeInFrames = 200;
+    config.noDisableDenormals = true;  // Set once per thread by setupAudioThread()
+    config.periods = settings.periods;
+    config.periodSizeInFrames = settings.period_frames;
     config.performanceProfile = ma_performance_profile_low_latency;
     config.wasapi.noAutoConvertSRC = true;
     config.wasapi.usage = ma_wasapi_usage_pro_audio;
 
-    if (ma_device_init(NULL, &config, &m_device) != MA_SUCCESS) {
+    if (ma_device_init(&m_context, &config, &m_device) != MA_SUCCESS) {
         return -1;  // Failed to initialize the device.
     }
+    const bool playback_native = fromMaFormat(m_device.playback.format) == AudioSampleFormat::Native;
+    const bool capture_native = settings.duplex && fromMaFormat(m_device.capture.format) == AudioSampleFormat::Native;
+    if (playback_native || capture_native) {
+        // A native format the callback can't handle, let miniaudio convert.
+        ma_device_uninit(&m_device);
+        if (playback_native) config.playback.format = ma_format_f32;
+        if (capture_native) config.capture.format = ma_format_f32;
+        if (ma_device_init(&m_context, &config, &m_device) != MA_SUCCESS) {
+            return -1;
+        }
+    }
+    m_device_open = true;
+    m_format = StreamFormat();
+    m_format.format = m_device.playback.format;
+    m_format.channels = m_device.playback.channels;
+    m_format.sample_rate = m_device.playback.internalSampleRate;
+    m_format.period_frames = m_device.playback.internalPeriodSizeInFrames;
+    m_format.periods = m_device.playback.internalPeriods;
+    if (settings.duplex) {
+        m_format.capture_format = m_device.capture.format;
+        m_format.capture_channels = m_device.capture.channels;
+        m_format.capture_buffer_frames = m_device.capture.internalPeriodSizeInFrames * m_device.capture.internalPeriods;
+    }
     std::print("Using audio device: {}\n", m_device.playback.name);
     std::print("  Sample rate:      {} Hz\n", m_device.playback.internalSampleRate);
     std::print("  Format:           {}\n", (int)m_device.playback.internalFormat);
@@ -99,18 +511,371 @@ int AudioEngineImpl::init() {
     std::print("  Periods:          {}\n", m_device.playback.internalPeriods);
     std::print("  Buffer length:    {} ms\n", 1000 * m_device.playback.internalPeriodSizeInFrames * m_device.playback.internalPeriods /
                                                   m_device.playback.internalSampleRate);
+    if (settings.duplex) {
+        std::print("Using capture device: {}\n", m_device.capture.name);
+        std::print("  Format:           {}, {} channels\n", (int)m_device.capture.format, m_device.capture.channels);
+    }
+    return 0;
+}
 
+void AudioEngineImpl::closeDevice() {
+    stopDevice();
+    if (m_device_open) {
+        ma_device_uninit(&m_device);
+        m_device_open = false;
+    }
+    m_started = false;
+}
+
+AudioDeviceSettings AudioEngineImpl::getDeviceSettings() const {
+    return m_settings;
+}
 
-    ma_device_start(&m_device);  // The device is sleeping by default so you'll need to start it manually.
+AudioDeviceStatus AudioEngineImpl::getDeviceStatus() const {
+    AudioDeviceStatus status;
+    if (!m_started) {
+        return status;
+    }
+    const bool simulated = m_settings.simulation.enabled;
+    status.name = simulated ? "Simulated device" : m_device.playback.name;
+    status.format = fromMaFormat(m_format.format);
+    status.sample_rate = m_format.sample_rate;
+    status.channels = m_format.channels;
+    status.period_frames = m_format.period_frames;
+    status.periods = m_format.periods;
+    status.round_trip_frames = status.period_frames * status.periods;
+    if (m_format.capture_channels) {
+        status.capture_name = simulated ? "Simulated input" : m_device.capture.name;
+        status.capture_format = fromMaFormat(m_format.capture_format);
+        status.capture_channels = m_format.capture_channels;
+        status.capture_direct = m_format.capture_format == ma_format_f32 && m_format.capture_channels == 1;
+        status.round_trip_frames += m_format.capture_buffer_frames;
+        float latency = 0.0f;
+        for (const Part& part : m_parts) {
+            if (part.graph) {
+                latency = std::max(latency, part.graph->stats().latency);
+            }
+        }
+        status.round_trip_frames += (uint32_t)ceilf(latency);
+    }
+    return status;
+}
+
+AudioTimingStats AudioEngineImpl::getTimingStats() const {
+    AudioTimingStats stats;
+    stats.callbacks = m_timed_callbacks.load(std::memory_order_relaxed);
+    stats.deadline_misses = m_deadline_misses.load(std::memory_order_relaxed);
+    stats.worst_ms = m_worst_ns.load(std::memory_order_relaxed) / 1e6f;
+    stats.average_ms = stats.callbacks ? m_total_ns.load(std::memory_order_relaxed) / 1e6f / stats.callbacks : 0.0f;
+    stats.worst_load = m_worst_load.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AudioEngineImpl::resetTimingStats() {
+    m_reset_timing.store(true, std::memory_order_relaxed);
+}
+
+int AudioEngineImpl::startRecording(const AuRecorderSettings& settings, const std::vector<std::pair<AuNodePtr, size_t>>& taps) {
+    stopRecording();
+    // Only part 0's taps: the recorder takes one producer, and parts may
+    // render on other threads.
+    const AuNodeGraphPtr& graph = m_parts[0].graph;
+    for (const auto& [node, pin] : taps) {
+        if (!graph || !node || graph->findNode(node->id()) != node || pin >= node->outPins()) {
+            std::print("Error: can't tap {}, only outputs of part 0's graph can be recorded\n", node ? node->name() : "nothing");
+            return -1;
+        }
+    }
+    std::vector<std::string> tracks{"out"};
+    for (const auto& [node, pin] : taps) {
+        tracks.push_back(std::format("{}{}-{}", node->name(), node->id(), node->outPin(pin).name()));
+    }
+    const float sample_rate = m_format.sample_rate ? (float)m_format.sample_rate : 48000.0f;
+    if (m_recorder.start(settings, tracks, sample_rate) != 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < taps.size(); ++i) {
+        const auto& [node, pin] = taps[i];
+        const bool probed = node->outPin(pin).probe() != nullptr;
+        graph->setProbe(node, pin, true);
+        if (AuProbe* probe = node->outPin(pin).probe()) {
+            probe->setTap(m_recorder.tap((uint32_t)i + 1));
+            m_taps.push_back({node, probe, probed ? nullptr : graph, pin});
+        }
+    }
+    m_recording.store(true, std::memory_order_release);
     return 0;
 }
 
+void AudioEngineImpl::stopRecording() {
+    m_recording.store(false, std::memory_order_release);
+    for (const Tap& tap : m_taps) {
+        tap.probe->setTap(nullptr);
+    }
+    waitForCallback();
+    for (const Tap& tap : m_taps) {
+        if (tap.graph) {
+            tap.graph->setProbe(tap.node, tap.pin, false);
+        }
+    }
+    m_taps.clear();
+    m_recorder.stop();
+}
+
+AuRecorderStats AudioEngineImpl::getRecorderStats() const {
+    return m_recorder.stats();
+}
+
 void AudioEngineImpl::setGraph(AuNodeGraphPtr node_graph) {
-    m_node_graph = node_graph;
+    setPartGraph(0, node_graph);
 }
 
 AuNodeGraphPtr AudioEngineImpl::getGraph() {
-    return m_node_graph;
+    return m_parts[0].graph;
+}
+
+void AudioEngineImpl::setPartGraph(size_t index, AuNodeGraphPtr graph) {
+    if (index >= kMaxParts) {
+        std::print("Error: no part {}, there are {}\n", index, kMaxParts);
+        return;
+    }
+    for (size_t i = 0; i < kMaxParts; ++i) {
+        if (graph && i != index && m_parts[i].graph == graph) {
+            std::print("Error: the graph already plays in part {}\n", i);
+            return;
+        }
+    }
+    Part& part = m_parts[index];
+    AuNodeGraphPtr previous = part.graph;  // Released after the audio thread moved on
+    if (graph && graph == previous) {
+        // Not prepared while the audio thread may render it.
+        part.audio_graph.store(nullptr, std::memory_order_release);
+        waitForCallback();
+    }
+    if (graph) {
+        graph->prepare(partConfig(index));
+    }
+    part.graph = graph;
+    part.audio_graph.store(graph.get(), std::memory_order_release);
+    waitForCallback();
+    startPartThreads();
+}
+
+AuNodeGraphPtr AudioEngineImpl::getPartGraph(size_t index) {
+    return index < kMaxParts ? m_parts[index].graph : nullptr;
+}
+
+void AudioEngineImpl::setPartSettings(size_t index, const AudioPartSettings& settings) {
+    if (index >= kMaxParts) {
+        std::print("Error: no part {}, there are {}\n", index, kMaxParts);
+        return;
+    }
+    Part& part = m_parts[index];
+    const bool rechannel = settings.midi_channel != part.settings.midi_channel;
+    part.settings = settings;
+    part.gain.store(settings.mute ? 0.0f : settings.gain, std::memory_order_relaxed);
+    if (rechannel && part.graph) {
+        setPartGraph(index, part.graph);
+    }
+}
+
+AudioPartSettings AudioEngineImpl::getPartSettings(size_t index) const {
+    return index < kMaxParts ? m_parts[index].settings : AudioPartSettings();
+}
+
+void AudioEngineImpl::update() {
+    for (size_t i = 0; i < kMaxParts; ++i) {
+        Part& part = m_parts[i];
+        if (part.graph && part.graph->needsPrepare()) {
+            setPartGraph(i, part.graph);
+        }
+        if (part.graph) {
+            part.graph->update();
+        }
+    }
+}
+
+AuGraphConfig AudioEngineImpl::partConfig(size_t index) const {
+    AuGraphConfig config = m_graph_config;
+    config.midi_channel = m_parts[index].settings.midi_channel;
+    return config;
+}
+
+void AudioEngineImpl::startPartThreads() {
+    size_t parts = 0;
+    for (const Part& part : m_parts) {
+        parts += part.graph ? 1 : 0;
+    }
+    if (parts < 2 || !m_part_threads.empty()) {
+        return;
+    }
+    int threads = m_options.part_threads;
+    if (threads < 0) {
+        threads = (int)std::thread::hardware_concurrency() - 1;
+    }
+    threads = std::clamp(threads, 0, (int)kMaxParts - 1);
+    for (int i = 0; i < threads; ++i) {
+        m_part_threads.emplace_back(&AudioEngineImpl::partThread, this);
+    }
+    m_part_thread_count.store(m_part_threads.size(), std::memory_order_release);
+}
+
+void AudioEngineImpl::partThread() {
+    AuThreadOptions options = m_options.thread;
+    options.cpu = -1;
+    setupAudioThread(options);
+    while (true) {
+        m_part_wake.acquire();
+        if (m_part_stop.load(std::memory_order_acquire)) {
+            return;
+        }
+        AuRealtimeScope realtime;
+        renderJobs();
+    }
+}
+
+void AudioEngineImpl::waitForCallback() {
+    if (!m_started) {
+        return;
+    }
+    const uint64_t callbacks = m_callbacks.load(std::memory_order_acquire);
+    for (int i = 0; i < 200 && m_callbacks.load(std::memory_order_acquire) == callbacks; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void AudioEngineImpl::setInternalRate(float sample_rate, AuResampleQuality quality) {
+    m_internal_rate = sample_rate;
+    m_quality = quality;
+    if (!m_started) {
+        return;
+    }
+    stopDevice();
+    configureGraph();
+    startDevice();
+}
+
+float AudioEngineImpl::getInternalRate() const {
+    return m_internal_rate;
+}
+
+AuResampleQuality AudioEngineImpl::getResampleQuality() const {
+    return m_quality;
+}
+
+void AudioEngineImpl::configureGraph() {
+    const float device_rate = (float)m_format.sample_rate;
+    const bool resample = m_internal_rate > 0.0f && m_internal_rate != device_rate;
+    m_graph_config.sample_rate = resample ? m_internal_rate : device_rate;
+    m_graph_config.max_frames = std::clamp<size_t>(m_format.period_frames, MIN_BLOCK_FRAMES, MAX_BLOCK_FRAMES);
+    m_block.assign(m_graph_config.max_frames, 0.0f);
+    const size_t capture_channels = m_format.capture_channels;
+    m_capture.assign(capture_channels * m_graph_config.max_frames, 0.0f);
+    m_capture_channels.resize(capture_channels);
+    for (size_t c = 0; c < capture_channels; ++c) {
+        m_capture_channels[c] = m_capture.data() + c * m_graph_config.max_frames;
+    }
+    m_mix.assign(m_graph_config.max_frames, 0.0f);
+    m_resampler.reset();
+    if (resample) {
+        m_resampler = std::make_unique<AuSincResampler>(m_internal_rate, device_rate, m_quality, m_graph_config.max_frames);
+        std::print("Rendering at {} Hz, resampling to {} Hz\n", m_internal_rate, device_rate);
+    }
+    for (size_t i = 0; i < kMaxParts; ++i) {
+        if (m_parts[i].graph) {
+            m_parts[i].graph->prepare(partConfig(i));
+        }
+    }
+}
+
+bool AudioEngineImpl::gatherParts() {
+    bool playing = false;
+    m_job_count = 0;
+    for (Part& part : m_parts) {
+        AuNodeGraph* graph = part.audio_graph.load(std::memory_order_acquire);
+        if (!graph) {
+            part.mixed_gain = 0.0f;  // A new graph fades in
+            continue;
+        }
+        playing = true;
+        const float gain = part.gain.load(std::memory_order_relaxed);
+        if (gain != 0.0f || part.mixed_gain != 0.0f) {
+            m_jobs[m_job_count++] = {&part, graph, gain, nullptr};
+        }
+    }
+    return playing;
+}
+
+void AudioEngineImpl::renderJobs() {
+    for (int32_t job; (job = m_unclaimed.fetch_sub(1, std::memory_order_acq_rel)) > 0;) {
+        PartJob& part_job = m_jobs[job - 1];
+        part_job.block = part_job.graph->process(m_job_frames, m_job_capture);
+        m_finished.fetch_add(1, std::memory_order_release);
+    }
+}
+
+const float* AudioEngineImpl::renderParts(size_t frames, const AuCaptureBlock& capture) {
+    const int32_t count = (int32_t)m_job_count;
+    m_job_frames = frames;
+    m_job_capture = capture;
+    m_finished.store(0, std::memory_order_relaxed);
+    m_unclaimed.store(count, std::memory_order_release);
+    const size_t helpers = std::min<size_t>(std::max(count - 1, 0), m_part_thread_count.load(std::memory_order_acquire));
+    if (helpers > 0) {
+        m_part_wake.release(helpers);
+    }
+    renderJobs();
+    // Parts claimed by part threads may still be rendering. Waiting takes
+    // less than rendering one of them, so it spins.
+    while (m_finished.load(std::memory_order_acquire) < count) {
+#if defined(AU_SSE2)
+        _mm_pause();
+#endif
+    }
+
+    // One part at unity gain plays as rendered.
+    if (count == 1 && m_jobs[0].block && m_jobs[0].gain == 1.0f && m_jobs[0].part->mixed_gain == 1.0f) {
+        return m_jobs[0].block;
+    }
+    float* mix = m_mix.data();
+    std::fill_n(mix, frames, 0.0f);
+    const int32_t n = (int32_t)frames;
+    for (int32_t j = 0; j < count; ++j) {
+        PartJob& job = m_jobs[j];
+        const float from = job.part->mixed_gain;
+        const float to = job.gain;
+        job.part->mixed_gain = to;
+        const float* block = job.block;
+        if (!block) {
+            continue;
+        }
+        if (from == to) {
+            for (int32_t i = 0; i < n; ++i) {
+                mix[i] += block[i] * to;
+            }
+        } else {
+            const float step = (to - from) / n;
+            for (int32_t i = 0; i < n; ++i) {
+                mix[i] += block[i] * (from + step * (float)(i + 1));
+            }
+        }
+    }
+    return mix;
+}
+
+// Renders frames at the device rate. The capture is only passed on when the
+// graphs run at the device rate too.
+const float* AudioEngineImpl::render(size_t frames, const AuCaptureBlock& capture) {
+    if (!m_resampler) {
+        return renderParts(frames, capture);
+    }
+    for (size_t needed = m_resampler->inputNeeded(frames); needed > 0;) {
+        size_t n = std::min(needed, m_graph_config.max_frames);
+        m_resampler->write(renderParts(n, AuCaptureBlock()), n);
+        needed -= n;
+    }
+    m_resampler->read(m_block.data(), frames);
+    return m_block.data();
 }
 
 float AudioEngineImpl::getDb() const {
@@ -126,50 +891,112 @@ size_t AudioEngineImpl::getHistoryPos() const {
 }
 
 void AudioEngineImpl::s_dataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
-    ((AudioEngineImpl*)pDevice->pUserData)->dataCallback(pDevice, pOutput, pInput, frameCount);
+    ((AudioEngineImpl*)pDevice->pUserData)->dataCallback(pOutput, pInput, frameCount, Clock::now());
 }
 
-void AudioEngineImpl::dataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount) {
+void AudioEngineImpl::recordTiming(Clock::time_point due, ma_uint32 frameCount) {
+    if (m_reset_timing.exchange(false, std::memory_order_relaxed)) {
+        m_timed_callbacks.store(0, std::memory_order_relaxed);
+        m_deadline_misses.store(0, std::memory_order_relaxed);
+        m_worst_ns.store(0, std::memory_order_relaxed);
+        m_total_ns.store(0, std::memory_order_relaxed);
+        m_worst_load.store(0.0f, std::memory_order_relaxed);
+    }
+    const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count();
+    const int64_t length = (int64_t)frameCount * 1000000000 / m_format.sample_rate;
+    if (elapsed > length) {
+        m_deadline_misses.store(m_deadline_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    if (elapsed > m_worst_ns.load(std::memory_order_relaxed)) {
+        m_worst_ns.store(elapsed, std::memory_order_relaxed);
+    }
+    const float load = (float)elapsed / length;
+    if (load > m_worst_load.load(std::memory_order_relaxed)) {
+        m_worst_load.store(load, std::memory_order_relaxed);
+    }
+    m_total_ns.store(m_total_ns.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+    m_timed_callbacks.store(m_timed_callbacks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void AudioEngineImpl::dataCallback(void* pOutput, const void* pInput, ma_uint32 frameCount, Clock::time_point due) {
+    // Backends may restart their thread, so set up whichever thread calls.
+    thread_local bool thread_ready = false;
+    if (!thread_ready) {
+        setupAudioThread(m_options.thread);
+        thread_ready = true;
+    }
+    AuRealtimeScope realtime;
     // std::print("Frame count: {}\n", frameCount);
-    int channels = 2;
-    if (m_node_graph == 0) {
-        int size = 0;
-        switch (pDevice->playback.format) {
-            case ma_format_f32:
-                size = 4;
-                break;
-            case ma_format_s16:
-                size = 2;
-                break;
-        }
-        memset(pOutput, 0, size * frameCount * channels);
+    const ma_uint32 channels = m_format.channels;
+    if (!gatherParts()) {
+        memset(pOutput, 0, frameCount * ma_get_bytes_per_frame(m_format.format, channels));
+        m_callbacks.fetch_add(1, std::memory_order_release);
         return;
     }
 
     float* out_f = (float*)pOutput;
     short* out_s = (short*)pOutput;
+    int32_t* out_i = (int32_t*)pOutput;
     float sum2 = 0.0f;
+    size_t p_hist = m_p_hist.load(std::memory_order_relaxed);
+    const bool recording = m_recording.load(std::memory_order_acquire);
 
-
-    for (ma_uint32 i = 0; i < frameCount; ++i) {
-        float sample = std::max(-1.0f, std::min(1.0f, m_node_graph->outputNode()->generate(0)));
-        switch (pDevice->playback.format) {
-            case ma_format_f32:
-                *out_f++ = sample;
-                *out_f++ = sample;
-                break;
-            case ma_format_s16:
-                short s = (short)(sample * 16000);
-                *out_s++ = s;
-                *out_s++ = s;
-                break;
+    for (ma_uint32 done = 0; done < frameCount;) {
+        size_t frames = std::min<size_t>(frameCount - done, m_graph_config.max_frames);
+        // Mono f32 is passed as is, anything else converted into m_capture.
+        AuCaptureBlock capture;
+        const float* direct = nullptr;
+        if (pInput && !m_capture_channels.empty()) {
+            const ma_uint32 capture_channels = m_format.capture_channels;
+            if (m_format.capture_format == ma_format_f32 && capture_channels == 1) {
+                direct = (const float*)pInput + done;
+                capture = {&direct, 1};
+            } else {
+                const size_t offset = done * ma_get_bytes_per_frame(m_format.capture_format, capture_channels);
+                convertCapture((const char*)pInput + offset, m_format.capture_format, capture_channels, frames, m_capture_channels.data());
+                capture = {m_capture_channels.data(), m_capture_channels.size()};
+            }
+        }
+        const float* block = render(frames, capture);
+        if (recording) {
+            m_recorder.write(0, block, frames, (float)m_format.sample_rate);
         }
-        sum2 += sample * sample;
-        m_history[m_p_hist++] = sample;
-        if (m_p_hist == HISTORY_SIZE) {
-            m_p_hist = 0;
+        for (size_t i = 0; i < frames; ++i) {
+            float sample = block ? std::max(-1.0f, std::min(1.0f, block[i])) : 0.0f;
+            switch (m_format.format) {
+                case ma_format_f32:
+                    for (ma_uint32 c = 0; c < channels; ++c) {
+                        *out_f++ = sample;
+                    }
+                    break;
+                case ma_format_s16: {
+                    short s = (short)(sample * 16000);
+                    for (ma_uint32 c = 0; c < channels; ++c) {
+                        *out_s++ = s;
+                    }
+                    break;
+                }
+                case ma_format_s32: {
+                    int32_t s = (int32_t)(sample * 16000 * 65536);
+                    for (ma_uint32 c = 0; c < channels; ++c) {
+                        *out_i++ = s;
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+            sum2 += sample * sample;
+            m_history[p_hist++] = sample;
+            if (p_hist == HISTORY_SIZE) {
+                p_hist = 0;
+            }
         }
+        done += frames;
     }
+    m_p_hist.store(p_hist, std::memory_order_relaxed);
     float rms = sqrt(sum2 / frameCount);
-    m_db = 20 * log10(rms);
+    m_db.store(20 * log10(rms), std::memory_order_relaxed);
+    recordTiming(due, frameCount);
+    m_callbacks.fetch_add(1, std::memory_order_release);
 }
@@ -1,20 +1,143 @@
 #pragma once
 
 #include "audio_graph.h"
+#include "disk_recorder.h"
+#include "realtime_thread.h"
+#include "sinc_resampler.h"
+
+#include <stdint.h>
 
 #include <memory>
+#include <string>
+#include <vector>
+
+enum class AudioSampleFormat { Native, F32, S16, S32 };
+
+// A timer thread in place of the sound card, for soak tests on machines
+// without one. Blocks are due at the period cadence and are timed like a
+// device's, see AudioTimingStats.
+struct AudioSimulation {
+    bool enabled = false;
+    uint32_t sample_rate = 48000;
+    uint32_t channels = 2;
+    float period_variation = 0.0f;  // Blocks vary in size by up to this fraction of the period
+    float jitter_ms = 0.0f;  // Random lateness of each wake up, up to this
+    float preempt_chance = 0.0f;  // Chance per block of the thread being descheduled
+    float preempt_ms = 0.0f;  // For this long
+};
+
+struct AudioDeviceSettings {
+    int device = 0;  // Index into getDevices(), -1 for the system default
+    AudioSampleFormat format = AudioSampleFormat::Native;
+    uint32_t period_frames = 200;
+    uint32_t periods = 2;
+    bool exclusive = true;
+    // Opens a capture device as well and feeds it to AudioInput nodes. They
+    // stay silent while the graph renders at an internal rate.
+    bool duplex = false;
+    int capture_device = 0;  // Index into getCaptureDevices(), -1 for the system default
+    AudioSimulation simulation;
+};
+
+// What the open device runs with, which can differ from what was asked for.
+struct AudioDeviceStatus {
+    std::string name;
+    AudioSampleFormat format = AudioSampleFormat::Native;
+    uint32_t sample_rate = 0;
+    uint32_t channels = 0;
+    uint32_t period_frames = 0;
+    uint32_t periods = 0;
+    // Duplex only.
+    std::string capture_name;
+    AudioSampleFormat capture_format = AudioSampleFormat::Native;
+    uint32_t capture_channels = 0;
+    bool capture_direct = false;  // Mono f32, the graph reads the device buffer as is
+    // Capture buffer, graph latency and playback buffer, the delay an effect
+    // chain adds to a live input.
+    uint32_t round_trip_frames = 0;
+};
 
+// Callback timing since the last reset. A block misses its deadline when it's
+// done later than its length after the device asked for it, or after it was
+// due in a simulation.
+struct AudioTimingStats {
+    uint64_t callbacks = 0;
+    uint64_t deadline_misses = 0;
+    float worst_ms = 0.0f;
+    float average_ms = 0.0f;
+    float worst_load = 0.0f;  // Worst time over block length
+};
+
+struct AudioEngineOptions {
+    AudioDeviceSettings device;
+    AuThreadOptions thread;  // Applied to the device callback thread
+    bool lock_memory = false;  // mlockall() before the device starts
+    // Threads rendering parts along with the callback thread, -1 for one per
+    // other core. Started with the second part. They take thread's options
+    // but aren't pinned.
+    int part_threads = -1;
+};
+
+// How a part, one of the graphs the engine plays at once, is mixed in.
+struct AudioPartSettings {
+    int midi_channel = 0;  // The graph's AuGraphConfig::midi_channel
+    float gain = 1.0f;
+    bool mute = false;  // Muted parts aren't rendered
+};
+
+// Plays up to kMaxParts graphs, like the bass, pad and drums of a set. Each
+// block the parts are rendered concurrently, on the callback thread and the
+// part threads, and summed into the output.
 class AudioEngine {
    public:
+    static constexpr size_t kMaxParts = 16;
+
     virtual ~AudioEngine() {}
     virtual int init() = 0;
+    // Part 0.
     virtual void setGraph(AuNodeGraphPtr graph) = 0;
     virtual AuNodeGraphPtr getGraph() = 0;
+    // nullptr empties the part. A graph can only play in one part. The
+    // previous graph is released once the audio thread is done with it.
+    virtual void setPartGraph(size_t part, AuNodeGraphPtr graph) = 0;
+    virtual AuNodeGraphPtr getPartGraph(size_t part) = 0;
+    // Gain and mute changes are ramped over the next block. A new MIDI
+    // channel prepares the part's graph again, which silences it for a block.
+    virtual void setPartSettings(size_t part, const AudioPartSettings& settings) = 0;
+    virtual AudioPartSettings getPartSettings(size_t part) const = 0;
+    // UI thread. AuNodeGraph::update() of every part's graph. A graph whose
+    // oversampling changed is prepared again first, which silences it for a
+    // block, see AuNodeGraph::needsPrepare().
+    virtual void update() = 0;
     virtual float getDb() const = 0;
     virtual const std::vector<float>& getHistory() const = 0;
     virtual size_t getHistoryPos() const = 0;
+    // Renders the graph at sample_rate and resamples it to the device rate,
+    // or at the device rate if sample_rate is 0.
+    virtual void setInternalRate(float sample_rate, AuResampleQuality quality) = 0;
+    virtual float getInternalRate() const = 0;
+    virtual AuResampleQuality getResampleQuality() const = 0;
+    // Enumerates playback devices again and returns their names.
+    virtual std::vector<std::string> getDevices() = 0;
+    virtual std::vector<std::string> getCaptureDevices() = 0;
+    // Closes the device and opens it with settings. The graph keeps its state
+    // and is prepared again for the new block size. If the new settings don't
+    // work the previous ones are restored and -1 is returned.
+    virtual int openDevice(const AudioDeviceSettings& settings) = 0;
+    virtual AudioDeviceSettings getDeviceSettings() const = 0;
+    virtual AudioDeviceStatus getDeviceStatus() const = 0;
+    virtual AudioTimingStats getTimingStats() const = 0;
+    // Applied by the audio thread on its next callback.
+    virtual void resetTimingStats() = 0;
+    // Records the output, as played but unclipped, to settings.path-out.wav,
+    // and each tapped output of part 0's graph to path-<node><id>-<pin>.wav.
+    // Taps are probed while recording, see AuNodeGraph::setProbe(). Returns
+    // -1 if a file can't be created or a tap isn't in part 0's graph.
+    virtual int startRecording(const AuRecorderSettings& settings, const std::vector<std::pair<AuNodePtr, size_t>>& taps = {}) = 0;
+    virtual void stopRecording() = 0;
+    virtual AuRecorderStats getRecorderStats() const = 0;
 
-    static std::unique_ptr<AudioEngine> create();
+    static std::unique_ptr<AudioEngine> create(const AudioEngineOptions& options = AudioEngineOptions());
 
    private:
 };
@@ -1,5 +1,9 @@
 #include "audio_graph.h"
+#include "envelope_node.h"
+#include "graph_compiler.h"
+#include "graph_jit.h"
 #include "midi_node.h"
+#include "noise_node.h"
 #include <chrono>
 
 
@@ -9,6 +13,194 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <format>
+
+AuNodeGraph::AuNodeGraph() : m_compiler(std::make_unique<AuGraphCompiler>()) {
+}
+
+AuNodeGraph::~AuNodeGraph() {
+    delete m_pending.exchange(nullptr);
+    delete m_retired.exchange(nullptr);
+    delete m_active;
+}
+
+void AuNodeGraph::addNode(AuNodePtr node, uint32_t id) {
+    if (id == 0 || m_node_index.count(id)) {
+        while (m_node_index.count(m_next_id)) {
+            m_next_id++;
+        }
+        id = m_next_id++;
+    }
+    node->m_id = id;
+    node->prepare(nodeConfig(*node));
+    m_node_index[id] = m_nodes.size();
+    m_nodes.push_back(node);
+    m_edits.nodes.push_back(node.get());
+}
+
+void AuNodeGraph::setOutputNode(AuNodePtr node) {
+    m_output_node = node;
+    m_dirty = true;
+}
+
+void AuNodeGraph::connect(AuNodePtr node, size_t pin, AuNodePtr upstream, size_t index) {
+    node->inPin(pin).connect(upstream, index);
+    m_edits.nodes.push_back(node.get());
+}
+
+void AuNodeGraph::disconnect(AuNodePtr node, size_t pin) {
+    node->inPin(pin).disconnect();
+    m_edits.nodes.push_back(node.get());
+}
+
+void AuNodeGraph::setValue(AuNodePtr node, size_t pin, float value) {
+    Pin& input = node->inPin(pin);
+    input.m_value = value;
+    AuParamChange change = {&input.param(), value};
+    if (!m_unsent_changes.empty() || !m_param_changes.push(change)) {
+        m_unsent_changes.push_back(change);
+    }
+    m_edits.values.emplace_back(node.get(), pin);
+}
+
+void AuNodeGraph::setOversampling(AuNodePtr node, size_t factor) {
+    // Not applied right away: the audio thread may be running the node with
+    // buffers sized for the current factor.
+    std::erase_if(m_oversampling_changes, [&](const auto& change) { return change.first == node; });
+    if (factor != node->oversampling()) {
+        m_oversampling_changes.emplace_back(node, factor);
+    }
+}
+
+void AuNodeGraph::setProbe(AuNodePtr node, size_t pin, bool enabled) {
+    Pin& output = node->outPin(pin);
+    if (enabled && !output.m_probe) {
+        output.m_probe = std::make_unique<AuProbe>();
+    }
+    output.m_probed = enabled;
+    m_edits.nodes.push_back(node.get());
+}
+
+void AuNodeGraph::setJit(bool enabled) {
+    if (enabled != (m_jit != nullptr)) {
+        m_jit = enabled ? std::make_unique<AuJitCompiler>() : nullptr;
+        m_dirty = true;
+    }
+}
+
+void AuNodeGraph::prepare(const AuGraphConfig& config) {
+    m_config = config;
+    for (const auto& [node, factor] : m_oversampling_changes) {
+        node->m_oversampling = factor;
+    }
+    m_oversampling_changes.clear();
+    for (const auto& node : m_nodes) {
+        node->prepare(nodeConfig(*node));
+    }
+    m_dirty = true;
+    commit();
+    // process() isn't running, so swap in the new plan now. The old one may
+    // be sized for a smaller block than the next process() call.
+    delete m_retired.exchange(nullptr, std::memory_order_acquire);
+    delete m_active;
+    m_active = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+}
+
+AuGraphConfig AuNodeGraph::nodeConfig(const AuNode& node) const {
+    // At control rate an oversampled node runs ticks, fewer frames than this.
+    AuGraphConfig config = m_config;
+    const size_t factor = node.oversampling();
+    if (factor == 2 || factor == 4 || factor == 8) {
+        config.max_frames *= factor;
+        config.sample_rate *= factor;
+    }
+    return config;
+}
+
+void AuNodeGraph::update() {
+    if (AuGraphPlan* retired = m_retired.exchange(nullptr, std::memory_order_acquire)) {
+        m_compiler->recycle(std::unique_ptr<AuGraphPlan>(retired));
+    }
+    size_t sent = 0;
+    while (sent < m_unsent_changes.size() && m_param_changes.push(m_unsent_changes[sent])) {
+        sent++;
+    }
+    m_unsent_changes.erase(m_unsent_changes.begin(), m_unsent_changes.begin() + sent);
+    if (m_jit && m_jit->poll()) {
+        m_edits.jit_ready = true;
+    }
+    if (m_dirty || !m_edits.empty()) {
+        commit();
+    }
+}
+
+void AuNodeGraph::commit() {
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    std::unique_ptr<AuGraphPlan> plan = m_dirty ? m_compiler->compile(*this) : m_compiler->recompile(*this, m_edits);
+    m_stats.compile_ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    m_stats.patched = !m_dirty && m_compiler->patched();
+    m_stats.jit_pending = m_jit ? m_jit->pending() : 0;
+    m_edits = AuGraphEdits();
+    m_dirty = false;
+    if (!plan) {
+        return;
+    }
+    m_stats.audio_nodes = plan->audioNodes();
+    m_stats.control_nodes = plan->controlNodes();
+    m_stats.specialized_nodes = plan->specializedNodes();
+    m_stats.oversampled_nodes = plan->oversampledNodes();
+    m_stats.latency = plan->latency();
+    m_stats.fused_nodes = plan->fusedNodes();
+    m_stats.fused_kernels = plan->fusedKernels();
+    if (AuGraphPlan* unused = m_pending.exchange(plan.release(), std::memory_order_acq_rel)) {
+        m_compiler->recycle(std::unique_ptr<AuGraphPlan>(unused));
+    }
+}
+
+void AuNodeGraph::applyParamChanges() {
+    const size_t ramp_frames = (size_t)(m_config.smoothing_time * m_config.sample_rate);
+    AuParamChange change;
+    while (m_param_changes.pop(change)) {
+        AuParam& param = *change.param;
+        param.target = change.value;
+        param.remaining = ramp_frames;
+        if (ramp_frames == 0) {
+            param.current = change.value;
+        } else {
+            param.step = (param.target - param.current) / ramp_frames;
+        }
+        param.published.store(change.value, std::memory_order_relaxed);
+    }
+}
+
+const float* AuNodeGraph::process(size_t frames, const AuCaptureBlock& capture) {
+    applyParamChanges();
+    if (m_pending.load(std::memory_order_acquire) && !m_retired.load(std::memory_order_acquire)) {
+        if (AuGraphPlan* plan = m_pending.exchange(nullptr, std::memory_order_acq_rel)) {
+            if (m_active) {
+                plan->adopt(*m_active);
+            }
+            m_retired.store(m_active, std::memory_order_release);
+            m_active = plan;
+        }
+    }
+    return m_active ? m_active->process(frames, capture) : nullptr;
+}
+
+void AuNodeBase::process(const AuProcessContext& ctx) {
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        for (size_t k = 0; k < m_in_pins.size(); ++k) {
+            size_t frame = m_in_pins[k].rate() == AuRate::Audio ? i : i / ctx.tick_frames;
+            m_in_pins[k].m_current = ctx.inputs[k][frame];
+        }
+        for (size_t k = 0; k < m_out_pins.size(); ++k) {
+            ctx.outputs[k][i] = generate(k);
+        }
+    }
+}
+
 size_t AuNodeBase::inPins() {
     return m_in_pins.size();
 }
@@ -25,62 +217,95 @@ Pin& AuNodeBase::outPin(size_t index) {
     return m_out_pins[index];
 }
 
-void AuNodeBase::addInPin(const std::string& name, float value) {
-    m_in_pins.emplace_back(name, value);
+void AuNodeBase::addInPin(const std::string& name, float value, AuRate rate) {
+    m_in_pins.emplace_back(name, value, rate);
 }
 
 void AuNodeBase::addOutPin(const std::string& name) {
     m_out_pins.emplace_back(name, 0.0f);
 }
 
-AuJitterGenerator::AuJitterGenerator() {
-    addInPin("input", 1.0);
-    addInPin("jitter", 0.1);
-    addOutPin("out");
-
-}
-
-float AuJitterGenerator::generate(size_t index) {
-    float input = inPin(0).generate();
-    float jitter_factor = inPin(1).generate()*input;
-
-    float r = rand() / (float)RAND_MAX;
-
-    return ((jitter_factor * r)-jitter_factor*0.5) + input;
-
-}
-
 AuSineGenerator::AuSineGenerator() {
     addInPin("frequency", 440);
     addInPin("amplitude", 1);
     addOutPin("out");
     m_phase = 0;
-    m_multiplier = 2.0 * M_PI / 48000.0;
 }
 
-float AuSineGenerator::generate(size_t index) {
-    assert(index < outPins());
-    m_phase += inPin(0).generate() * m_multiplier;
-    while (m_phase > (2 * M_PI)) {
-        m_phase -= (2 * M_PI);
+void AuSineGenerator::process(const AuProcessContext& ctx) {
+    kernel<false, Amp::Buffer>(*this, ctx);
+}
+
+AuKernel AuSineGenerator::specialize(uint32_t constant_mask) {
+    const bool const_freq = constant_mask & 1;
+    if (!(constant_mask & 2)) {
+        return const_freq ? &kernel<true, Amp::Buffer> : &kernel<false, Amp::Buffer>;
     }
-    return inPin(1).generate() * sin(m_phase);
+    if (inPin(1).value() == 1.0f) {
+        return const_freq ? &kernel<true, Amp::Unity> : &kernel<false, Amp::Unity>;
+    }
+    return const_freq ? &kernel<true, Amp::Constant> : &kernel<false, Amp::Constant>;
+}
+
+template <bool kConstFreq, AuSineGenerator::Amp kAmp>
+void AuSineGenerator::kernel(AuNode& node, const AuProcessContext& ctx) {
+    auto& self = static_cast<AuSineGenerator&>(node);
+    const float* freq = ctx.in(0);
+    const float* amp = ctx.in(1);
+    float* out = ctx.out(0);
+    const float multiplier = 2.0 * M_PI / ctx.sample_rate;
+    const float increment = freq[0] * multiplier;
+    const float amp0 = amp[0];
+    float phase = self.m_phase;
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        phase += kConstFreq ? increment : freq[i] * multiplier;
+        while (phase > (2 * M_PI)) {
+            phase -= (2 * M_PI);
+        }
+        if constexpr (kAmp == Amp::Unity) {
+            out[i] = sin(phase);
+        } else if constexpr (kAmp == Amp::Constant) {
+            out[i] = amp0 * sin(phase);
+        } else {
+            out[i] = amp[i] * sin(phase);
+        }
+    }
+    self.m_phase = phase;
+}
+
+bool AuSineGenerator::emit(AuCodegen& gen) {
+    const std::string phase = gen.state(m_phase);
+    const float multiplier = 2.0 * M_PI / gen.sampleRate();
+    gen.line(std::format("{} += {} * {};", phase, gen.in(0), AuCodegen::literal(multiplier)));
+    gen.line(std::format("while ({0} > (2 * M_PI)) {0} -= (2 * M_PI);", phase));
+    gen.line(std::format("{} = {} * sin({});", gen.out(0), gen.in(1), phase));
+    return true;
 }
 
 AuEMAGenerator::AuEMAGenerator() {
     addInPin("in", 0);
-    addInPin("alpha", 0.9);
+    addInPin("alpha", 0.9, AuRate::Control);
     addOutPin("out");
     m_alpha = 0.9;
     m_previous = 0.0;
 }
 
-float AuEMAGenerator::generate(size_t index) {
-    float current = inPin(0).generate();
-    m_alpha = inPin(1).generate();
-    float out = m_alpha * current + (1.0 - m_alpha) * m_previous;
-    m_previous = out;
-    return out;
+void AuEMAGenerator::process(const AuProcessContext& ctx) {
+    const float* in = ctx.in(0);
+    const float* alpha = ctx.in(1);
+    float* out = ctx.out(0);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        m_alpha = alpha[i / ctx.tick_frames];
+        m_previous = m_alpha * in[i] + (1.0 - m_alpha) * m_previous;
+        out[i] = m_previous;
+    }
+}
+
+bool AuEMAGenerator::emit(AuCodegen& gen) {
+    const std::string previous = gen.state(m_previous);
+    gen.line(std::format("{0} = {1} * {2} + (1.0 - {1}) * {0};", previous, gen.in(1), gen.in(0)));
+    gen.line(std::format("{} = {};", gen.out(0), previous));
+    return true;
 }
 
 namespace {
@@ -113,7 +338,7 @@ void stairs(int& reflect, float& time, float& height, float& wait) {
 AuHexGenerator::AuHexGenerator() {
     addInPin("frequency", 440);
     addInPin("amplitude", 1);
-    addInPin("type", 0);
+    addInPin("type", 0, AuRate::Control);
     addOutPin("out");
     //                     reflect   time   height   wait
     //      Sawtooth          1       1      any      0
@@ -142,9 +367,7 @@ AuHexGenerator::~AuHexGenerator() {
     delete m_osc;
 }
 
-float AuHexGenerator::generate(size_t index) {
-    assert(index < outPins());
-    int wave_type = (int)inPin(2).generate();
+void AuHexGenerator::updateWaveType(int wave_type) {
     if (wave_type != m_wave_type) {
         m_wave_type = wave_type;
         int reflect;
@@ -165,11 +388,44 @@ float AuHexGenerator::generate(size_t index) {
         }
         hexwave_change(m_osc, reflect, time, height, wait);
     }
-    // If this is smaller than this hexwave writes beyond the buffer with triangle
-    // wave
-    float samples[16];
-    hexwave_generate_samples(samples, 1, m_osc, inPin(0).generate() / 48000.0f);
-    return inPin(1).generate() * samples[0];
+}
+
+void AuHexGenerator::process(const AuProcessContext& ctx) {
+    updateWaveType((int)ctx.in(2)[0]);
+    const float* freq = ctx.in(0);
+    const float* amp = ctx.in(1);
+    float* out = ctx.out(0);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        // If this is smaller than this hexwave writes beyond the buffer with triangle
+        // wave
+        float samples[16];
+        hexwave_generate_samples(samples, 1, m_osc, freq[i] / ctx.sample_rate);
+        out[i] = amp[i] * samples[0];
+    }
+}
+
+AuKernel AuHexGenerator::specialize(uint32_t constant_mask) {
+    if (!(constant_mask & 1)) {
+        return nullptr;
+    }
+    const bool unity_amp = (constant_mask & 2) && inPin(1).value() == 1.0f;
+    return unity_amp ? &constantFrequencyKernel<true> : &constantFrequencyKernel<false>;
+}
+
+// With a fixed frequency the whole block is rendered in one call, which lets
+// hexwave run its segment loop without restarting every sample.
+template <bool kUnityAmp>
+void AuHexGenerator::constantFrequencyKernel(AuNode& node, const AuProcessContext& ctx) {
+    auto& self = static_cast<AuHexGenerator&>(node);
+    self.updateWaveType((int)ctx.in(2)[0]);
+    float* out = ctx.out(0);
+    hexwave_generate_samples(out, (int)ctx.frames, self.m_osc, ctx.in(0)[0] / ctx.sample_rate);
+    if constexpr (!kUnityAmp) {
+        const float* amp = ctx.in(1);
+        for (size_t i = 0; i < ctx.frames; ++i) {
+            out[i] *= amp[i];
+        }
+    }
 }
 
 AuSub::AuSub() {
@@ -178,87 +434,56 @@ AuSub::AuSub() {
     addOutPin("out");
 }
 
-float AuSub::generate(size_t index) {
-    assert(index < outPins());
-    return inPin(0).generate() - inPin(1).generate();
+void AuSub::process(const AuProcessContext& ctx) {
+    const float* in1 = ctx.in(0);
+    const float* in2 = ctx.in(1);
+    float* out = ctx.out(0);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] = in1[i] - in2[i];
+    }
 }
 
-AuADSR::AuADSR() : m_t(0), m_last(-1), m_r(0) {
-    addInPin("amplitude", 1);
-    addInPin("A", 0.1);
-    addInPin("D", 0.4);
-    addInPin("S", 0.6);
-    addInPin("R", 0.8);
-    addOutPin("out");
+AuKernel AuSub::specialize(uint32_t constant_mask) {
+    switch (constant_mask & 3) {
+        case 3:
+            return &constantKernel;
+        case 1:
+            return &constantIn1Kernel;
+        case 2:
+            return inPin(1).value() == 0.0f ? &passThroughKernel : &constantIn2Kernel;
+    }
+    return nullptr;
 }
 
-namespace {
-float calcADS(float t, float A, float D, float S) {
-    if (t <= A) { // We're in attack phase, raise until t == A
-        float a = (t / A);
-        return a;
-    }
-    t -= A;
-    if (t <= D) { // We're in decay phase, lower until t == A + D
-        float d = (1 - t / D);
-        float a = S + d * (1 - S);
-        return a;
-    }
-    return S; // We're in sustain phase, return S while note on
+bool AuSub::emit(AuCodegen& gen) {
+    gen.line(std::format("{} = {} - {};", gen.out(0), gen.in(0), gen.in(1)));
+    return true;
 }
-}  // namespace
 
-class DePopper {
-   public:
-    float value(float value) {
-        const float delta = 0.01f;
-        float diff = abs(value - m_last);
-        if (diff < delta) {
-            m_last = value;
-        } else {
-            if (value < m_last) {
-                m_last = m_last - delta;
-            } else {
-                m_last = m_last + delta;
-            }
-        }
-        return sqrt(m_last);
-    }
+void AuSub::constantKernel(AuNode& node, const AuProcessContext& ctx) {
+    std::fill_n(ctx.out(0), ctx.frames, ctx.in(0)[0] - ctx.in(1)[0]);
+}
 
-   private:
-    float m_last = 0.0f;
-};
-
-
-float AuADSR::generate(size_t index) {
-    static DePopper de_popper;
-    const float amplitude = inPin(0).generate();
-    const float A = inPin(1).generate();
-    const float D = inPin(2).generate();
-    const float S = std::min(inPin(3).generate(), 1.0f);
-    const float R = inPin(4).generate();
-
-    float ads = calcADS(m_t, A, D, S);
-    m_t += 1.0 / 48000.0;
-    // Assume note change when amplitude change
-    if (amplitude != m_last) {
-        // Assume note off, start release phase from current value
-        if (amplitude == 0) {
-            m_r = ads * m_last;
-            m_rc = m_r / (R * 48000.0f);
-        }
-        if (amplitude != 0 || m_r == 0) {
-            m_t = 0;
-            ads = calcADS(m_t, A, D, S);
-            m_r = 0;
-        }
-        m_last = amplitude;
+void AuSub::constantIn1Kernel(AuNode& node, const AuProcessContext& ctx) {
+    const float in1 = ctx.in(0)[0];
+    const float* in2 = ctx.in(1);
+    float* out = ctx.out(0);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] = in1 - in2[i];
     }
-    if (m_r > 0) {
-        m_r = std::max(0.0f, m_r - m_rc);
-        return de_popper.value(m_r);
+}
+
+void AuSub::constantIn2Kernel(AuNode& node, const AuProcessContext& ctx) {
+    const float* in1 = ctx.in(0);
+    const float in2 = ctx.in(1)[0];
+    float* out = ctx.out(0);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] = in1[i] - in2;
     }
-    return de_popper.value(amplitude * ads);
+}
+
+void AuSub::passThroughKernel(AuNode& node, const AuProcessContext& ctx) {
+    std::copy_n(ctx.in(0), ctx.frames, ctx.out(0));
 }
 
 AuNodeGraphPtr createTestGraph() {
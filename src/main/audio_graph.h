@@ -3,27 +3,138 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "probe.h"
+#include "spsc_queue.h"
+
 
 
 
 class AuNode;
 class AuNodeGraph;
+class AuGraphPlan;
+class AuGraphCompiler;
+class AuCodegen;
+class AuJitCompiler;
 
 using AuNodePtr = std::shared_ptr<AuNode>;
 using AuNodeGraphPtr = std::shared_ptr<AuNodeGraph>;
 
+// How often a pin or node is evaluated. Control rate values are computed once
+// per control tick (AuGraphConfig::control_period frames) and reach audio rate
+// consumers as linear ramps. Init rate inputs are latched once when the graph
+// is (re)compiled.
+enum class AuRate { Audio, Control, Init };
+
+struct AuGraphConfig {
+    float sample_rate = 48000.0f;
+    size_t max_frames = 512;
+    size_t control_period = 32;
+    float smoothing_time = 0.02f;  // Seconds to ramp edited constants
+    int midi_channel = 0;  // Read by MidiIn nodes, 1 to 16, or 0 for every channel
+};
+
+// Audio thread state of an input pin's constant value. Edits arrive as
+// AuParamChange messages and are applied at block boundaries as a linear ramp
+// from current to target.
+struct AuParam {
+    explicit AuParam(float value) : current(value), target(value), published(value) {}
+
+    float current;
+    float target;
+    float step = 0.0f;
+    size_t remaining = 0;
+    // Last target the audio thread applied, for the UI to read back.
+    std::atomic<float> published;
+};
+
+struct AuParamChange {
+    AuParam* param;
+    float value;
+};
+
+// Arguments to AuNode::process(). Audio rate inputs and all outputs hold
+// frames values. Control and init rate inputs hold one value per control tick,
+// so the value at frame i is in(k)[i / tick_frames]. A node that runs at
+// control rate sees everything at tick resolution: frames is the tick count,
+// tick_frames is 1 and sample_rate is the tick rate.
+struct AuProcessContext {
+    size_t frames;
+    size_t tick_frames;
+    float sample_rate;
+    const float* const* inputs;
+    float* const* outputs;
+
+    const float* in(size_t index) const {
+        return inputs[index];
+    }
+    float* out(size_t index) const {
+        return outputs[index];
+    }
+    size_t ticks() const {
+        return (frames + tick_frames - 1) / tick_frames;
+    }
+};
+
+// Audio captured by the engine for the block about to be processed, one
+// buffer of frames per device channel. Read by nodes with
+// AuNode::captureChannel().
+struct AuCaptureBlock {
+    const float* const* channels = nullptr;
+    size_t count = 0;
+};
+
+// A process() variant picked by AuNode::specialize().
+using AuKernel = void (*)(AuNode& node, const AuProcessContext& ctx);
+
+// Edits since the last plan, for AuGraphCompiler::recompile().
+struct AuGraphEdits {
+    std::vector<AuNode*> nodes;  // Added, or inputs or probes changed
+    std::vector<std::pair<AuNode*, size_t>> values;  // Inputs set with setValue()
+    bool jit_ready = false;  // Fused kernels finished compiling
+
+    bool empty() const {
+        return nodes.empty() && values.empty() && !jit_ready;
+    }
+};
+
 class AuNodeGraph {
    public:
-    void addNode(AuNodePtr node) {
-        m_nodes.push_back(node);
-    }
-    void setOutputNode(AuNodePtr node) {
-        m_output_node = node;
+    AuNodeGraph();
+    ~AuNodeGraph();
+
+    // Edits, UI thread. Changes reach the audio thread on the next update().
+    // id restores a saved AuNode::id(); 0, or an id already in use, picks the
+    // next free one.
+    void addNode(AuNodePtr node, uint32_t id = 0);
+    void setOutputNode(AuNodePtr node);
+    void connect(AuNodePtr node, size_t pin, AuNodePtr upstream, size_t index);
+    void disconnect(AuNodePtr node, size_t pin);
+    // Sends the new value to the audio thread right away, where it's smoothed
+    // in over smoothing_time. The node is re-specialized for the new value on
+    // the next update().
+    void setValue(AuNodePtr node, size_t pin, float value);
+    // Runs the node and connected nodes with the same factor oversampled.
+    // The node has to be prepared again for the new block size and rate, so
+    // the factor only applies from the next prepare(), see needsPrepare().
+    void setOversampling(AuNodePtr node, size_t factor);
+    // Has the plan publish each block of an output to its Pin::probe(), from
+    // the next recompile on. Outputs of nodes the output node doesn't reach
+    // aren't computed, so their probes stay empty.
+    void setProbe(AuNodePtr node, size_t pin, bool enabled);
+    // Fuses runs of nodes that support AuNode::emit() into native kernels,
+    // compiled in the background. Plans use the interpreter until a run's
+    // kernel is ready, then swap it in with the next recompile.
+    void setJit(bool enabled);
+
+    AuJitCompiler* jit() const {
+        return m_jit.get();
     }
 
     AuNodePtr getOutputNode() const {
@@ -34,28 +145,113 @@ class AuNodeGraph {
         return m_output_node;
     }
 
-    const std::vector<AuNodePtr> nodes() const {
+    const std::vector<AuNodePtr>& nodes() const {
         return m_nodes;
     }
 
+    // The node with AuNode::id() id, or nullptr.
+    AuNodePtr findNode(uint32_t id) const {
+        auto it = m_node_index.find(id);
+        return it != m_node_index.end() ? m_nodes[it->second] : nullptr;
+    }
+
+    const AuGraphConfig& config() const {
+        return m_config;
+    }
+
+    // Must not be called while process() may run. Prepares each node with
+    // max_frames and sample_rate multiplied by its oversampling factor.
+    void prepare(const AuGraphConfig& config);
+    // True while oversampling changes wait for prepare(). AudioEngine
+    // prepares the graphs it plays again when they do.
+    bool needsPrepare() const {
+        return !m_oversampling_changes.empty();
+    }
+    // UI thread. Recompiles if the graph was edited and frees plans the audio
+    // thread is done with. Most edits only patch the part of the plan they
+    // touch, see AuGraphCompiler::recompile().
+    void update();
+    // Audio thread. Renders frames (<= max_frames) of the output node.
+    // capture must stay valid until the call returns.
+    const float* process(size_t frames, const AuCaptureBlock& capture = AuCaptureBlock());
+
+    struct Stats {
+        size_t audio_nodes = 0;
+        size_t control_nodes = 0;
+        size_t specialized_nodes = 0;
+        size_t oversampled_nodes = 0;
+        float latency = 0.0f;  // Frames
+        size_t fused_nodes = 0;
+        size_t fused_kernels = 0;
+        size_t jit_pending = 0;  // Kernels still compiling
+        float compile_ms = 0.0f;  // Last recompile
+        bool patched = false;  // Last recompile patched the previous plan
+    };
+    Stats stats() const {
+        return m_stats;
+    }
+
    private:
+    void commit();
+    void applyParamChanges();
+    AuGraphConfig nodeConfig(const AuNode& node) const;
+
     std::vector<AuNodePtr> m_nodes;
+    std::unordered_map<uint32_t, size_t> m_node_index;  // id to index in m_nodes
+    uint32_t m_next_id = 1;
     AuNodePtr m_output_node;
+    AuGraphConfig m_config;
+    bool m_dirty = true;  // Needs a full compile
+    AuGraphEdits m_edits;
+    std::vector<std::pair<AuNodePtr, size_t>> m_oversampling_changes;  // Applied by prepare()
+    std::unique_ptr<AuGraphCompiler> m_compiler;
+    Stats m_stats;
+
+    // Plans are built on the UI thread and handed over through m_pending. The
+    // audio thread hands the plan it replaced back through m_retired, and
+    // won't take a new plan until the UI thread has freed the old one.
+    std::atomic<AuGraphPlan*> m_pending{nullptr};
+    std::atomic<AuGraphPlan*> m_retired{nullptr};
+    AuGraphPlan* m_active = nullptr;
+
+    SpscQueue<AuParamChange, 1024> m_param_changes;
+    std::vector<AuParamChange> m_unsent_changes;  // Queue was full, retried in update()
+
+    std::unique_ptr<AuJitCompiler> m_jit;
 };
 
 class Pin {
    public:
-    Pin(const std::string& name, float value) : m_name(name), m_value(value) {}
-    float generate() const;
+    Pin(const std::string& name, float value, AuRate rate = AuRate::Audio)
+        : m_name(name), m_value(value), m_rate(rate), m_param(std::make_unique<AuParam>(value)) {}
+
+    // Value at the current frame, valid inside AuNodeBase::generate().
+    float generate() const {
+        return m_current;
+    }
 
+    // Sets the initial value of a node that isn't processed yet. Use
+    // AuNodeGraph::setValue() for live edits.
     void set(float value) {
         m_value = value;
+        m_param->current = m_param->target = value;
+        m_param->published.store(value, std::memory_order_relaxed);
     }
 
-    float& value() {
+    // The value last set from the UI thread.
+    float value() const {
         return m_value;
     }
 
+    // The value the audio thread has applied.
+    float published() const {
+        return m_param->published.load(std::memory_order_relaxed);
+    }
+
+    AuParam& param() {
+        return *m_param;
+    }
+
     void connect(AuNodePtr node, size_t index) {
         m_connection = node;
         m_index = index;
@@ -77,32 +273,128 @@ class Pin {
         return m_name;
     }
 
+    AuRate rate() const {
+        return m_rate;
+    }
+
+    // Last value a control rate output was ramped to, audio thread only.
+    float& rampFrom() {
+        return m_ramp_from;
+    }
+
+    // Snapshots of a probed output, or nullptr, see AuNodeGraph::setProbe().
+    AuProbe* probe() const {
+        return m_probed ? m_probe.get() : nullptr;
+    }
+
    private:
+    friend class AuNodeBase;
+    friend class AuNodeGraph;
+
     std::string m_name;
     float m_value;
+    AuRate m_rate;
+    std::unique_ptr<AuParam> m_param;
     AuNodePtr m_connection;
-    size_t m_index;
+    size_t m_index = 0;
+    float m_current = 0.0f;
+    float m_ramp_from = 0.0f;
+    bool m_probed = false;
+    // Made when the pin is first probed and kept, a retired plan may still be
+    // publishing to it.
+    std::unique_ptr<AuProbe> m_probe;
 };
 
 class AuNode {
    public:
     virtual ~AuNode() {}
-    virtual float generate(size_t index) = 0;
+    // Called off the audio thread before the node is processed, and again
+    // whenever the sample rate, maximum block size or oversampling changes.
+    // max_frames and sample_rate are already multiplied by oversampling().
+    virtual void prepare(const AuGraphConfig& config) {}
+    virtual void process(const AuProcessContext& ctx) = 0;
+    // Called when the graph is compiled. Bit i of constant_mask is set when
+    // input i is unconnected, so its buffer holds inPin(i).value() for the
+    // whole block. Returns a kernel specialized for those constants, or
+    // nullptr to use process(). The plan falls back to process() as soon as
+    // one of the constants is edited, until the graph is compiled again.
+    virtual AuKernel specialize(uint32_t constant_mask) {
+        return nullptr;
+    }
+    // Writes C++ that computes one frame of every output and returns true,
+    // or returns false if the node can't be fused, see AuCodegen. The code
+    // must match what process() computes.
+    virtual bool emit(AuCodegen& gen) {
+        return false;
+    }
+    // Control forces the node to control rate. Audio lets the compiler pick
+    // control rate when no consumer needs audio rate values.
+    virtual AuRate rate() const {
+        return AuRate::Audio;
+    }
+    // True if the node must run at rate() even when no consumer needs it.
+    virtual bool fixedRate() const {
+        return false;
+    }
+    // Capture channel the node's first output passes through, or -1. Such
+    // nodes aren't processed; the plan hands their readers the captured
+    // block, see AuCaptureBlock.
+    virtual int captureChannel() const {
+        return -1;
+    }
     virtual size_t inPins() = 0;
     virtual Pin& inPin(size_t index) = 0;
     virtual size_t outPins() = 0;
     virtual Pin& outPin(size_t index) = 0;
     virtual std::string_view name() const = 0;
+
+    // A text setting besides the pin values, like the file a sample player
+    // plays, saved with the graph. Nodes without one return an empty name.
+    virtual std::string_view settingsName() const {
+        return {};
+    }
+    virtual std::string settings() const {
+        return {};
+    }
+    // UI thread. Keeps the setting even if it can't be applied, then prints
+    // the reason and returns false.
+    virtual bool setSettings(const std::string& settings) {
+        return false;
+    }
+
+    // Audio rate nodes run at this multiple of the engine rate: 1, 2, 4 or 8.
+    // Set with AuNodeGraph::setOversampling().
+    size_t oversampling() const {
+        return m_oversampling;
+    }
+
+    // Unique in the node's graph and kept across save and load, so the editor
+    // can key its layout on it. 0 until the node is added to a graph.
+    uint32_t id() const {
+        return m_id;
+    }
+
+   private:
+    friend class AuNodeGraph;
+
+    size_t m_oversampling = 1;
+    uint32_t m_id = 0;
 };
 
+// Nodes either override process() or compute one sample at a time in
+// generate(), reading their inputs with Pin::generate().
 class AuNodeBase : public AuNode {
    public:
+    void process(const AuProcessContext& ctx) override;
+    virtual float generate(size_t index) {
+        return 0.0f;
+    }
     size_t inPins() override;
     Pin& inPin(size_t index) override;
     size_t outPins() override;
     Pin& outPin(size_t index) override;
 
-    void addInPin(const std::string& name, float value);
+    void addInPin(const std::string& name, float value, AuRate rate = AuRate::Audio);
     void addOutPin(const std::string& name);
 
    protected:
@@ -110,21 +402,22 @@ class AuNodeBase : public AuNode {
     std::vector<Pin> m_out_pins;
 };
 
-inline float Pin::generate() const {
-    return m_connection ? m_connection->generate(m_index) : m_value;
-}
-
 class AuSineGenerator : public AuNodeBase {
    public:
     AuSineGenerator();
-    float generate(size_t index) override;
+    void process(const AuProcessContext& ctx) override;
+    AuKernel specialize(uint32_t constant_mask) override;
+    bool emit(AuCodegen& gen) override;
     std::string_view name() const {
         return "SineGenerator";
     }
 
    private:
+    enum class Amp { Buffer, Constant, Unity };
+    template <bool kConstFreq, Amp kAmp>
+    static void kernel(AuNode& node, const AuProcessContext& ctx);
+
     float m_phase;
-    float m_multiplier;
 };
 
 /*
@@ -150,7 +443,8 @@ class AuLooper : public AuNodeBase {
 class AuEMAGenerator : public AuNodeBase {
    public:
     AuEMAGenerator();
-    float generate(size_t index) override;
+    void process(const AuProcessContext& ctx) override;
+    bool emit(AuCodegen& gen) override;
     std::string_view name() const {
         return "EMAGenerator";
     }
@@ -160,30 +454,23 @@ class AuEMAGenerator : public AuNodeBase {
     float m_alpha;
 };
 
-class AuJitterGenerator : public AuNodeBase {
-   public:
-    AuJitterGenerator();
-    float generate(size_t index) override;
-    std::string_view name() const {
-        return "JitterGenerator";
-    }
-
-   private:
- };
-
-
 struct HexWave;
 
 class AuHexGenerator : public AuNodeBase {
    public:
     AuHexGenerator();
     ~AuHexGenerator();
-    float generate(size_t index) override;
+    void process(const AuProcessContext& ctx) override;
+    AuKernel specialize(uint32_t constant_mask) override;
     std::string_view name() const {
         return "HexGenerator";
     }
 
    private:
+    void updateWaveType(int wave_type);
+    template <bool kUnityAmp>
+    static void constantFrequencyKernel(AuNode& node, const AuProcessContext& ctx);
+
     HexWave* m_osc;
     int m_wave_type;
 };
@@ -191,24 +478,18 @@ class AuHexGenerator : public AuNodeBase {
 class AuSub : public AuNodeBase {
    public:
     AuSub();
-    float generate(size_t index) override;
+    void process(const AuProcessContext& ctx) override;
+    AuKernel specialize(uint32_t constant_mask) override;
+    bool emit(AuCodegen& gen) override;
     std::string_view name() const {
         return "Sub";
     }
-};
 
-class AuADSR : public AuNodeBase {
-   public:
-    AuADSR();
-    float generate(size_t index) override;
-    std::string_view name() const {
-        return "ADSR";
-    }
    private:
-    float m_t;      // Time since note started
-    float m_last;   // Last amplitude to see if note changed
-    float m_r;      // Current release amplitude after note off
-    float m_rc;     // Amount to subtract from release each sample
+    static void constantKernel(AuNode& node, const AuProcessContext& ctx);
+    static void constantIn1Kernel(AuNode& node, const AuProcessContext& ctx);
+    static void constantIn2Kernel(AuNode& node, const AuProcessContext& ctx);
+    static void passThroughKernel(AuNode& node, const AuProcessContext& ctx);
 };
 
 AuNodeGraphPtr createTestGraph();
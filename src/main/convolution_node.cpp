@@ -0,0 +1,477 @@
+#include "convolution_node.h"
+
+#include "realtime_thread.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <chrono>
+#include <print>
+#define NOMINMAX
+#include <miniaudio.h>
+
+namespace {
+
+constexpr size_t kHeadEnd = 2048;  // First tap of the tails
+constexpr size_t kFirstTail = 1024;
+constexpr size_t kLastTail = 65536;
+constexpr float kMaxSeconds = 60.0f;
+
+// sum += a * b, bin by bin.
+void multiplyAdd(const float* ar, const float* ai, const float* br, const float* bi, float* sr, float* si, size_t bins) {
+    for (size_t k = 0; k < bins; ++k) {
+        sr[k] += ar[k] * br[k] - ai[k] * bi[k];
+        si[k] += ar[k] * bi[k] + ai[k] * br[k];
+    }
+}
+
+// Spectra of response[begin, end) cut into parts of size taps, each zero
+// padded to an FFT of twice that and scaled by the inverse FFT's 1 / size.
+// Stored [channel][part][bin].
+size_t transformParts(const std::vector<std::vector<float>>& response, size_t begin, size_t end, size_t size, AuFft& fft,
+                      std::vector<float>& re, std::vector<float>& im) {
+    const size_t parts = (end - begin + size - 1) / size;
+    const size_t bins = fft.bins();
+    re.assign(response.size() * parts * bins, 0.0f);
+    im.assign(response.size() * parts * bins, 0.0f);
+    std::vector<float> padded(2 * size);
+    const float scale = 1.0f / fft.size();
+    for (size_t c = 0; c < response.size(); ++c) {
+        for (size_t p = 0; p < parts; ++p) {
+            std::fill(padded.begin(), padded.end(), 0.0f);
+            const size_t first = begin + p * size;
+            const size_t last = std::min({first + size, end, response[c].size()});
+            for (size_t k = first; k < last; ++k) {
+                padded[k - first] = response[c][k] * scale;
+            }
+            const size_t at = (c * parts + p) * bins;
+            fft.forward(padded.data(), re.data() + at, im.data() + at);
+        }
+    }
+    return parts;
+}
+
+// The response's first two channels at sample_rate, normalized so white
+// noise comes out at the level it went in. Empty if the file can't be decoded.
+std::vector<std::vector<float>> decodeResponse(const std::string& path, float sample_rate) {
+    ma_decoder decoder;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, (ma_uint32)sample_rate);
+    if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) {
+        std::print("Error: can't decode {}\n", path);
+        return {};
+    }
+    const size_t channels = decoder.outputChannels;
+    const size_t max_frames = (size_t)(kMaxSeconds * sample_rate);
+    std::vector<std::vector<float>> response(std::min<size_t>(channels, 2));
+    std::vector<float> chunk(4096 * channels);
+    ma_uint64 read = 0;
+    while (response[0].size() < max_frames &&
+           ma_decoder_read_pcm_frames(&decoder, chunk.data(), 4096, &read) == MA_SUCCESS && read > 0) {
+        for (size_t c = 0; c < response.size(); ++c) {
+            for (size_t i = 0; i < read; ++i) {
+                response[c].push_back(chunk[i * channels + c]);
+            }
+        }
+    }
+    ma_decoder_uninit(&decoder);
+    if (response[0].empty()) {
+        std::print("Error: {} is empty\n", path);
+        return {};
+    }
+    double energy = 0.0;
+    for (const auto& channel : response) {
+        double sum = 0.0;
+        for (float x : channel) {
+            sum += (double)x * x;
+        }
+        energy = std::max(energy, sum);
+    }
+    if (energy > 0.0) {
+        const float scale = (float)(1.0 / sqrt(energy));
+        for (auto& channel : response) {
+            for (float& x : channel) {
+                x *= scale;
+            }
+        }
+    }
+    return response;
+}
+
+}  // namespace
+
+// Taps offset to offset + parts * size of the response, run a block of size
+// input frames at a time by a worker. The audio thread and the workers share
+// kSlots slots of input and of output blocks: block j goes through slot
+// j % kSlots, whose block number tells when it has arrived.
+struct AuConvolver::Tail {
+    static constexpr size_t kSlots = 4;
+
+    Tail(const std::vector<std::vector<float>>& response, size_t size, const std::atomic<uint64_t>& clock)
+        : size(size), offset(2 * size), channels(response.size()), fft(2 * size), clock(clock) {
+        const size_t end = size == kLastTail ? response[0].size() : std::min(response[0].size(), 16 * size);
+        parts = transformParts(response, offset, end, size, fft, part_re, part_im);
+        window.assign(2 * size, 0.0f);
+        input_re.assign(parts * fft.bins(), 0.0f);
+        input_im.assign(parts * fft.bins(), 0.0f);
+        sum_re.resize(fft.bins());
+        sum_im.resize(fft.bins());
+        time.resize(2 * size);
+        input.assign(kSlots * size, 0.0f);
+        output.assign(kSlots * channels * size, 0.0f);
+        for (size_t s = 0; s < kSlots; ++s) {
+            arrived[s].store(UINT64_MAX, std::memory_order_relaxed);
+            ready[s].store(UINT64_MAX, std::memory_order_relaxed);
+        }
+    }
+
+    // Worker. Convolves block next, or silence if the audio thread had to
+    // skip it.
+    void run() {
+        const size_t slot = next % kSlots;
+        std::copy_n(window.data() + size, size, window.data());
+        if (arrived[slot].load(std::memory_order_acquire) == next) {
+            std::copy_n(input.data() + slot * size, size, window.data() + size);
+        } else {
+            std::fill_n(window.data() + size, size, 0.0f);
+        }
+        const size_t bins = fft.bins();
+        newest = (newest + 1) % parts;
+        fft.forward(window.data(), input_re.data() + newest * bins, input_im.data() + newest * bins);
+        for (size_t c = 0; c < channels; ++c) {
+            std::fill(sum_re.begin(), sum_re.end(), 0.0f);
+            std::fill(sum_im.begin(), sum_im.end(), 0.0f);
+            for (size_t p = 0; p < parts; ++p) {
+                const size_t x = (newest + parts - p) % parts * bins;
+                const size_t h = (c * parts + p) * bins;
+                multiplyAdd(input_re.data() + x, input_im.data() + x, part_re.data() + h, part_im.data() + h, sum_re.data(), sum_im.data(), bins);
+            }
+            fft.inverse(sum_re.data(), sum_im.data(), time.data());
+            std::copy_n(time.data() + size, size, output.data() + (slot * channels + c) * size);
+        }
+        ready[slot].store(next, std::memory_order_release);
+        done.store(++next, std::memory_order_release);
+    }
+
+    // Frames until block next is due, negative once it's late.
+    int64_t slack() const {
+        return (int64_t)(next * size + offset) - (int64_t)clock.load(std::memory_order_relaxed);
+    }
+
+    const size_t size;
+    const size_t offset;
+    const size_t channels;
+    size_t parts = 0;
+    AuFft fft;
+    std::vector<float> part_re;
+    std::vector<float> part_im;
+    const std::atomic<uint64_t>& clock;
+
+    // Worker. The previous and the current input block and the spectra of
+    // the last parts blocks.
+    std::vector<float> window;
+    std::vector<float> input_re;
+    std::vector<float> input_im;
+    size_t newest = 0;
+    std::vector<float> sum_re;
+    std::vector<float> sum_im;
+    std::vector<float> time;
+    uint64_t next = 0;
+    bool busy = false;  // Guarded by the workers' mutex
+
+    std::vector<float> input;  // [slot][frame]
+    std::vector<float> output;  // [slot][channel][frame]
+    std::atomic<uint64_t> arrived[kSlots];
+    std::atomic<uint64_t> ready[kSlots];
+    std::atomic<uint64_t> posted{0};  // Blocks the audio thread is done with
+    std::atomic<uint64_t> done{0};
+    std::atomic<uint64_t> late{0};
+
+    // Audio thread.
+    bool writing = false;  // The current block has a free slot
+    uint64_t missed = UINT64_MAX;  // Last block counted late
+};
+
+AuConvolver::AuConvolver(const std::vector<std::vector<float>>& response) : m_channels(response.size()) {
+    const size_t length = response.empty() ? 0 : response[0].size();
+    m_direct.assign(m_channels * kBlock, 0.0f);
+    for (size_t c = 0; c < m_channels; ++c) {
+        for (size_t k = 0; k < std::min(kBlock, response[c].size()); ++k) {
+            m_direct[c * kBlock + kBlock - 1 - k] = response[c][k];
+        }
+    }
+    m_head_out.assign(m_channels * kBlock, 0.0f);
+    if (length > kBlock) {
+        m_parts = transformParts(response, kBlock, std::min(length, kHeadEnd), kBlock, m_fft, m_part_re, m_part_im);
+        m_input_re.assign(m_parts * m_fft.bins(), 0.0f);
+        m_input_im.assign(m_parts * m_fft.bins(), 0.0f);
+        m_sum_re.resize(m_fft.bins());
+        m_sum_im.resize(m_fft.bins());
+        m_time.resize(2 * kBlock);
+    }
+    for (size_t size = kFirstTail; size <= kLastTail && 2 * size < length; size *= 8) {
+        m_tails.push_back(std::make_unique<Tail>(response, size, m_clock));
+    }
+    for (auto& tail : m_tails) {
+        AuConvolutionWorkers::instance().add(tail.get());
+    }
+}
+
+AuConvolver::~AuConvolver() {
+    for (auto& tail : m_tails) {
+        AuConvolutionWorkers::instance().remove(tail.get());
+    }
+}
+
+uint64_t AuConvolver::late() const {
+    uint64_t late = 0;
+    for (const auto& tail : m_tails) {
+        late += tail->late.load(std::memory_order_relaxed);
+    }
+    return late;
+}
+
+void AuConvolver::process(const float* in, float* const* out, size_t frames) {
+    if (m_channels == 0) {
+        std::fill_n(out[0], frames, 0.0f);
+        return;
+    }
+    for (size_t done = 0; done < frames;) {
+        const size_t n = std::min(frames - done, kBlock - m_fill);
+        std::copy_n(in + done, n, m_input + kBlock + m_fill);
+        for (size_t c = 0; c < m_channels; ++c) {
+            float* y = out[c] + done;
+            const float* taps = m_direct.data() + c * kBlock;
+            for (size_t i = 0; i < n; ++i) {
+                // Lanes of partial sums the compiler keeps in SIMD registers.
+                const float* x = m_input + 1 + m_fill + i;
+                float lanes[8] = {};
+                for (size_t k = 0; k < kBlock; k += 8) {
+                    for (size_t l = 0; l < 8; ++l) {
+                        lanes[l] += taps[k + l] * x[k + l];
+                    }
+                }
+                y[i] = ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7])) +
+                       m_head_out[c * kBlock + m_fill + i];
+            }
+            // The tails' blocks are whole multiples of kBlock, so n frames
+            // come from one block of each.
+            for (auto& tail : m_tails) {
+                if (m_position < tail->offset) {
+                    continue;
+                }
+                const uint64_t j = (m_position - tail->offset) / tail->size;
+                const size_t slot = j % Tail::kSlots;
+                if (tail->ready[slot].load(std::memory_order_acquire) == j) {
+                    const float* src = tail->output.data() + (slot * m_channels + c) * tail->size + (m_position - tail->offset) % tail->size;
+                    for (size_t i = 0; i < n; ++i) {
+                        y[i] += src[i];
+                    }
+                } else if (tail->missed != j) {
+                    tail->missed = j;
+                    tail->late.store(tail->late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                }
+            }
+        }
+        m_fill += n;
+        m_position += n;
+        done += n;
+        if (m_fill == kBlock) {
+            head();
+        }
+    }
+}
+
+// A block of input is complete: queue it for the tails and compute the next
+// block of the 64 tap partitions.
+void AuConvolver::head() {
+    bool wake = false;
+    const uint64_t first = m_position - kBlock;
+    for (auto& tail : m_tails) {
+        const uint64_t j = first / tail->size;
+        const size_t at = first % tail->size;
+        const size_t slot = j % Tail::kSlots;
+        if (at == 0) {
+            // Block j - kSlots must be done before its slot is reused.
+            tail->writing = j - tail->done.load(std::memory_order_acquire) < Tail::kSlots;
+            if (!tail->writing) {
+                tail->late.store(tail->late.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+        if (tail->writing) {
+            std::copy_n(m_input + kBlock, kBlock, tail->input.data() + slot * tail->size + at);
+        }
+        if (at + kBlock == tail->size) {
+            if (tail->writing) {
+                tail->arrived[slot].store(j, std::memory_order_release);
+            }
+            tail->posted.store(j + 1, std::memory_order_release);
+            wake = true;
+        }
+    }
+    m_clock.store(m_position, std::memory_order_relaxed);
+    if (wake) {
+        AuConvolutionWorkers::instance().wake();
+    }
+
+    if (m_parts > 0) {
+        const size_t bins = m_fft.bins();
+        m_newest = (m_newest + 1) % m_parts;
+        m_fft.forward(m_input, m_input_re.data() + m_newest * bins, m_input_im.data() + m_newest * bins);
+        for (size_t c = 0; c < m_channels; ++c) {
+            std::fill(m_sum_re.begin(), m_sum_re.end(), 0.0f);
+            std::fill(m_sum_im.begin(), m_sum_im.end(), 0.0f);
+            for (size_t p = 0; p < m_parts; ++p) {
+                const size_t x = (m_newest + m_parts - p) % m_parts * bins;
+                const size_t h = (c * m_parts + p) * bins;
+                multiplyAdd(m_input_re.data() + x, m_input_im.data() + x, m_part_re.data() + h, m_part_im.data() + h, m_sum_re.data(),
+                            m_sum_im.data(), bins);
+            }
+            m_fft.inverse(m_sum_re.data(), m_sum_im.data(), m_time.data());
+            std::copy_n(m_time.data() + kBlock, kBlock, m_head_out.data() + c * kBlock);
+        }
+    }
+    std::copy_n(m_input + kBlock, kBlock, m_input);
+    m_fill = 0;
+}
+
+AuConvolutionWorkers& AuConvolutionWorkers::instance() {
+    static AuConvolutionWorkers workers;
+    return workers;
+}
+
+AuConvolutionWorkers::AuConvolutionWorkers() {
+    // Leave a core to the audio thread where there's one to spare.
+    const unsigned cores = std::thread::hardware_concurrency();
+    const unsigned threads = cores > 2 ? std::min(cores - 1, 4u) : 1;
+    for (unsigned i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&AuConvolutionWorkers::run, this);
+    }
+}
+
+AuConvolutionWorkers::~AuConvolutionWorkers() {
+    m_stop.store(true);
+    m_wake.release(m_threads.size());
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void AuConvolutionWorkers::add(AuConvolver::Tail* tail) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tails.push_back(tail);
+}
+
+void AuConvolutionWorkers::remove(AuConvolver::Tail* tail) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [tail] { return !tail->busy; });
+    std::erase(m_tails, tail);
+}
+
+void AuConvolutionWorkers::wake() {
+    if (!m_woken.exchange(true, std::memory_order_acq_rel)) {
+        m_wake.release();
+    }
+}
+
+void AuConvolutionWorkers::run() {
+    // Tails decay into denormals.
+    setFlushDenormals(true);
+    while (!m_stop.load()) {
+        AuConvolver::Tail* tail = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            int64_t slack = INT64_MAX;
+            for (AuConvolver::Tail* candidate : m_tails) {
+                if (!candidate->busy && candidate->next < candidate->posted.load(std::memory_order_acquire) && candidate->slack() < slack) {
+                    tail = candidate;
+                    slack = candidate->slack();
+                }
+            }
+            if (tail) {
+                tail->busy = true;
+            }
+        }
+        if (!tail) {
+            // The timeout catches up with blocks posted while the wake was
+            // still pending.
+            m_wake.try_acquire_for(std::chrono::milliseconds(20));
+            m_woken.store(false, std::memory_order_release);
+            continue;
+        }
+        tail->run();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            tail->busy = false;
+        }
+        m_idle.notify_all();
+    }
+}
+
+AuConvolutionReverb::AuConvolutionReverb() {
+    addInPin("in", 0.0f);
+    addInPin("dry", 1.0f, AuRate::Control);
+    addInPin("wet", 0.3f, AuRate::Control);
+    addOutPin("left");
+    addOutPin("right");
+}
+
+AuConvolutionReverb::~AuConvolutionReverb() {
+    delete m_pending.load();
+    delete m_retired.load();
+    delete m_convolver;
+}
+
+void AuConvolutionReverb::prepare(const AuGraphConfig& config) {
+    if (config.sample_rate != m_sample_rate) {
+        m_sample_rate = config.sample_rate;
+        if (!m_path.empty()) {
+            load();
+        }
+    }
+}
+
+bool AuConvolutionReverb::setSettings(const std::string& settings) {
+    m_path = settings;
+    return load();
+}
+
+bool AuConvolutionReverb::load() {
+    delete m_retired.exchange(nullptr, std::memory_order_acquire);
+    // A file that can't be decoded plays dry, like no file.
+    std::vector<std::vector<float>> response;
+    if (!m_path.empty()) {
+        response = decodeResponse(m_path, m_sample_rate);
+    }
+    // A response the audio thread hasn't taken yet is replaced.
+    delete m_pending.exchange(new AuConvolver(response), std::memory_order_acq_rel);
+    return m_path.empty() || !response.empty();
+}
+
+void AuConvolutionReverb::process(const AuProcessContext& ctx) {
+    if (m_pending.load(std::memory_order_relaxed) && !m_retired.load(std::memory_order_acquire)) {
+        m_retired.store(m_convolver, std::memory_order_release);
+        m_convolver = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+    }
+    const float* in = ctx.in(0);
+    const float* dry = ctx.in(1);
+    const float* wet = ctx.in(2);
+    float* left = ctx.out(0);
+    float* right = ctx.out(1);
+    if (m_convolver && m_convolver->channels() > 0) {
+        float* out[] = {left, right};
+        m_convolver->process(in, out, ctx.frames);
+        if (m_convolver->channels() == 1) {
+            std::copy_n(left, ctx.frames, right);
+        }
+    } else {
+        std::fill_n(left, ctx.frames, 0.0f);
+        std::fill_n(right, ctx.frames, 0.0f);
+    }
+    for (size_t t = 0, i = 0; i < ctx.frames; ++t) {
+        const size_t end = std::min(i + ctx.tick_frames, ctx.frames);
+        for (; i < end; ++i) {
+            left[i] = dry[t] * in[i] + wet[t] * left[i];
+            right[i] = dry[t] * in[i] + wet[t] * right[i];
+        }
+    }
+}
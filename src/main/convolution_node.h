@@ -0,0 +1,130 @@
+#pragma once
+#include "audio_graph.h"
+#include "fft.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Convolves a mono input with a mono or stereo impulse response at zero
+// latency, partitioned by how soon each part of the response is needed:
+//
+//   taps 0 to 63          direct form, per sample, on the audio thread
+//   taps 64 to 2047       64 tap partitions, FFT per 64 frames, audio thread
+//   from 2048, 16384 ...  1024, 8192, 65536 tap partitions, each size L from
+//                         tap 2L on, on AuConvolutionWorkers
+//
+// A tail block of L input frames is complete L frames before its output is
+// due, which is the workers' deadline. A block that misses it plays without
+// that part of the tail rather than making the audio thread wait.
+class AuConvolver {
+   public:
+    static constexpr size_t kBlock = 64;
+
+    // Any thread but the audio thread, transforms the whole response.
+    // An empty response convolves to silence.
+    explicit AuConvolver(const std::vector<std::vector<float>>& response);
+    ~AuConvolver();
+
+    size_t channels() const {
+        return m_channels;
+    }
+    // Audio thread. Writes the convolution of frames of in to out[0] and, for
+    // stereo responses, out[1].
+    void process(const float* in, float* const* out, size_t frames);
+    // Any thread. Tail blocks that missed their deadline.
+    uint64_t late() const;
+
+   private:
+    friend class AuConvolutionWorkers;
+    struct Tail;
+
+    void head();
+
+    size_t m_channels;
+    // Direct form taps, reversed, per channel.
+    std::vector<float> m_direct;
+    // The previous and the current block of input.
+    alignas(32) float m_input[2 * kBlock] = {};
+    size_t m_fill = 0;
+    uint64_t m_position = 0;  // Audio thread, input frames so far
+    std::atomic<uint64_t> m_clock{0};  // m_position at the last block, for the workers' deadlines
+    // 64 tap partitions, their spectra [channel][part][bin] and the input
+    // spectra of the last m_parts blocks, newest at m_newest.
+    AuFft m_fft{2 * kBlock};
+    size_t m_parts = 0;
+    std::vector<float> m_part_re;
+    std::vector<float> m_part_im;
+    std::vector<float> m_input_re;
+    std::vector<float> m_input_im;
+    size_t m_newest = 0;
+    std::vector<float> m_sum_re;
+    std::vector<float> m_sum_im;
+    std::vector<float> m_time;
+    std::vector<float> m_head_out;  // [channel][kBlock], for the current block
+    std::vector<std::unique_ptr<Tail>> m_tails;
+};
+
+// Threads that run the tail blocks of all AuConvolvers, the block with the
+// nearest deadline first.
+class AuConvolutionWorkers {
+   public:
+    static AuConvolutionWorkers& instance();
+    ~AuConvolutionWorkers();
+
+    void add(AuConvolver::Tail* tail);
+    // Returns once no worker runs the tail.
+    void remove(AuConvolver::Tail* tail);
+    // Any thread, never blocks.
+    void wake();
+
+   private:
+    AuConvolutionWorkers();
+    void run();
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle;
+    std::vector<AuConvolver::Tail*> m_tails;
+    std::counting_semaphore<> m_wake{0};
+    std::atomic<bool> m_woken{false};
+    std::atomic<bool> m_stop{false};
+    std::vector<std::thread> m_threads;
+};
+
+// Convolution reverb with an impulse response file, the node's settings(),
+// decoded with miniaudio at the graph rate and normalized to unity power
+// gain. Mono responses play on both outputs.
+class AuConvolutionReverb : public AuNodeBase {
+   public:
+    AuConvolutionReverb();
+    ~AuConvolutionReverb();
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    std::string_view settingsName() const override {
+        return "impulse";
+    }
+    std::string settings() const override {
+        return m_path;
+    }
+    bool setSettings(const std::string& settings) override;
+    std::string_view name() const {
+        return "ConvolutionReverb";
+    }
+
+   private:
+    bool load();
+
+    std::string m_path;
+    float m_sample_rate = 48000.0f;
+    // Handed over like AuSamplePlayer's sources.
+    std::atomic<AuConvolver*> m_pending{nullptr};
+    std::atomic<AuConvolver*> m_retired{nullptr};
+    AuConvolver* m_convolver = nullptr;  // Audio thread
+};
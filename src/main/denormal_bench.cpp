@@ -0,0 +1,106 @@
+// Renders a bank of filters ringing out after their input stops, which is
+// when filter state decays into denormals, once with IEEE denormals and once
+// with FTZ/DAZ, and reports the time per block of each.
+//
+//   imsynth_denormal_bench [filters] [blocks] [frames]
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+#include <print>
+#include <vector>
+
+#include "audio_graph.h"
+#include "filter_node.h"
+#include "realtime_thread.h"
+
+namespace {
+
+// A sine into a bank of biquads and SVFs, summed by a chain of Sub nodes.
+// Sub flips the sign of some filters, which doesn't matter here.
+AuNodeGraphPtr createBenchGraph(size_t filters, AuNodePtr& source) {
+    AuNodeGraphPtr graph = std::make_shared<AuNodeGraph>();
+    source = std::make_shared<AuSineGenerator>();
+    source->inPin(0).set(220.0f);
+    graph->addNode(source);
+    AuNodePtr sum;
+    for (size_t i = 0; i < filters; ++i) {
+        AuNodePtr filter;
+        if (i % 2) {
+            filter = std::make_shared<AuBiquad>();
+            filter->inPin(1).set(200.0f + 50.0f * i);
+        } else {
+            filter = std::make_shared<AuSvf>();
+            filter->inPin(1).set(200.0f + 50.0f * i);
+            filter->inPin(2).set(0.9f);
+        }
+        filter->inPin(0).connect(source, 0);
+        graph->addNode(filter);
+        if (!sum) {
+            sum = filter;
+            continue;
+        }
+        AuNodePtr sub = std::make_shared<AuSub>();
+        sub->inPin(0).connect(sum, 0);
+        sub->inPin(1).connect(filter, 0);
+        graph->addNode(sub);
+        sum = sub;
+    }
+    graph->setOutputNode(sum);
+    return graph;
+}
+
+struct Result {
+    double per_block;  // ns
+    size_t denormals;  // Output samples that were denormal
+};
+
+Result run(size_t filters, size_t blocks, size_t frames, bool flush) {
+    setFlushDenormals(flush);
+    AuNodePtr source;
+    AuNodeGraphPtr graph = createBenchGraph(filters, source);
+    AuGraphConfig config;
+    config.max_frames = frames;
+    graph->prepare(config);
+    for (size_t i = 0; i < 100; ++i) {
+        graph->process(frames);
+    }
+    // Silence the input and let the filters decay, then time the tails.
+    graph->setValue(source, 1, 0.0f);
+    graph->update();
+    const size_t decay = (size_t)(2.0f * config.sample_rate / frames);
+    for (size_t i = 0; i < decay; ++i) {
+        graph->process(frames);
+    }
+
+    Result result = {};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < blocks; ++i) {
+        const float* out = graph->process(frames);
+        for (size_t j = 0; j < frames; ++j) {
+            result.denormals += fpclassify(out[j]) == FP_SUBNORMAL;
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    result.per_block = elapsed / blocks;
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const size_t filters = argc > 1 ? atoi(argv[1]) : 64;
+    const size_t blocks = argc > 2 ? atoi(argv[2]) : 2000;
+    const size_t frames = argc > 3 ? atoi(argv[3]) : 256;
+
+    const Result ieee = run(filters, blocks, frames, false);
+    const Result flushed = run(filters, blocks, frames, true);
+    std::print("Filters:          {}\n", filters);
+    std::print("Block:            {} frames\n", frames);
+    std::print("IEEE denormals:   {:.0f} ns per block, {} denormal output samples\n", ieee.per_block, ieee.denormals);
+    std::print("FTZ/DAZ:          {:.0f} ns per block, {} denormal output samples\n", flushed.per_block, flushed.denormals);
+    std::print("Speedup:          {:.1f}x\n", ieee.per_block / flushed.per_block);
+    return 0;
+}
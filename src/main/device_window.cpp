@@ -0,0 +1,220 @@
+#include "device_window.h"
+
+#include "audio_engine.h"
+#include "graph_io.h"
+
+#include <imgui.h>
+#include <misc/cpp/imgui_stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+class DeviceWindow_impl : public DeviceWindow {
+   public:
+    DeviceWindow_impl(AudioEngine& audio_engine);
+    void frame() override;
+
+   private:
+    void deviceCombo(const char* label, const std::vector<std::string>& devices, int& device);
+    void recorder();
+    void parts();
+
+    AudioEngine& m_audio;
+    // Edited here and applied with a reopen of the device.
+    AudioDeviceSettings m_settings;
+    std::vector<std::string> m_devices;
+    std::vector<std::string> m_capture_devices;
+    bool m_failed = false;
+    AuRecorderSettings m_record;
+    bool m_record_probes = false;  // Taps every probed output as well
+    bool m_record_failed = false;
+    std::vector<std::string> m_part_files = std::vector<std::string>(AudioEngine::kMaxParts);
+};
+
+std::unique_ptr<DeviceWindow> DeviceWindow::create(AudioEngine& audio_engine) {
+    return std::make_unique<DeviceWindow_impl>(audio_engine);
+}
+
+DeviceWindow_impl::DeviceWindow_impl(AudioEngine& audio_engine) : m_audio(audio_engine) {
+    m_settings = m_audio.getDeviceSettings();
+}
+
+void DeviceWindow_impl::deviceCombo(const char* label, const std::vector<std::string>& devices, int& device) {
+    const char* preview = device >= 0 && (size_t)device < devices.size() ? devices[device].c_str() : "System default";
+    ImGui::SetNextItemWidth(240);
+    if (ImGui::BeginCombo(label, preview)) {
+        if (ImGui::Selectable("System default", device < 0)) device = -1;
+        for (int i = 0; i < (int)devices.size(); ++i) {
+            ImGui::PushID(i);
+            if (ImGui::Selectable(devices[i].c_str(), device == i)) device = i;
+            ImGui::PopID();
+        }
+        ImGui::EndCombo();
+    }
+}
+
+void DeviceWindow_impl::frame() {
+    ImGui::Begin("Audio device");
+    if (m_devices.empty() || ImGui::Button("Rescan")) {
+        m_devices = m_audio.getDevices();
+        m_capture_devices = m_audio.getCaptureDevices();
+    }
+    deviceCombo("Device", m_devices, m_settings.device);
+    ImGui::Checkbox("Duplex", &m_settings.duplex);
+    if (m_settings.duplex) deviceCombo("Capture device", m_capture_devices, m_settings.capture_device);
+
+    static const char* kFormatNames[] = {"Native", "32 bit float", "16 bit", "32 bit"};
+    int format = (int)m_settings.format;
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::Combo("Format", &format, kFormatNames, IM_ARRAYSIZE(kFormatNames))) m_settings.format = (AudioSampleFormat)format;
+    int period_frames = (int)m_settings.period_frames;
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::InputInt("Period frames", &period_frames, 32, 256)) m_settings.period_frames = (uint32_t)std::max(16, period_frames);
+    int periods = (int)m_settings.periods;
+    ImGui::SetNextItemWidth(120);
+    if (ImGui::InputInt("Periods", &periods)) m_settings.periods = (uint32_t)std::max(1, periods);
+    ImGui::Checkbox("Exclusive", &m_settings.exclusive);
+    AudioSimulation& simulation = m_settings.simulation;
+    ImGui::Checkbox("Simulate", &simulation.enabled);
+    if (simulation.enabled) {
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderFloat("Block size variation", &simulation.period_variation, 0.0f, 1.0f);
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderFloat("Jitter ms", &simulation.jitter_ms, 0.0f, 10.0f);
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderFloat("Preempt chance", &simulation.preempt_chance, 0.0f, 0.1f);
+        ImGui::SetNextItemWidth(120);
+        ImGui::SliderFloat("Preempt ms", &simulation.preempt_ms, 0.0f, 50.0f);
+    }
+    if (ImGui::Button("Apply")) {
+        m_failed = m_audio.openDevice(m_settings) != 0;
+        m_settings = m_audio.getDeviceSettings();
+    }
+    if (m_failed) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed, previous settings restored");
+    }
+
+    AudioDeviceStatus status = m_audio.getDeviceStatus();
+    ImGui::Separator();
+    ImGui::Text("%s", status.name.c_str());
+    ImGui::Text("%s, %u Hz, %u channels", kFormatNames[(int)status.format], status.sample_rate, status.channels);
+    if (status.sample_rate) {
+        ImGui::Text("%u x %u frames, %.1f ms", status.periods, status.period_frames,
+                    1000.0f * status.periods * status.period_frames / status.sample_rate);
+    }
+    if (!status.capture_name.empty()) {
+        ImGui::Text("Capture: %s", status.capture_name.c_str());
+        ImGui::Text("%s, %u channels%s", kFormatNames[(int)status.capture_format], status.capture_channels,
+                    status.capture_direct ? ", read in place" : "");
+        ImGui::Text("Round trip: %u frames, %.1f ms", status.round_trip_frames, 1000.0f * status.round_trip_frames / status.sample_rate);
+    }
+
+    AudioTimingStats timing = m_audio.getTimingStats();
+    ImGui::Text("%llu blocks, %llu missed", (unsigned long long)timing.callbacks, (unsigned long long)timing.deadline_misses);
+    ImGui::Text("Worst %.3f ms (%.0f%%), average %.3f ms", timing.worst_ms, 100.0f * timing.worst_load, timing.average_ms);
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) m_audio.resetTimingStats();
+
+    ImGui::Separator();
+    static const float kRates[] = {0.0f, 44100.0f, 48000.0f, 96000.0f};
+    static const char* kRateNames[] = {"Device rate", "44100 Hz", "48000 Hz", "96000 Hz"};
+    static const char* kQualityNames[] = {"Low", "Medium", "High"};
+    int rate = 0;
+    for (int i = 0; i < IM_ARRAYSIZE(kRates); ++i) {
+        if (kRates[i] == m_audio.getInternalRate()) rate = i;
+    }
+    int quality = (int)m_audio.getResampleQuality();
+    ImGui::SetNextItemWidth(120);
+    bool changed = ImGui::Combo("Internal rate", &rate, kRateNames, IM_ARRAYSIZE(kRateNames));
+    ImGui::SetNextItemWidth(120);
+    changed |= ImGui::Combo("Resampling", &quality, kQualityNames, IM_ARRAYSIZE(kQualityNames));
+    if (changed) m_audio.setInternalRate(kRates[rate], (AuResampleQuality)quality);
+
+    ImGui::Separator();
+    recorder();
+    ImGui::Separator();
+    parts();
+    ImGui::End();
+}
+
+void DeviceWindow_impl::recorder() {
+    AuRecorderStats stats = m_audio.getRecorderStats();
+    if (stats.recording) {
+        if (ImGui::Button("Stop recording")) m_audio.stopRecording();
+    } else {
+        ImGui::SetNextItemWidth(240);
+        ImGui::InputText("Record to", &m_record.path);
+        static const char* kRecordFormats[] = {"WAV", "Raw float"};
+        int format = (int)m_record.format;
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::Combo("File format", &format, kRecordFormats, IM_ARRAYSIZE(kRecordFormats))) m_record.format = (AuRecordFormat)format;
+        ImGui::Checkbox("O_DIRECT", &m_record.direct);
+        ImGui::SameLine();
+        ImGui::Checkbox("Sync writes", &m_record.sync);
+        ImGui::SameLine();
+        ImGui::Checkbox("Probed outputs", &m_record_probes);
+        if (ImGui::Button("Record")) {
+            std::vector<std::pair<AuNodePtr, size_t>> taps;
+            AuNodeGraphPtr graph = m_audio.getGraph();
+            if (m_record_probes && graph) {
+                for (const auto& node : graph->nodes()) {
+                    for (size_t i = 0; i < node->outPins(); ++i) {
+                        if (node->outPin(i).probe()) taps.push_back({node, i});
+                    }
+                }
+            }
+            m_record_failed = m_audio.startRecording(m_record, taps) != 0;
+        }
+        if (m_record_failed) {
+            ImGui::SameLine();
+            ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "Failed to create the files");
+        }
+    }
+    if (stats.recording || stats.written_bytes) {
+        ImGui::Text("Ring %.0f%%, peak %.0f%%, %llu blocks dropped", 100.0f * stats.fill, 100.0f * stats.peak_fill,
+                    (unsigned long long)stats.dropped_blocks);
+        ImGui::Text("%.1f MB written%s", stats.written_bytes / 1e6, stats.failed ? ", write failed" : "");
+    }
+}
+
+// Part 0 is the graph in the editor, the others are loaded from files. Lists
+// the parts in use and one empty one.
+void DeviceWindow_impl::parts() {
+    bool empty_shown = false;
+    for (size_t part = 0; part < AudioEngine::kMaxParts; ++part) {
+        AuNodeGraphPtr graph = m_audio.getPartGraph(part);
+        if (!graph && part > 0) {
+            if (empty_shown) continue;
+            empty_shown = true;
+        }
+        ImGui::PushID((int)part);
+        AudioPartSettings settings = m_audio.getPartSettings(part);
+        bool changed = false;
+        ImGui::Text("Part %zu", part + 1);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80);
+        changed |= ImGui::SliderInt("Channel", &settings.midi_channel, 0, 16, settings.midi_channel ? "%d" : "All");
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        changed |= ImGui::SliderFloat("Gain", &settings.gain, 0.0f, 2.0f);
+        ImGui::SameLine();
+        changed |= ImGui::Checkbox("Mute", &settings.mute);
+        if (changed) m_audio.setPartSettings(part, settings);
+        if (part > 0) {
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(160);
+            ImGui::InputText("##file", &m_part_files[part]);
+            ImGui::SameLine();
+            if (ImGui::Button("Load")) {
+                if (AuNodeGraphPtr loaded = loadGraph(m_part_files[part])) m_audio.setPartGraph(part, loaded);
+            }
+            if (graph) {
+                ImGui::SameLine();
+                if (ImGui::Button("Remove")) m_audio.setPartGraph(part, nullptr);
+            }
+        }
+        ImGui::PopID();
+    }
+}
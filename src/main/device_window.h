@@ -0,0 +1,12 @@
+#pragma once
+
+#include "imgui_window.h"
+
+#include <memory>
+
+class AudioEngine;
+
+class DeviceWindow : public ImguiWindow {
+   public:
+    static std::unique_ptr<DeviceWindow> create(AudioEngine& audio_engine);
+};
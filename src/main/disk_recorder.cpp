@@ -0,0 +1,377 @@
+#include "disk_recorder.h"
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <print>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+// Samples start this far into a WAV file, and writes are multiples of it, as
+// O_DIRECT needs.
+constexpr size_t kHeaderBytes = 4096;
+constexpr size_t kBufferBytes = 1 << 20;
+
+int openFile(const std::string& path, bool direct) {
+#if defined(_WIN32)
+    return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if defined(O_DIRECT)
+    if (direct) {
+        const int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (fd >= 0) {
+            return fd;
+        }
+        std::print("Recording {} through the page cache, O_DIRECT failed\n", path);
+    }
+#endif
+    return open(path.c_str(), flags, 0644);
+#endif
+}
+
+// Leaves O_DIRECT for the unaligned writes at the end.
+void bufferFile(int fd) {
+#if defined(O_DIRECT)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+#endif
+}
+
+bool writeFile(int fd, const void* data, size_t bytes) {
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+#if defined(_WIN32)
+        const int n = _write(fd, p, (unsigned)bytes);
+#else
+        const ssize_t n = ::write(fd, p, bytes);
+#endif
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+bool writeFileAt(int fd, const void* data, size_t bytes, int64_t offset) {
+#if defined(_WIN32)
+    return _lseeki64(fd, offset, SEEK_SET) == offset && writeFile(fd, data, bytes);
+#else
+    return pwrite(fd, data, bytes, offset) == (ssize_t)bytes;
+#endif
+}
+
+void syncFile(int fd) {
+#if defined(_WIN32)
+    _commit(fd);
+#elif defined(__APPLE__)
+    fsync(fd);
+#else
+    fdatasync(fd);
+#endif
+}
+
+void closeFile(int fd) {
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+void put16(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+void put32(uint8_t* p, uint32_t value) {
+    put16(p, value);
+    put16(p + 2, value >> 16);
+}
+
+void put64(uint8_t* p, uint64_t value) {
+    put32(p, (uint32_t)value);
+    put32(p + 4, (uint32_t)(value >> 32));
+}
+
+// 32 bit float mono WAV, padded with a JUNK chunk to kHeaderBytes. The first
+// chunk is room for the ds64 chunk of RF64, which takes over once the file
+// outgrows 32 bit sizes.
+void wavHeader(uint8_t* header, float sample_rate, uint64_t data_bytes) {
+    memset(header, 0, kHeaderBytes);
+    const uint64_t riff_bytes = kHeaderBytes - 8 + data_bytes;
+    const bool rf64 = riff_bytes > 0xffffffffu;
+    memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+    put32(header + 4, rf64 ? 0xffffffffu : (uint32_t)riff_bytes);
+    memcpy(header + 8, "WAVE", 4);
+    memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+    put32(header + 16, 28);
+    if (rf64) {
+        put64(header + 20, riff_bytes);
+        put64(header + 28, data_bytes);
+        put64(header + 36, data_bytes / 4);
+    }
+    const uint32_t rate = (uint32_t)lroundf(sample_rate);
+    memcpy(header + 48, "fmt ", 4);
+    put32(header + 52, 16);
+    put16(header + 56, 3);  // IEEE float
+    put16(header + 58, 1);
+    put32(header + 60, rate);
+    put32(header + 64, rate * 4);
+    put16(header + 68, 4);
+    put16(header + 70, 32);
+    memcpy(header + 72, "JUNK", 4);
+    put32(header + 76, kHeaderBytes - 88);
+    memcpy(header + kHeaderBytes - 8, "data", 4);
+    put32(header + kHeaderBytes - 4, rf64 ? 0xffffffffu : (uint32_t)data_bytes);
+}
+}  // namespace
+
+struct AuDiskRecorder::Tap : AuProbeTap {
+    Tap(AuDiskRecorder* recorder, uint32_t track) : recorder(recorder), track(track) {}
+    void write(const float* values, size_t count, float sample_rate) override {
+        recorder->write(track, values, count, sample_rate);
+    }
+
+    AuDiskRecorder* recorder;
+    uint32_t track;
+};
+
+// One track's file, written a whole buffer at a time from memory aligned for
+// O_DIRECT. A WAV file's buffer starts with room for the header, which is
+// written for real on close.
+struct AuDiskRecorder::TrackFile {
+    static constexpr size_t kAlign = kHeaderBytes / sizeof(float);
+    static constexpr size_t kValues = kBufferBytes / sizeof(float);
+
+    std::string path;
+    int fd = -1;
+    bool wav = true;
+    bool sync = false;
+    float sample_rate = 0.0f;
+    bool fed = false;  // Has its rate from a block
+    bool flushed = false;
+    uint64_t data_bytes = 0;
+    std::vector<float> storage;
+    float* buffer = nullptr;
+    size_t used = 0;
+
+    bool open(const std::string& file_path, const AuRecorderSettings& settings, float rate) {
+        path = file_path;
+        sample_rate = rate;
+        wav = settings.format == AuRecordFormat::Wav;
+        sync = settings.sync;
+        fd = openFile(path, settings.direct);
+        if (fd < 0) {
+            std::print("Error: can't create {}: {}\n", path, strerror(errno));
+            return false;
+        }
+        storage.assign(kValues + kAlign, 0.0f);
+        buffer = storage.data() + (kAlign - (uintptr_t)storage.data() / sizeof(float) % kAlign) % kAlign;
+        used = wav ? kAlign : 0;
+        return true;
+    }
+
+    // Appends silence if values is nullptr.
+    bool append(const float* values, uint64_t count) {
+        while (count > 0) {
+            const size_t n = (size_t)std::min<uint64_t>(count, kValues - used);
+            if (values) {
+                std::copy_n(values, n, buffer + used);
+                values += n;
+            } else {
+                std::fill_n(buffer + used, n, 0.0f);
+            }
+            used += n;
+            count -= n;
+            data_bytes += n * sizeof(float);
+            if (used == kValues && !flush()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool flush() {
+        if (wav && !flushed) {
+            wavHeader((uint8_t*)buffer, sample_rate, data_bytes);  // Until close() writes the final one
+            flushed = true;
+        }
+        const bool ok = writeFile(fd, buffer, used * sizeof(float));
+        if (!ok) {
+            std::print("Error: writing {}: {}\n", path, strerror(errno));
+        } else if (sync) {
+            syncFile(fd);
+        }
+        used = 0;
+        return ok;
+    }
+
+    bool close() {
+        bufferFile(fd);
+        bool ok = used == 0 || flush();
+        if (ok && wav) {
+            std::vector<uint8_t> header(kHeaderBytes);
+            wavHeader(header.data(), sample_rate, data_bytes);
+            ok = writeFileAt(fd, header.data(), header.size(), 0);
+            if (!ok) {
+                std::print("Error: writing {}: {}\n", path, strerror(errno));
+            }
+        }
+        if (sync) {
+            syncFile(fd);
+        }
+        closeFile(fd);
+        fd = -1;
+        return ok;
+    }
+};
+
+AuDiskRecorder::AuDiskRecorder() {}
+
+AuDiskRecorder::~AuDiskRecorder() {
+    stop();
+}
+
+int AuDiskRecorder::start(const AuRecorderSettings& settings, const std::vector<std::string>& tracks, float sample_rate) {
+    stop();
+    m_settings = settings;
+    const char* extension = settings.format == AuRecordFormat::Wav ? ".wav" : ".f32";
+    m_files.clear();
+    for (const std::string& track : tracks) {
+        auto file = std::make_unique<TrackFile>();
+        if (!file->open(settings.path + "-" + track + extension, settings, sample_rate)) {
+            for (auto& opened : m_files) {
+                opened->close();
+            }
+            m_files.clear();
+            return -1;
+        }
+        m_files.push_back(std::move(file));
+    }
+    m_taps.clear();
+    for (uint32_t i = 0; i < tracks.size(); ++i) {
+        m_taps.push_back(std::make_unique<Tap>(this, i));
+    }
+    m_missing.assign(tracks.size(), 0);
+
+    size_t size = 1 << 16;
+    while (size < settings.buffer_seconds * sample_rate * tracks.size()) {
+        size *= 2;
+    }
+    // Written now, so the audio thread doesn't fault the pages in.
+    m_samples.assign(size, 0.0f);
+    if (!m_blocks) {
+        m_blocks = std::make_unique<SpscQueue<Block, kBlocks>>();
+    }
+    m_written.store(0, std::memory_order_relaxed);
+    m_read.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_peak.store(0, std::memory_order_relaxed);
+    m_bytes.store(0, std::memory_order_relaxed);
+    m_failed.store(false, std::memory_order_relaxed);
+    m_stop.store(false);
+    m_thread = std::thread(&AuDiskRecorder::run, this);
+    return 0;
+}
+
+void AuDiskRecorder::stop() {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    m_stop.store(true);
+    m_thread.join();
+}
+
+AuRecorderStats AuDiskRecorder::stats() const {
+    AuRecorderStats stats;
+    stats.recording = m_thread.joinable();
+    if (!m_samples.empty()) {
+        const uint64_t queued = m_written.load(std::memory_order_relaxed) - m_read.load(std::memory_order_relaxed);
+        stats.fill = std::min(1.0f, (float)queued / m_samples.size());
+        stats.peak_fill = (float)m_peak.load(std::memory_order_relaxed) / m_samples.size();
+    }
+    stats.dropped_blocks = m_dropped.load(std::memory_order_relaxed);
+    stats.written_bytes = m_bytes.load(std::memory_order_relaxed);
+    stats.failed = m_failed.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AuDiskRecorder::write(uint32_t track, const float* values, size_t count, float sample_rate) {
+    const uint64_t size = m_samples.size();
+    uint64_t offset = m_written.load(std::memory_order_relaxed);
+    // Blocks don't wrap, so the writer hands them to the file as they are.
+    const uint64_t end = size - (offset & (size - 1));
+    if (count > end) {
+        offset += end;
+    }
+    const uint64_t queued = offset + count - m_read.load(std::memory_order_acquire);
+    float* dst = m_samples.data() + (offset & (size - 1));
+    if (queued <= size) {
+        if (values) {
+            std::copy_n(values, count, dst);
+        } else {
+            std::fill_n(dst, count, 0.0f);
+        }
+        if (m_blocks->push({offset, m_missing[track], track, (uint32_t)count, sample_rate})) {
+            m_missing[track] = 0;
+            m_written.store(offset + count, std::memory_order_relaxed);
+            if (queued > m_peak.load(std::memory_order_relaxed)) {
+                m_peak.store(queued, std::memory_order_relaxed);
+            }
+            return;
+        }
+    }
+    m_missing[track] += count;
+    m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool AuDiskRecorder::drain() {
+    Block block;
+    if (!m_blocks->pop(block)) {
+        return false;
+    }
+    TrackFile& file = *m_files[block.track];
+    if (!file.fed) {
+        file.sample_rate = block.sample_rate;
+        file.fed = true;
+    }
+    // After a failed write the ring is still drained, so the audio thread
+    // keeps going.
+    if (!m_failed.load(std::memory_order_relaxed)) {
+        const float* values = m_samples.data() + (block.offset & (m_samples.size() - 1));
+        if (!file.append(nullptr, block.missing) || !file.append(values, block.count)) {
+            m_failed.store(true, std::memory_order_relaxed);
+        }
+        m_bytes.store(m_bytes.load(std::memory_order_relaxed) + (block.missing + block.count) * sizeof(float), std::memory_order_relaxed);
+    }
+    m_read.store(block.offset + block.count, std::memory_order_release);
+    return true;
+}
+
+void AuDiskRecorder::run() {
+    while (!m_stop.load()) {
+        if (!drain()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    while (drain()) {
+    }
+    for (auto& file : m_files) {
+        if (!file->close()) {
+            m_failed.store(true, std::memory_order_relaxed);
+        }
+    }
+}
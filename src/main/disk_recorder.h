@@ -0,0 +1,93 @@
+#pragma once
+
+#include "probe.h"
+#include "spsc_queue.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class AuRecordFormat { Wav, Raw };
+
+struct AuRecorderSettings {
+    // Each track goes to path-<track name>.wav, or .f32 for raw files.
+    std::string path = "imsynth-take";
+    // 32 bit float WAV, switched to RF64 at 4 GB. Raw is headerless native
+    // endian 32 bit float.
+    AuRecordFormat format = AuRecordFormat::Wav;
+    bool direct = false;  // O_DIRECT, bypasses the page cache (Linux)
+    bool sync = false;  // fdatasync() after each write, so a crash loses at most one
+    float buffer_seconds = 10.0f;  // Ring size, per track at the rate passed to start()
+};
+
+struct AuRecorderStats {
+    bool recording = false;
+    float fill = 0.0f;  // Of the ring, 0 to 1
+    float peak_fill = 0.0f;  // Since start()
+    uint64_t dropped_blocks = 0;  // Ring full, written as silence to keep tracks aligned
+    uint64_t written_bytes = 0;
+    bool failed = false;  // A write failed, see the printed reason
+};
+
+// Records blocks from the audio thread to disk. write() copies a block into
+// a lock-free ring and never blocks or allocates; a writer thread drains the
+// ring into one file per track with large sequential writes. When the disk
+// can't keep up the ring fills and blocks are dropped, never the audio.
+class AuDiskRecorder {
+   public:
+    AuDiskRecorder();
+    ~AuDiskRecorder();
+
+    // UI thread. Creates a file for each track and starts the writer. Prints
+    // the reason and returns -1 if a file can't be created.
+    int start(const AuRecorderSettings& settings, const std::vector<std::string>& tracks, float sample_rate);
+    // UI thread. Writes what is left in the ring and closes the files. The
+    // audio thread must be done calling write() and the taps.
+    void stop();
+    AuRecorderStats stats() const;
+
+    // Audio thread. Queues count values of track recorded at sample_rate, or
+    // silence if values is nullptr. The first block sets the file's rate.
+    void write(uint32_t track, const float* values, size_t count, float sample_rate);
+    // Feeds a probed output to track, see AuProbe::setTap().
+    AuProbeTap* tap(uint32_t track) {
+        return m_taps[track].get();
+    }
+
+   private:
+    struct Block {
+        uint64_t offset = 0;  // Of the values in m_samples, unwrapped
+        uint64_t missing = 0;  // Values of the track dropped before this block
+        uint32_t track = 0;
+        uint32_t count = 0;
+        float sample_rate = 0.0f;
+    };
+    struct Tap;
+    struct TrackFile;
+
+    static constexpr size_t kBlocks = 1 << 16;
+
+    void run();
+    // Writer thread. Returns false once the ring is empty.
+    bool drain();
+
+    AuRecorderSettings m_settings;
+    std::vector<std::unique_ptr<AuProbeTap>> m_taps;
+    std::vector<std::unique_ptr<TrackFile>> m_files;  // Writer thread
+    std::unique_ptr<SpscQueue<Block, kBlocks>> m_blocks;
+    std::vector<float> m_samples;  // Power of two long
+    std::atomic<uint64_t> m_written{0};  // End of the values in m_samples
+    std::atomic<uint64_t> m_read{0};  // Values the writer is done with
+    std::vector<uint64_t> m_missing;  // Audio thread, per track
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_peak{0};  // Values in the ring
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<bool> m_failed{false};
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
@@ -0,0 +1,217 @@
+#include "envelope_node.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// Exponential segments end where this fraction of the distance to the point
+// they aim at is left, -60 dB.
+constexpr float kCurveRatio = 0.001f;
+}  // namespace
+
+AuEnvelopeBank::AuEnvelopeBank(size_t voices) : m_voices(voices) {
+}
+
+void AuEnvelopeBank::setSampleRate(float sample_rate) {
+    m_sample_rate = sample_rate;
+}
+
+void AuEnvelopeBank::setParams(size_t voice, const AuEnvelopeParams& params) {
+    Voice& v = m_voices[voice];
+    const bool glide = params.sustain != v.params.sustain;
+    v.params = params;
+    if (!glide) {
+        return;
+    }
+    if (v.stage == Stage::Sustain) {
+        start(v, Stage::Decay, v.peak * params.sustain, 0.0f, false);
+    } else if (v.stage == Stage::Decay) {
+        start(v, Stage::Decay, v.peak * params.sustain, v.remaining / m_sample_rate, v.exponential);
+    }
+}
+
+void AuEnvelopeBank::noteOn(size_t voice, float peak) {
+    Voice& v = m_voices[voice];
+    v.peak = peak;
+    start(v, Stage::Attack, peak, v.params.attack, false);
+}
+
+void AuEnvelopeBank::noteOff(size_t voice) {
+    Voice& v = m_voices[voice];
+    if (v.stage != Stage::Idle && v.stage != Stage::Release) {
+        start(v, Stage::Release, 0.0f, v.params.release, v.params.curve == AuEnvelopeCurve::Exponential);
+    }
+}
+
+bool AuEnvelopeBank::active(size_t voice) const {
+    return m_voices[voice].stage != Stage::Idle;
+}
+
+void AuEnvelopeBank::reset() {
+    for (Voice& v : m_voices) {
+        v = Voice{.params = v.params};
+    }
+}
+
+void AuEnvelopeBank::start(Voice& v, Stage stage, float target, float seconds, bool exponential) {
+    // NaN passes through max and clamp, and converting it is undefined.
+    if (!std::isfinite(seconds)) {
+        seconds = kMinSeconds;
+    }
+    const float frames = std::clamp(std::max(seconds, kMinSeconds) * m_sample_rate, 1.0f, (float)INT32_MAX);
+    v.stage = stage;
+    v.remaining = (uint32_t)frames;
+    v.target = target;
+    v.exponential = exponential && target != v.level;
+    if (v.exponential) {
+        // Aims at bias, beyond target, so that after remaining frames
+        // kCurveRatio of the distance to bias is left, which is target.
+        v.bias = target - (v.level - target) * kCurveRatio / (1.0f - kCurveRatio);
+        v.step = powf(kCurveRatio, 1.0f / v.remaining);
+    } else {
+        v.step = (target - v.level) / v.remaining;
+    }
+}
+
+void AuEnvelopeBank::next(Voice& v) {
+    v.level = v.target;
+    switch (v.stage) {
+        case Stage::Attack:
+            start(v, Stage::Decay, v.peak * v.params.sustain, v.params.decay, v.params.curve == AuEnvelopeCurve::Exponential);
+            break;
+        case Stage::Decay:
+            v.stage = Stage::Sustain;
+            break;
+        default:
+            v.stage = Stage::Idle;
+            break;
+    }
+}
+
+void AuEnvelopeBank::fill(Voice& v, float* out, int32_t frames) {
+    if (!v.exponential) {
+        const float level = v.level;
+        const float step = v.step;
+        for (int32_t k = 0; k < frames; ++k) {
+            out[k] = level + step * (float)(k + 1);
+        }
+    } else {
+        // bias + distance * step^(k + 1), with the powers kept in 8 lanes
+        // that advance by step^8.
+        const float bias = v.bias;
+        const float distance = v.level - bias;
+        float power[8];
+        power[0] = v.step;
+        for (int j = 1; j < 8; ++j) {
+            power[j] = power[j - 1] * v.step;
+        }
+        const float step8 = power[7];
+        int32_t k = 0;
+        for (; k + 8 <= frames; k += 8) {
+            for (int j = 0; j < 8; ++j) {
+                out[k + j] = bias + distance * power[j];
+                power[j] *= step8;
+            }
+        }
+        for (int j = 0; k < frames; ++k, ++j) {
+            out[k] = bias + distance * power[j];
+        }
+    }
+    v.level = out[frames - 1];
+}
+
+void AuEnvelopeBank::render(float* const* out, size_t begin, size_t end) {
+    for (size_t voice = 0; voice < m_voices.size(); ++voice) {
+        Voice& v = m_voices[voice];
+        float* y = out[voice];
+        size_t i = begin;
+        while (i < end) {
+            if (v.remaining == 0) {
+                std::fill(y + i, y + end, v.level);
+                break;
+            }
+            const size_t n = std::min((size_t)v.remaining, end - i);
+            fill(v, y + i, (int32_t)n);
+            v.remaining -= (uint32_t)n;
+            i += n;
+            if (v.remaining == 0) {
+                next(v);
+            }
+        }
+    }
+}
+
+AuEnvelopeNode::AuEnvelopeNode(size_t lanes, const char* in_name, const char* out_name)
+    : m_lanes(lanes), m_bank(lanes), m_last(lanes, 0.0f) {
+    assert(lanes <= AuADSRBank::kLanes);
+    auto lane_name = [&](const char* name, size_t lane) {
+        return lanes == 1 ? std::string(name) : name + std::to_string(lane + 1);
+    };
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        addInPin(lane_name(in_name, lane), 1.0);
+    }
+    addInPin("A", 0.1, AuRate::Control);
+    addInPin("D", 0.4, AuRate::Control);
+    addInPin("S", 0.6, AuRate::Control);
+    addInPin("R", 0.8, AuRate::Control);
+    addInPin("curve", 1.0, AuRate::Init);  // 0 linear, 1 exponential decay and release
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        addOutPin(lane_name(out_name, lane));
+    }
+}
+
+void AuEnvelopeNode::process(const AuProcessContext& ctx) {
+    const size_t lanes = m_lanes;
+    float* out[AuADSRBank::kLanes];
+    for (size_t lane = 0; lane < lanes; ++lane) {
+        out[lane] = ctx.out(lane);
+    }
+    m_bank.setSampleRate(ctx.sample_rate);
+    // NaN and infinite amplitudes read as 0, so they release the note.
+    auto amplitude = [&](size_t lane, size_t frame) {
+        const float value = ctx.in(lane)[frame];
+        return std::isfinite(value) ? value : 0.0f;
+    };
+    AuEnvelopeParams params;
+    params.curve = ctx.in(lanes + 4)[0] >= 0.5f ? AuEnvelopeCurve::Exponential : AuEnvelopeCurve::Linear;
+    for (size_t t = 0, start = 0; start < ctx.frames; ++t, start += ctx.tick_frames) {
+        params.attack = ctx.in(lanes)[t];
+        params.decay = ctx.in(lanes + 1)[t];
+        params.sustain = std::isnan(ctx.in(lanes + 2)[t]) ? 0.0f : std::clamp(ctx.in(lanes + 2)[t], 0.0f, 1.0f);
+        params.release = ctx.in(lanes + 3)[t];
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            m_bank.setParams(lane, params);
+        }
+        // Starts or releases the notes whose amplitude changes at frame i,
+        // then renders up to the next change of any lane, at least frame i.
+        const size_t end = std::min(start + ctx.tick_frames, ctx.frames);
+        for (size_t i = start; i < end;) {
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                const float value = amplitude(lane, i);
+                if (value == m_last[lane]) {
+                    continue;
+                }
+                if (value == 0.0f) {
+                    m_bank.noteOff(lane);
+                } else {
+                    m_bank.noteOn(lane, value);
+                }
+                m_last[lane] = value;
+            }
+            size_t next = end;
+            for (size_t lane = 0; lane < lanes; ++lane) {
+                const float last = m_last[lane];
+                size_t j = i + 1;
+                while (j < next && amplitude(lane, j) == last) {
+                    j++;
+                }
+                next = j;
+            }
+            m_bank.render(out, i, next);
+            i = next;
+        }
+    }
+}
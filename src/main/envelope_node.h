@@ -0,0 +1,103 @@
+#pragma once
+#include "audio_graph.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+enum class AuEnvelopeCurve { Linear, Exponential };
+
+struct AuEnvelopeParams {
+    float attack = 0.1f;  // Seconds
+    float decay = 0.4f;
+    float sustain = 0.6f;  // Of the peak
+    float release = 0.8f;
+    AuEnvelopeCurve curve = AuEnvelopeCurve::Exponential;  // Of decay and release, attack is linear
+};
+
+// ADSR envelopes of any number of voices, rendered together a block at a
+// time. A voice's envelope is a series of segments, each a ramp to a target
+// level over a number of frames fixed when the segment starts, so rendering
+// fills whole runs of frames with vectorized linear or exponential ramps
+// instead of working out the phase every frame. Exponential segments aim past
+// their target so they land on it exactly at their end.
+//
+// Every segment starts from the level its voice has reached and none is
+// shorter than kMinSeconds, so retriggers, early note offs and zero times
+// ramp rather than click.
+class AuEnvelopeBank {
+   public:
+    static constexpr float kMinSeconds = 0.002f;
+
+    explicit AuEnvelopeBank(size_t voices = 1);
+    size_t voices() const {
+        return m_voices.size();
+    }
+    void setSampleRate(float sample_rate);
+    // A new sustain level is glided to, times apply from the next segment.
+    void setParams(size_t voice, const AuEnvelopeParams& params);
+    // Attack from the current level to peak, then decay to peak * sustain.
+    void noteOn(size_t voice, float peak);
+    void noteOff(size_t voice);
+    bool active(size_t voice) const;
+    void reset();
+    // Writes frames begin to end of every voice's envelope to out[voice].
+    void render(float* const* out, size_t begin, size_t end);
+
+   private:
+    enum class Stage : uint8_t { Idle, Attack, Decay, Sustain, Release };
+
+    struct Voice {
+        Stage stage = Stage::Idle;
+        bool exponential = false;
+        uint32_t remaining = 0;  // Frames left in the segment, 0 holds level
+        float level = 0.0f;
+        float target = 0.0f;
+        float peak = 0.0f;
+        // Per frame, linear: level += step, exponential: level - bias *= step.
+        float step = 0.0f;
+        float bias = 0.0f;
+        AuEnvelopeParams params;
+    };
+
+    void start(Voice& voice, Stage stage, float target, float seconds, bool exponential);
+    void next(Voice& voice);
+    static void fill(Voice& voice, float* out, int32_t frames);
+
+    std::vector<Voice> m_voices;
+    float m_sample_rate = 48000.0f;
+};
+
+// Envelopes of kLanes voices with shared times. A voice's note starts when
+// its amplitude input changes to a nonzero peak and is released when it
+// changes to zero.
+class AuEnvelopeNode : public AuNodeBase {
+   public:
+    void process(const AuProcessContext& ctx) override;
+
+   protected:
+    AuEnvelopeNode(size_t lanes, const char* in_name, const char* out_name);
+
+   private:
+    size_t m_lanes;
+    AuEnvelopeBank m_bank;
+    std::vector<float> m_last;  // Amplitudes the current notes started from
+};
+
+class AuADSR : public AuEnvelopeNode {
+   public:
+    AuADSR() : AuEnvelopeNode(1, "amplitude", "out") {}
+    std::string_view name() const {
+        return "ADSR";
+    }
+};
+
+class AuADSRBank : public AuEnvelopeNode {
+   public:
+    static constexpr size_t kLanes = 8;
+
+    AuADSRBank() : AuEnvelopeNode(kLanes, "amplitude", "out") {}
+    std::string_view name() const {
+        return "ADSRBank";
+    }
+};
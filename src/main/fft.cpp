@@ -0,0 +1,112 @@
+#include "fft.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+
+AuFft::AuFft(size_t size) : m_size(size), m_half(size / 2) {
+    assert(size >= 4 && (size & (size - 1)) == 0);
+    int bits = 0;
+    while ((size_t(1) << bits) < m_half) {
+        bits++;
+    }
+    m_reverse.resize(m_half);
+    for (size_t i = 0; i < m_half; ++i) {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        m_reverse[i] = r;
+    }
+    m_stage_cos.resize(std::max<size_t>(m_half, 1));
+    m_stage_sin.resize(std::max<size_t>(m_half, 1));
+    for (size_t h = 1; h < m_half; h *= 2) {
+        for (size_t k = 0; k < h; ++k) {
+            const double angle = -M_PI * k / h;
+            m_stage_cos[h - 1 + k] = (float)cos(angle);
+            m_stage_sin[h - 1 + k] = (float)sin(angle);
+        }
+    }
+    m_cos.resize(m_half + 1);
+    m_sin.resize(m_half + 1);
+    for (size_t k = 0; k <= m_half; ++k) {
+        const double angle = -2.0 * M_PI * k / m_size;
+        m_cos[k] = (float)cos(angle);
+        m_sin[k] = (float)sin(angle);
+    }
+    m_re.resize(m_half);
+    m_im.resize(m_half);
+}
+
+void AuFft::transform(float* re, float* im) const {
+    for (size_t i = 0; i < m_half; ++i) {
+        const size_t j = m_reverse[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+    for (size_t h = 1; h < m_half; h *= 2) {
+        const float* wr = m_stage_cos.data() + h - 1;
+        const float* wi = m_stage_sin.data() + h - 1;
+        for (size_t i = 0; i < m_half; i += 2 * h) {
+            float* ar = re + i;
+            float* ai = im + i;
+            float* br = re + i + h;
+            float* bi = im + i + h;
+            for (size_t k = 0; k < h; ++k) {
+                const float tr = br[k] * wr[k] - bi[k] * wi[k];
+                const float ti = br[k] * wi[k] + bi[k] * wr[k];
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+}
+
+void AuFft::forward(const float* in, float* re, float* im) {
+    float* zr = m_re.data();
+    float* zi = m_im.data();
+    for (size_t k = 0; k < m_half; ++k) {
+        zr[k] = in[2 * k];
+        zi[k] = in[2 * k + 1];
+    }
+    transform(zr, zi);
+    // Even and odd samples' spectra from z and its mirror, then combined.
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[m_half] = zr[0] - zi[0];
+    im[m_half] = 0.0f;
+    for (size_t k = 1; k < m_half; ++k) {
+        const float a = zr[k], b = zi[k];
+        const float c = zr[m_half - k], d = zi[m_half - k];
+        const float er = 0.5f * (a + c), ei = 0.5f * (b - d);
+        const float orr = 0.5f * (b + d), oi = -0.5f * (a - c);
+        re[k] = er + m_cos[k] * orr - m_sin[k] * oi;
+        im[k] = ei + m_cos[k] * oi + m_sin[k] * orr;
+    }
+}
+
+void AuFft::inverse(const float* re, const float* im, float* out) {
+    float* zr = m_re.data();
+    float* zi = m_im.data();
+    for (size_t k = 0; k < m_half; ++k) {
+        const float a = re[k], b = im[k];
+        const float c = re[m_half - k], d = im[m_half - k];
+        const float er = a + c, ei = b - d;
+        const float dr = a - c, di = b + d;
+        // Twice the odd spectrum, (x[k] - conj(x[half - k])) / w^k.
+        const float orr = dr * m_cos[k] + di * m_sin[k];
+        const float oi = di * m_cos[k] - dr * m_sin[k];
+        zr[k] = er - oi;
+        zi[k] = ei + orr;
+    }
+    transform(zi, zr);
+    for (size_t k = 0; k < m_half; ++k) {
+        out[2 * k] = zr[k];
+        out[2 * k + 1] = zi[k];
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// Real FFT of a power of two size, as a complex FFT of half the size. Spectra
+// are the size / 2 + 1 bins from DC to Nyquist in split real and imaginary
+// arrays, so products of spectra are plain loops the compiler vectorizes.
+// Neither direction scales: inverse(forward(x)) is x times size().
+class AuFft {
+   public:
+    explicit AuFft(size_t size);
+
+    size_t size() const {
+        return m_size;
+    }
+    size_t bins() const {
+        return m_half + 1;
+    }
+    void forward(const float* in, float* re, float* im);
+    void inverse(const float* re, const float* im, float* out);
+
+   private:
+    // In place complex FFT of m_half points. Swapping re and im inverts it.
+    void transform(float* re, float* im) const;
+
+    size_t m_size;
+    size_t m_half;
+    std::vector<uint32_t> m_reverse;  // Bit reversal permutation of m_half
+    // e^(-2 pi i k / 2h) for k < h of the stage that combines pairs of h
+    // points, stored from h - 1 on, so each stage reads them contiguously.
+    std::vector<float> m_stage_cos;
+    std::vector<float> m_stage_sin;
+    // e^(-2 pi i k / size) for k <= m_half, which split the half size
+    // transform into the real one.
+    std::vector<float> m_cos;
+    std::vector<float> m_sin;
+    std::vector<float> m_re;  // Scratch
+    std::vector<float> m_im;
+};
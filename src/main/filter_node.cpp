@@ -0,0 +1,224 @@
+#include "filter_node.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// NaN passes through std::clamp and would stay in the filter state, so
+// non-finite settings fall back to value.
+float finiteOr(float setting, float value) {
+    return std::isfinite(setting) ? setting : value;
+}
+
+float clampCutoff(float cutoff, float sample_rate) {
+    return std::clamp(finiteOr(cutoff, 1000.0f), 10.0f, 0.49f * sample_rate);
+}
+
+}  // namespace
+
+template <size_t kLanes>
+void AuSvfCore<kLanes>::setCoefficients(size_t lane, float cutoff_hz, float res, float rate) {
+    cutoff[lane] = cutoff_hz;
+    resonance[lane] = res;
+    sample_rate[lane] = rate;
+    float g = tanf((float)M_PI * clampCutoff(cutoff_hz, rate) / rate);
+    k[lane] = 2.0f - 2.0f * std::clamp(finiteOr(res, 0.0f), 0.0f, 0.98f);
+    a1[lane] = 1.0f / (1.0f + g * (g + k[lane]));
+    a2[lane] = g * a1[lane];
+    a3[lane] = g * a2[lane];
+}
+
+template <size_t kLanes>
+void AuSvfCore<kLanes>::reset() {
+    std::fill_n(ic1eq, kLanes, 0.0f);
+    std::fill_n(ic2eq, kLanes, 0.0f);
+}
+
+template <size_t kLanes>
+void AuSvfCore<kLanes>::process(const float* x, float* low, float* band, float* high, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            size_t n = i * kLanes + lane;
+            float v0 = x[n];
+            float v3 = v0 - ic2eq[lane];
+            float v1 = a1[lane] * ic1eq[lane] + a2[lane] * v3;
+            float v2 = ic2eq[lane] + a2[lane] * ic1eq[lane] + a3[lane] * v3;
+            ic1eq[lane] = 2.0f * v1 - ic1eq[lane];
+            ic2eq[lane] = 2.0f * v2 - ic2eq[lane];
+            low[n] = v2;
+            band[n] = v1;
+            high[n] = v0 - k[lane] * v1 - v2;
+        }
+    }
+}
+
+template <size_t kLanes>
+void AuBiquadCore<kLanes>::setCoefficients(size_t lane, AuBiquadType t, float cutoff_hz, float quality, float rate) {
+    type[lane] = t;
+    cutoff[lane] = cutoff_hz;
+    q[lane] = quality;
+    sample_rate[lane] = rate;
+    float w0 = 2.0f * (float)M_PI * clampCutoff(cutoff_hz, rate) / rate;
+    float c = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * std::clamp(finiteOr(quality, 0.707f), 0.05f, 1000.0f));
+    float nb0, nb1, nb2;
+    switch (t) {
+        case AuBiquadType::LowPass:
+            nb0 = nb2 = (1.0f - c) * 0.5f;
+            nb1 = 1.0f - c;
+            break;
+        case AuBiquadType::HighPass:
+            nb0 = nb2 = (1.0f + c) * 0.5f;
+            nb1 = -(1.0f + c);
+            break;
+        case AuBiquadType::BandPass:
+            nb0 = alpha;
+            nb1 = 0.0f;
+            nb2 = -alpha;
+            break;
+        case AuBiquadType::Notch:
+        default:
+            nb0 = nb2 = 1.0f;
+            nb1 = -2.0f * c;
+            break;
+    }
+    float a0 = 1.0f + alpha;
+    b0[lane] = nb0 / a0;
+    b1[lane] = nb1 / a0;
+    b2[lane] = nb2 / a0;
+    a1[lane] = -2.0f * c / a0;
+    a2[lane] = (1.0f - alpha) / a0;
+}
+
+template <size_t kLanes>
+void AuBiquadCore<kLanes>::reset() {
+    std::fill_n(z1, kLanes, 0.0f);
+    std::fill_n(z2, kLanes, 0.0f);
+}
+
+template <size_t kLanes>
+void AuBiquadCore<kLanes>::process(const float* x, float* y, size_t frames) {
+    for (size_t i = 0; i < frames; ++i) {
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            size_t n = i * kLanes + lane;
+            float in = x[n];
+            float out = b0[lane] * in + z1[lane];
+            z1[lane] = b1[lane] * in - a1[lane] * out + z2[lane];
+            z2[lane] = b2[lane] * in - a2[lane] * out;
+            y[n] = out;
+        }
+    }
+}
+
+template struct AuSvfCore<1>;
+template struct AuSvfCore<4>;
+template struct AuBiquadCore<1>;
+
+AuSvf::AuSvf() {
+    addInPin("in", 0.0);
+    addInPin("cutoff", 1000.0, AuRate::Control);
+    addInPin("resonance", 0.5, AuRate::Control);
+    addOutPin("low");
+    addOutPin("band");
+    addOutPin("high");
+}
+
+void AuSvf::prepare(const AuGraphConfig& config) {
+    // A device reopen at the same rate keeps the state, so the tail carries on.
+    if (config.sample_rate != m_sample_rate) {
+        m_sample_rate = config.sample_rate;
+        m_core.reset();
+    }
+}
+
+void AuSvf::process(const AuProcessContext& ctx) {
+    const float* cutoff = ctx.in(1);
+    const float* resonance = ctx.in(2);
+    for (size_t t = 0, start = 0; start < ctx.frames; ++t, start += ctx.tick_frames) {
+        if (cutoff[t] != m_core.cutoff[0] || resonance[t] != m_core.resonance[0] || ctx.sample_rate != m_core.sample_rate[0]) {
+            m_core.setCoefficients(0, cutoff[t], resonance[t], ctx.sample_rate);
+        }
+        size_t len = std::min(ctx.tick_frames, ctx.frames - start);
+        m_core.process(ctx.in(0) + start, ctx.out(0) + start, ctx.out(1) + start, ctx.out(2) + start, len);
+    }
+}
+
+AuSvfBank::AuSvfBank() {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        addInPin("in" + std::to_string(lane + 1), 0.0);
+    }
+    addInPin("cutoff", 1000.0, AuRate::Control);
+    addInPin("resonance", 0.5, AuRate::Control);
+    addInPin("mode", 0.0, AuRate::Init);  // 0 low, 1 band, 2 high pass
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        addOutPin("out" + std::to_string(lane + 1));
+    }
+}
+
+void AuSvfBank::prepare(const AuGraphConfig& config) {
+    if (config.sample_rate != m_sample_rate) {
+        m_sample_rate = config.sample_rate;
+        m_core.reset();
+    }
+    m_in.resize(config.max_frames * kLanes);
+    m_out.resize(3 * config.max_frames * kLanes);
+}
+
+void AuSvfBank::process(const AuProcessContext& ctx) {
+    const float* cutoff = ctx.in(kLanes);
+    const float* resonance = ctx.in(kLanes + 1);
+    const size_t mode = std::min((size_t)std::max(ctx.in(kLanes + 2)[0], 0.0f), (size_t)2);
+    const size_t stride = ctx.frames * kLanes;
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            m_in[i * kLanes + lane] = ctx.in(lane)[i];
+        }
+    }
+    float* low = m_out.data();
+    for (size_t t = 0, start = 0; start < ctx.frames; ++t, start += ctx.tick_frames) {
+        if (cutoff[t] != m_core.cutoff[0] || resonance[t] != m_core.resonance[0] || ctx.sample_rate != m_core.sample_rate[0]) {
+            for (size_t lane = 0; lane < kLanes; ++lane) {
+                m_core.setCoefficients(lane, cutoff[t], resonance[t], ctx.sample_rate);
+            }
+        }
+        size_t len = std::min(ctx.tick_frames, ctx.frames - start);
+        size_t n = start * kLanes;
+        m_core.process(m_in.data() + n, low + n, low + stride + n, low + 2 * stride + n, len);
+    }
+    const float* out = low + mode * stride;
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        for (size_t lane = 0; lane < kLanes; ++lane) {
+            ctx.out(lane)[i] = out[i * kLanes + lane];
+        }
+    }
+}
+
+AuBiquad::AuBiquad() {
+    addInPin("in", 0.0);
+    addInPin("cutoff", 1000.0, AuRate::Control);
+    addInPin("q", 0.707, AuRate::Control);
+    addInPin("type", 0.0, AuRate::Init);  // 0 low, 1 high, 2 band pass, 3 notch
+    addOutPin("out");
+}
+
+void AuBiquad::prepare(const AuGraphConfig& config) {
+    if (config.sample_rate != m_sample_rate) {
+        m_sample_rate = config.sample_rate;
+        m_core.reset();
+    }
+}
+
+void AuBiquad::process(const AuProcessContext& ctx) {
+    const float* cutoff = ctx.in(1);
+    const float* q = ctx.in(2);
+    const AuBiquadType type = (AuBiquadType)std::clamp((int)ctx.in(3)[0], 0, 3);
+    for (size_t t = 0, start = 0; start < ctx.frames; ++t, start += ctx.tick_frames) {
+        if (cutoff[t] != m_core.cutoff[0] || q[t] != m_core.q[0] || type != m_core.type[0] ||
+            ctx.sample_rate != m_core.sample_rate[0]) {
+            m_core.setCoefficients(0, type, cutoff[t], q[t], ctx.sample_rate);
+        }
+        size_t len = std::min(ctx.tick_frames, ctx.frames - start);
+        m_core.process(ctx.in(0) + start, ctx.out(0) + start, len);
+    }
+}
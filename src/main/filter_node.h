@@ -0,0 +1,99 @@
+#pragma once
+#include "audio_graph.h"
+
+#include <vector>
+
+// Filter cores run kLanes independent channels side by side. Samples are
+// interleaved (frame * kLanes + lane) so the inner loop over lanes compiles
+// to SIMD code. Coefficients are per lane and only recomputed when cutoff,
+// resonance or sample rate change, at most once per control tick.
+
+// Trapezoidal state variable filter (Simper). Gives low, band and high pass at
+// once and stays stable under fast cutoff modulation.
+template <size_t kLanes>
+struct AuSvfCore {
+    void setCoefficients(size_t lane, float cutoff, float resonance, float sample_rate);
+    void reset();
+    // x: frames * kLanes input, low/band/high receive all three outputs.
+    void process(const float* x, float* low, float* band, float* high, size_t frames);
+
+    float a1[kLanes] = {};
+    float a2[kLanes] = {};
+    float a3[kLanes] = {};
+    float k[kLanes] = {};
+    float ic1eq[kLanes] = {};
+    float ic2eq[kLanes] = {};
+    // Inputs the coefficients were computed from.
+    float cutoff[kLanes] = {};
+    float resonance[kLanes] = {};
+    float sample_rate[kLanes] = {};
+};
+
+enum class AuBiquadType { LowPass, HighPass, BandPass, Notch };
+
+// RBJ cookbook biquad in transposed direct form II.
+template <size_t kLanes>
+struct AuBiquadCore {
+    void setCoefficients(size_t lane, AuBiquadType type, float cutoff, float q, float sample_rate);
+    void reset();
+    void process(const float* x, float* y, size_t frames);
+
+    float b0[kLanes] = {};
+    float b1[kLanes] = {};
+    float b2[kLanes] = {};
+    float a1[kLanes] = {};
+    float a2[kLanes] = {};
+    float z1[kLanes] = {};
+    float z2[kLanes] = {};
+    AuBiquadType type[kLanes] = {};
+    float cutoff[kLanes] = {};
+    float q[kLanes] = {};
+    float sample_rate[kLanes] = {};
+};
+
+class AuSvf : public AuNodeBase {
+   public:
+    AuSvf();
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "SVF";
+    }
+
+   private:
+    AuSvfCore<1> m_core;
+    float m_sample_rate = 0.0f;  // Filter state is kept across prepares at the same rate
+};
+
+// Four signals through one SIMD SVF, sharing cutoff and resonance.
+class AuSvfBank : public AuNodeBase {
+   public:
+    static const size_t kLanes = 4;
+
+    AuSvfBank();
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "SVFBank";
+    }
+
+   private:
+    AuSvfCore<kLanes> m_core;
+    float m_sample_rate = 0.0f;
+    std::vector<float> m_in;
+    std::vector<float> m_out;
+};
+
+class AuBiquad : public AuNodeBase {
+   public:
+    AuBiquad();
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "Biquad";
+    }
+
+   private:
+    AuBiquadCore<1> m_core;
+    float m_sample_rate = 0.0f;
+};
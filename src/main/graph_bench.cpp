@@ -0,0 +1,194 @@
+// Renders a large generated patch without an audio device and reports the
+// time per block. Run it before and after a change to the graph executor.
+// Then edits the patch and reports the recompile time per kind of edit, and
+// fails if a patched plan differs from compiling the edited graph from scratch.
+//
+//   imsynth_bench [nodes] [blocks] [frames] [jit]
+//
+// With jit set to 1 the patch is fused into native kernels first, which needs
+// a compiler installed, see graph_jit.h.
+//
+// Built with IMSYNTH_REALTIME_GUARD it fails on any realtime violation in the
+// timed loop.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <print>
+#include <thread>
+#include <vector>
+
+#include "audio_graph.h"
+#include "graph_compiler.h"
+#include "realtime_guard.h"
+
+// A chain of Sub nodes where node i reads node i - 1 and node i / 2, fed by a
+// handful of sines. Nodes are created between unrelated allocations, like in a
+// patch that was edited for a while, so they end up spread over the heap.
+static AuNodeGraphPtr createBenchGraph(size_t nodes, std::vector<AuNodePtr>& chain, std::vector<std::unique_ptr<char[]>>& clutter) {
+    AuNodeGraphPtr graph = std::make_shared<AuNodeGraph>();
+    for (size_t i = 0; i < nodes; ++i) {
+        AuNodePtr node;
+        if (i < 8) {
+            node = std::make_shared<AuSineGenerator>();
+            node->inPin(0).set(110.0f * (i + 1));
+            node->inPin(1).set(0.1f);
+        } else {
+            node = std::make_shared<AuSub>();
+            node->inPin(0).connect(chain[i - 1], 0);
+            node->inPin(1).connect(chain[i / 2], 0);
+        }
+        graph->addNode(node);
+        chain.push_back(node);
+        clutter.emplace_back(new char[64 + rand() % 4096]);
+    }
+    graph->setOutputNode(chain.back());
+    return graph;
+}
+
+// True if the graph's current plan schedules the same as a full compile:
+// the same nodes at each rate, oversampled and specialized, and the same
+// latency.
+static bool matchesCompile(const AuNodeGraph& graph) {
+    AuGraphCompiler compiler;
+    std::unique_ptr<AuGraphPlan> plan = compiler.compile(graph);
+    const AuNodeGraph::Stats stats = graph.stats();
+    return plan->audioNodes() == stats.audio_nodes && plan->controlNodes() == stats.control_nodes &&
+           plan->oversampledNodes() == stats.oversampled_nodes && plan->specializedNodes() == stats.specialized_nodes &&
+           plan->latency() == stats.latency;
+}
+
+// Recompile times of one kind of edit.
+struct EditTimes {
+    double total_ms = 0.0;
+    double worst_ms = 0.0;
+    size_t count = 0;
+    size_t patched = 0;
+    size_t mismatched = 0;
+
+    void add(const AuNodeGraph& graph) {
+        const AuNodeGraph::Stats stats = graph.stats();
+        total_ms += stats.compile_ms;
+        worst_ms = std::max(worst_ms, (double)stats.compile_ms);
+        count++;
+        patched += stats.patched;
+        mismatched += !matchesCompile(graph);
+    }
+
+    void print(const char* name) const {
+        std::print("{:14}{:.3f} ms average, {:.3f} ms worst, {} of {} patched\n", name, count ? total_ms / count : 0.0, worst_ms, patched,
+                   count);
+        if (mismatched) {
+            std::print("Error: {} of {} plans differ from a full compile\n", mismatched, count);
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    const size_t nodes = argc > 1 ? atoi(argv[1]) : 1000;
+    const size_t blocks = argc > 2 ? atoi(argv[2]) : 2000;
+    const size_t frames = argc > 3 ? atoi(argv[3]) : 256;
+    const bool jit = argc > 4 && atoi(argv[4]) != 0;
+
+    std::vector<std::unique_ptr<char[]>> clutter;
+    std::vector<AuNodePtr> chain;
+    AuNodeGraphPtr graph = createBenchGraph(nodes, chain, clutter);
+    // Not connected until the rate edits.
+    AuNodePtr lfo = std::make_shared<AuSineGenerator>();
+    AuNodePtr ema = std::make_shared<AuEMAGenerator>();
+    lfo->inPin(0).set(2.0f);
+    lfo->inPin(1).set(0.01f);
+    ema->inPin(0).connect(chain[0], 0);
+    graph->addNode(lfo);
+    graph->addNode(ema);
+    AuGraphConfig config;
+    config.max_frames = frames;
+    graph->prepare(config);
+    if (jit) {
+        graph->setJit(true);
+        graph->update();
+        while (graph->stats().jit_pending > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            graph->update();
+        }
+    }
+
+    // Warm up, which also picks up the compiled plan.
+    float sum = 0.0f;
+    for (size_t i = 0; i < 100; ++i) {
+        sum += graph->process(frames)[0];
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        AuRealtimeScope realtime;
+        for (size_t i = 0; i < blocks; ++i) {
+            sum += graph->process(frames)[0];
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    const double per_block = elapsed / blocks;
+    std::print("Nodes:        {}\n", nodes);
+    std::print("Block:        {} frames\n", frames);
+    std::print("Fused:        {} nodes in {} kernels\n", graph->stats().fused_nodes, graph->stats().fused_kernels);
+    std::print("Per block:    {:.0f} ns\n", per_block);
+    std::print("Per node:     {:.1f} ns\n", per_block / nodes);
+    std::print("Realtime:     {:.1f}x\n", frames / config.sample_rate * 1e9 / per_block);
+    std::print("Checksum:     {}\n", sum);
+
+    // Each edit is followed by a block, so the audio side takes every plan.
+    EditTimes values, rewires, adds, rates;
+    for (size_t i = 0; i < 200 && nodes > 9; ++i) {
+        graph->setValue(chain[i % 8], 0, 110.0f * (i % 8 + 1) + (float)(i % 5));
+        graph->update();
+        values.add(*graph);
+        graph->process(frames);
+
+        AuNodePtr node = chain[8 + rand() % (nodes - 8)];
+        graph->connect(node, 1, chain[rand() % 8], 0);
+        graph->update();
+        rewires.add(*graph);
+        graph->process(frames);
+
+        // The lfo goes from an audio rate input to only a control rate one,
+        // which lowers it to control rate, then out of the patch.
+        const size_t j = 8 + rand() % (nodes - 8);
+        graph->connect(chain[j], 1, lfo, 0);
+        graph->update();
+        rates.add(*graph);
+        graph->process(frames);
+        graph->connect(chain[j], 1, ema, 0);
+        graph->connect(ema, 1, lfo, 0);
+        graph->update();
+        rates.add(*graph);
+        graph->process(frames);
+        graph->connect(chain[j], 1, chain[j / 2], 0);
+        graph->disconnect(ema, 1);
+        graph->update();
+        rates.add(*graph);
+        graph->process(frames);
+
+        const size_t k = 9 + rand() % (nodes - 9);
+        AuNodePtr added = std::make_shared<AuSub>();
+        graph->addNode(added);
+        graph->connect(added, 0, chain[k - 1], 0);
+        graph->connect(added, 1, chain[k / 2], 0);
+        graph->connect(chain[k], 1, added, 0);
+        graph->update();
+        adds.add(*graph);
+        graph->process(frames);
+    }
+    values.print("Value edit:");
+    rewires.print("Rewire:");
+    adds.print("Add node:");
+    rates.print("Rate change:");
+    if (size_t violations = reportRealtimeViolations()) {
+        std::print("Error: {} realtime violations\n", violations);
+        return 1;
+    }
+    const size_t mismatched = values.mismatched + rewires.mismatched + adds.mismatched + rates.mismatched;
+    return mismatched ? 1 : 0;
+}
@@ -0,0 +1,1321 @@
+#include "graph_compiler.h"
+
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <unordered_set>
+
+namespace {
+// Bounds the size of generated sources, and so compile time.
+const size_t kMaxFusedNodes = 32;
+// Order keys of a full compile are this far apart, which leaves room for the
+// nodes patches schedule between them.
+const uint64_t kOrderGap = 1ull << 32;
+
+float resampleLatency(size_t from_factor, size_t to_factor) {
+    float delay = 0.0f;
+    if (from_factor != to_factor) {
+        delay += from_factor > 1 ? AuResampler::latency(from_factor, false) : 0.0f;
+        delay += to_factor > 1 ? AuResampler::latency(to_factor, true) : 0.0f;
+    }
+    return delay;
+}
+}  // namespace
+
+AuGraphPlan::AuGraphPlan(const AuGraphLayout& layout) {
+    build(layout);
+}
+
+void AuGraphPlan::build(const AuGraphLayout& layout) {
+    AuGraphLayout::operator=(layout);
+    m_inputs.clear();
+    m_outputs.clear();
+    m_fused_inputs.clear();
+    m_fused_outputs.clear();
+    m_capture_slots.clear();
+    m_resamplers.clear();
+
+    // Over-allocate by one cache line and align the base by hand. Patches
+    // grow the arena a little at a time, so leave room for them.
+    const size_t size = m_arena_size + 64 / sizeof(float);
+    if (m_arena_storage.capacity() < size) {
+        m_arena_storage.reserve(size + size / 4);
+    }
+    m_arena_storage.assign(size, 0.0f);
+    uintptr_t base = (uintptr_t)m_arena_storage.data();
+    m_arena = m_arena_storage.data() + ((64 - base % 64) % 64) / sizeof(float);
+
+    for (const ConstantStep& step : m_constants) {
+        std::fill_n(buffer(step.dst), step.size, step.value);
+    }
+    for (uint32_t offset : m_input_offsets) {
+        m_inputs.push_back(buffer(offset));
+    }
+    for (uint32_t offset : m_output_offsets) {
+        m_outputs.push_back(buffer(offset));
+    }
+    for (uint32_t offset : m_fused_input_offsets) {
+        m_fused_inputs.push_back(buffer(offset));
+    }
+    for (uint32_t offset : m_fused_output_offsets) {
+        m_fused_outputs.push_back(buffer(offset));
+    }
+    for (const ResampleStep& step : m_resamples) {
+        m_resamplers.push_back(step.factor ? std::make_unique<AuResampler>(step.factor, step.up, m_config.max_frames) : nullptr);
+    }
+    m_output = buffer(m_output_offset);
+
+    for (CaptureStep& step : m_captures) {
+        const float* dst = buffer(step.dst);
+        step.first_slot = (uint32_t)m_capture_slots.size();
+        for (const float*& input : m_inputs) {
+            if (input == dst) {
+                m_capture_slots.push_back(&input);
+            }
+        }
+        for (const float*& input : m_fused_inputs) {
+            if (input == dst) {
+                m_capture_slots.push_back(&input);
+            }
+        }
+        step.slots = (uint32_t)m_capture_slots.size() - step.first_slot;
+    }
+}
+
+void AuGraphPlan::adopt(AuGraphPlan& previous) {
+    if (m_base == 0 || m_base != previous.m_generation) {
+        return;
+    }
+    // Patches only append steps, so shared steps have the same index.
+    const size_t resamplers = std::min(m_resamplers.size(), previous.m_resamplers.size());
+    for (size_t i = 0; i < resamplers; ++i) {
+        if (m_resamplers[i] && previous.m_resamplers[i]) {
+            std::swap(m_resamplers[i], previous.m_resamplers[i]);
+        }
+    }
+    const size_t ramps = std::min(m_ramps.size(), previous.m_ramps.size());
+    for (size_t i = 0; i < ramps; ++i) {
+        m_ramps[i].last = previous.m_ramps[i].last;
+    }
+    for (const Span& span : m_feedback) {
+        if (span.offset + span.size <= previous.m_arena_size) {
+            std::copy_n(previous.buffer(span.offset), span.size, buffer(span.offset));
+        }
+    }
+}
+
+const float* AuGraphPlan::process(size_t frames, const AuCaptureBlock& capture) {
+    const size_t period = m_config.control_period;
+    const size_t ticks = (frames + period - 1) / period;
+    for (const Step& step : m_steps) {
+        switch (step.kind) {
+            case Step::Constant: {
+                ConstantStep& constant = m_constants[step.index];
+                AuParam& param = *constant.param;
+                float* dst = buffer(constant.dst);
+                const size_t size = constant.size;
+                const size_t repeat = constant.repeat;
+                const bool ramping = param.remaining > 0;
+                if (ramping) {
+                    const size_t unit = constant.control ? period : 1;
+                    const size_t count = constant.control ? ticks : frames;
+                    for (size_t i = 0; i < count; ++i) {
+                        if (param.remaining > 0) {
+                            size_t n = std::min(unit, param.remaining);
+                            param.current += param.step * n;
+                            param.remaining -= n;
+                            if (param.remaining == 0) {
+                                param.current = param.target;
+                            }
+                        }
+                        if (repeat == 1) {
+                            dst[i] = param.current;
+                        } else {
+                            std::fill_n(dst + i * repeat, repeat, param.current);
+                        }
+                    }
+                    std::fill(dst + count * repeat, dst + size, param.current);
+                    constant.value = std::numeric_limits<float>::quiet_NaN();
+                } else if (param.current != constant.value) {
+                    std::fill_n(dst, size, param.current);
+                    constant.value = param.current;
+                }
+                const bool valid = !ramping && constant.value == constant.compiled;
+                if (valid != constant.valid) {
+                    ProcessStep& consumer = m_processes[constant.consumer];
+                    consumer.invalid = valid ? consumer.invalid - 1 : consumer.invalid + 1;
+                    constant.valid = valid;
+                }
+                break;
+            }
+            case Step::Ramp: {
+                // Each tick ramps linearly from the previous tick value and
+                // reaches its own value on the last frame of the tick.
+                RampStep& ramp = m_ramps[step.index];
+                const float* src = buffer(ramp.src);
+                float* dst = buffer(ramp.dst);
+                float& last = ramp.from ? *ramp.from : ramp.last;
+                const size_t tick_frames = period * ramp.factor;
+                const size_t total = frames * ramp.factor;
+                float from = last;
+                for (size_t t = 0; t < ticks; ++t) {
+                    size_t start = t * tick_frames;
+                    size_t len = std::min(tick_frames, total - start);
+                    float to = src[t];
+                    float inc = (to - from) / len;
+                    for (size_t i = 0; i < len; ++i) {
+                        dst[start + i] = from + inc * (i + 1);
+                    }
+                    from = to;
+                }
+                last = from;
+                break;
+            }
+            case Step::Decimate: {
+                const CopyStep& decimate = m_decimates[step.index];
+                const float* src = buffer(decimate.src);
+                float* dst = buffer(decimate.dst);
+                for (size_t t = 0; t < ticks; ++t) {
+                    dst[t] = src[t * decimate.stride];
+                }
+                break;
+            }
+            case Step::Latch: {
+                CopyStep& latch = m_latches[step.index];
+                if (!latch.latched) {
+                    std::fill_n(buffer(latch.dst), m_max_ticks, buffer(latch.src)[0]);
+                    latch.latched = true;
+                }
+                break;
+            }
+            case Step::Resample: {
+                const ResampleStep& resample = m_resamples[step.index];
+                m_resamplers[step.index]->process(buffer(resample.src), buffer(resample.dst), frames);
+                break;
+            }
+            case Step::Process: {
+                run(m_processes[step.index], frames, ticks);
+                break;
+            }
+            case Step::Fused: {
+                const FusedStep& fused = m_fused[step.index];
+                const ProcessStep* members = m_processes.data() + fused.first_process;
+                bool valid = true;
+                for (uint32_t p = 0; p < fused.processes; ++p) {
+                    valid = valid && members[p].invalid == 0;
+                }
+                if (valid) {
+                    fused.kernel(m_fused_inputs.data() + fused.first_input, m_fused_outputs.data() + fused.first_output,
+                                 m_fused_states.data() + fused.first_state, frames);
+                } else {
+                    for (uint32_t p = 0; p < fused.processes; ++p) {
+                        run(members[p], frames, ticks);
+                    }
+                }
+                break;
+            }
+            case Step::Capture: {
+                const CaptureStep& capture_step = m_captures[step.index];
+                const float* src = capture_step.channel < capture.count ? capture.channels[capture_step.channel] : nullptr;
+                if (!src || capture_step.copy) {
+                    float* dst = buffer(capture_step.dst);
+                    if (src) {
+                        std::copy_n(src, frames, dst);
+                    } else {
+                        std::fill_n(dst, frames, 0.0f);
+                    }
+                    src = dst;
+                }
+                for (uint32_t s = 0; s < capture_step.slots; ++s) {
+                    *m_capture_slots[capture_step.first_slot + s] = src;
+                }
+                break;
+            }
+            case Step::Probe: {
+                const ProbeStep& probe = m_probes[step.index];
+                const float rate = probe.control ? m_config.sample_rate / m_config.control_period : m_config.sample_rate * probe.factor;
+                probe.probe->publish(buffer(probe.src), probe.control ? ticks : frames * probe.factor, rate);
+                break;
+            }
+        }
+    }
+    return m_output;
+}
+
+void AuGraphPlan::run(const ProcessStep& process, size_t frames, size_t ticks) {
+    const size_t period = m_config.control_period;
+    AuProcessContext ctx;
+    ctx.frames = process.control ? ticks : frames * process.factor;
+    ctx.tick_frames = process.control ? 1 : period * process.factor;
+    ctx.sample_rate = process.control ? m_config.sample_rate / period : m_config.sample_rate * process.factor;
+    ctx.inputs = m_inputs.data() + process.first_input;
+    ctx.outputs = m_outputs.data() + process.first_output;
+    if (process.kernel && process.invalid == 0) {
+        process.kernel(*process.node, ctx);
+    } else {
+        process.node->process(ctx);
+    }
+}
+
+std::unique_ptr<AuGraphPlan> AuGraphCompiler::compile(const AuNodeGraph& graph) {
+    m_layout = AuGraphLayout();
+    m_layout.m_config = graph.config();
+    m_layout.m_max_ticks = (m_layout.m_config.max_frames + m_layout.m_config.control_period - 1) / m_layout.m_config.control_period;
+    m_output = graph.getOutputNode();
+    m_compiled = true;
+    m_patched = false;
+    m_insert = 0;
+    m_scheduled.clear();
+    m_out_buffers.clear();
+    m_ramped.clear();
+    m_decimated.clear();
+    m_resampled.clear();
+    m_sources.clear();
+    m_input_constants.clear();
+    m_runs.clear();
+    m_waiting.clear();
+
+    if (!m_output || m_output->outPins() == 0) {
+        m_layout.m_output_offset = allocate(bufferSize(false));
+        m_compiled_arena = m_layout.m_arena_size;
+        return instantiate(0);
+    }
+
+    // Dependency order of everything the output node reaches. Edges back to a
+    // node that is still being visited close a feedback loop.
+    std::vector<AuNodePtr> order;
+    std::unordered_map<AuNode*, size_t> position;
+    std::unordered_map<AuNode*, bool> visiting;
+    auto visit = [&](auto& self, const AuNodePtr& node) -> void {
+        if (visiting.count(node.get())) {
+            return;
+        }
+        visiting[node.get()] = true;
+        for (size_t i = 0; i < node->inPins(); ++i) {
+            if (AuNodePtr upstream = node->inPin(i).node()) {
+                self(self, upstream);
+            }
+        }
+        visiting[node.get()] = false;
+        position[node.get()] = order.size();
+        order.push_back(node);
+    };
+    visit(visit, m_output);
+
+    // Rates flow from consumers to producers: a node runs at audio rate if
+    // some audio rate node reads one of its outputs through an audio rate pin.
+    std::vector<AuRate> rate(order.size(), AuRate::Control);
+    for (size_t n = 0; n < order.size(); ++n) {
+        const AuNodePtr& node = order[n];
+        if (node->rate() != AuRate::Control && (node == m_output || node->fixedRate())) {
+            rate[n] = AuRate::Audio;
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t n = order.size(); n-- > 0;) {
+            if (rate[n] != AuRate::Audio) {
+                continue;
+            }
+            const AuNodePtr& node = order[n];
+            for (size_t i = 0; i < node->inPins(); ++i) {
+                Pin& pin = node->inPin(i);
+                AuNodePtr upstream = pin.node();
+                if (!upstream || pin.rate() != AuRate::Audio || upstream->rate() == AuRate::Control) {
+                    continue;
+                }
+                size_t u = position[upstream.get()];
+                if (rate[u] != AuRate::Audio) {
+                    rate[u] = AuRate::Audio;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // Oversampling only applies to audio rate nodes.
+    for (size_t n = 0; n < order.size(); ++n) {
+        Node& info = m_scheduled[order[n].get()];
+        const size_t f = order[n]->oversampling();
+        info.order = (n + 1) * kOrderGap;
+        info.control = rate[n] == AuRate::Control;
+        if (!info.control && (f == 2 || f == 4 || f == 8) && order[n]->captureChannel() < 0) {
+            info.factor = (uint32_t)f;
+        }
+    }
+    for (const AuNodePtr& node : order) {
+        emit(node);
+    }
+
+    Pin& output_pin = m_output->outPin(0);
+    const Node& out = m_scheduled.at(m_output.get());
+    m_layout.m_output_offset = !out.control ? resample(m_output.get(), output_pin, 1) : ramp(m_output.get(), output_pin, 1);
+    m_layout.m_latency = out.latency + (!out.control ? resampleLatency(out.factor, 1) : 0.0f);
+    for (const AuNodePtr& node : order) {
+        addProbes(node.get());
+    }
+    if (AuJitCompiler* jit = graph.jit()) {
+        fuse(*jit);
+    }
+    markCaptureCopies();
+    m_new_reads.clear();
+    m_compiled_arena = m_layout.m_arena_size;
+    return instantiate(0);
+}
+
+std::unique_ptr<AuGraphPlan> AuGraphCompiler::recompile(const AuNodeGraph& graph, const AuGraphEdits& edits) {
+    // Patches only ever add buffers, so compact now and then.
+    if (!m_compiled || graph.getOutputNode() != m_output || m_layout.m_arena_size > 2 * m_compiled_arena + 4096) {
+        return compile(graph);
+    }
+    bool changed = false;
+    if (!patch(graph, edits, changed)) {
+        return compile(graph);
+    }
+    m_patched = true;
+    return changed ? instantiate(m_generation) : nullptr;
+}
+
+std::unique_ptr<AuGraphPlan> AuGraphCompiler::instantiate(uint64_t base) {
+    m_layout.m_generation = ++m_generation;
+    m_layout.m_base = base;
+    if (m_spare) {
+        m_spare->build(m_layout);
+        return std::move(m_spare);
+    }
+    return std::make_unique<AuGraphPlan>(m_layout);
+}
+
+uint32_t AuGraphCompiler::allocate(size_t size) {
+    // Round up to whole cache lines so buffers never share one.
+    const size_t line = 64 / sizeof(float);
+    uint32_t offset = (uint32_t)m_layout.m_arena_size;
+    m_layout.m_arena_size += (size + line - 1) / line * line;
+    return offset;
+}
+
+void AuGraphCompiler::addStep(AuGraphLayout::Step::Kind kind, size_t index) {
+    m_layout.m_steps.insert(m_layout.m_steps.begin() + m_insert++, {kind, (uint32_t)index});
+}
+
+size_t AuGraphCompiler::findStep(AuGraphLayout::Step::Kind kind, size_t index) const {
+    const std::vector<AuGraphLayout::Step>& steps = m_layout.m_steps;
+    auto it = std::find_if(steps.begin(), steps.end(), [&](const auto& step) { return step.kind == kind && step.index == index; });
+    return it - steps.begin();
+}
+
+void AuGraphCompiler::removeStep(AuGraphLayout::Step::Kind kind, size_t index) {
+    const size_t i = findStep(kind, index);
+    if (i == m_layout.m_steps.size()) {
+        return;
+    }
+    m_layout.m_steps.erase(m_layout.m_steps.begin() + i);
+    if (i < m_insert) {
+        m_insert--;
+    }
+}
+
+void AuGraphCompiler::emit(const AuNodePtr& node) {
+    using Step = AuGraphLayout::Step;
+    Node& info = m_scheduled.at(node.get());
+    const int channel = node->captureChannel();
+    if (channel >= 0 && !info.control && node->outPins() > 0) {
+        AuGraphLayout::CaptureStep step{(uint32_t)channel, outBuffer(node.get(), node->outPin(0))};
+        info.capture = (int32_t)m_layout.m_captures.size();
+        addStep(Step::Capture, m_layout.m_captures.size());
+        m_layout.m_captures.push_back(step);
+        m_layout.m_nodes.push_back(node);
+        m_layout.m_audio_nodes++;
+        return;
+    }
+    AuGraphLayout::ProcessStep process{node.get()};
+    process.control = info.control;
+    process.factor = info.factor;
+    process.first_input = (uint32_t)m_layout.m_input_offsets.size();
+    process.first_output = (uint32_t)m_layout.m_output_offsets.size();
+    info.process = (int32_t)m_layout.m_processes.size();
+
+    uint32_t constant_mask = 0;
+    for (size_t i = 0; i < node->inPins(); ++i) {
+        Pin& pin = node->inPin(i);
+        AuRate need = pin.rate();
+        if (info.control && need == AuRate::Audio) {
+            need = AuRate::Control;
+        }
+        if (AuNodePtr upstream = pin.node()) {
+            m_layout.m_input_offsets.push_back(input(info, pin, need));
+            m_sources.emplace_back(upstream.get(), pin.index());
+            m_input_constants.push_back(-1);
+        } else {
+            m_layout.m_input_offsets.push_back(constant(info, pin, need));
+            m_sources.emplace_back(nullptr, 0);
+            m_input_constants.push_back((int32_t)m_layout.m_constants.size() - 1);
+            if (i < 32) {
+                constant_mask |= 1u << i;
+            }
+        }
+    }
+    for (size_t i = 0; i < node->outPins(); ++i) {
+        m_layout.m_output_offsets.push_back(outBuffer(node.get(), node->outPin(i)));
+    }
+    process.kernel = node->specialize(constant_mask);
+    addStep(Step::Process, m_layout.m_processes.size());
+    m_layout.m_processes.push_back(process);
+    m_layout.m_nodes.push_back(node);
+    if (process.kernel) {
+        m_layout.m_specialized_nodes++;
+    }
+    if (process.factor > 1) {
+        m_layout.m_oversampled_nodes++;
+    }
+    (info.control ? m_layout.m_control_nodes : m_layout.m_audio_nodes)++;
+}
+
+uint32_t AuGraphCompiler::constant(const Node& reader, Pin& pin, AuRate need) {
+    AuGraphLayout::ConstantStep step{&pin.param()};
+    step.control = need != AuRate::Audio;
+    step.repeat = step.control ? 1 : reader.factor;
+    step.size = (uint32_t)(bufferSize(step.control) * step.repeat);
+    step.dst = allocate(step.size);
+    step.consumer = (uint32_t)reader.process;
+    step.value = step.compiled = pin.value();
+    step.valid = true;
+    addStep(AuGraphLayout::Step::Constant, m_layout.m_constants.size());
+    m_layout.m_constants.push_back(step);
+    return step.dst;
+}
+
+uint32_t AuGraphCompiler::input(Node& reader, const Pin& pin, AuRate need) {
+    AuNodePtr upstream = pin.node();
+    Pin& source = upstream->outPin(pin.index());
+    Node& up = m_scheduled.at(upstream.get());
+    const bool source_audio = !up.control;
+    if (up.order < reader.order) {
+        // Resampling delays add up along each path to the output.
+        const float delay = source_audio && need == AuRate::Audio ? resampleLatency(up.factor, reader.factor) : 0.0f;
+        reader.latency = std::max(reader.latency, up.latency + delay);
+    } else {
+        // Read before it's written, so it holds the previous block.
+        const size_t size = up.control ? bufferSize(true) : bufferSize(false) * up.factor;
+        m_layout.m_feedback.push_back({outBuffer(upstream.get(), source), (uint32_t)size});
+    }
+    // Cycles keep their members read, so a loop cut off from the output
+    // stays scheduled until the next full compile.
+    up.readers++;
+    up.audio_readers += need == AuRate::Audio;
+    m_new_reads.emplace_back(upstream.get(), outBuffer(upstream.get(), source));
+    if (need == AuRate::Init) {
+        AuGraphLayout::CopyStep step{outBuffer(upstream.get(), source), allocate(bufferSize(true))};
+        addStep(AuGraphLayout::Step::Latch, m_layout.m_latches.size());
+        m_layout.m_latches.push_back(step);
+        return step.dst;
+    }
+    if (need == AuRate::Audio) {
+        return source_audio ? resample(upstream.get(), source, reader.factor) : ramp(upstream.get(), source, reader.factor);
+    }
+    return source_audio ? decimate(upstream.get(), source) : outBuffer(upstream.get(), source);
+}
+
+uint32_t AuGraphCompiler::outBuffer(AuNode* node, Pin& pin) {
+    auto it = m_out_buffers.find(&pin);
+    if (it == m_out_buffers.end()) {
+        const Node& info = m_scheduled.at(node);
+        const size_t size = info.control ? bufferSize(true) : bufferSize(false) * info.factor;
+        it = m_out_buffers.emplace(&pin, allocate(size)).first;
+    }
+    return it->second;
+}
+
+uint32_t AuGraphCompiler::ramp(AuNode* node, Pin& pin, size_t to_factor) {
+    auto it = m_ramped.find({&pin, to_factor});
+    if (it == m_ramped.end()) {
+        AuGraphLayout::RampStep step{nullptr, outBuffer(node, pin), allocate(bufferSize(false) * to_factor)};
+        // Only the engine rate ramp keeps its state across full compiles.
+        step.from = to_factor == 1 ? &pin.rampFrom() : nullptr;
+        step.factor = (uint32_t)to_factor;
+        addStep(AuGraphLayout::Step::Ramp, m_layout.m_ramps.size());
+        m_layout.m_ramps.push_back(step);
+        it = m_ramped.emplace(std::make_pair(&pin, to_factor), step.dst).first;
+    } else {
+        hoist(AuGraphLayout::Step::Ramp, it->second);
+    }
+    return it->second;
+}
+
+uint32_t AuGraphCompiler::decimate(AuNode* node, Pin& pin) {
+    auto it = m_decimated.find(&pin);
+    if (it == m_decimated.end()) {
+        AuGraphLayout::CopyStep step{outBuffer(node, pin), allocate(bufferSize(true))};
+        step.stride = (uint32_t)(m_layout.m_config.control_period * m_scheduled.at(node).factor);
+        addStep(AuGraphLayout::Step::Decimate, m_layout.m_decimates.size());
+        m_layout.m_decimates.push_back(step);
+        it = m_decimated.emplace(&pin, step.dst).first;
+    } else {
+        hoist(AuGraphLayout::Step::Decimate, it->second);
+    }
+    return it->second;
+}
+
+// An audio rate output converted to to_factor times the engine rate, through
+// the engine rate if it isn't there already.
+uint32_t AuGraphCompiler::resample(AuNode* node, Pin& pin, size_t to_factor) {
+    const size_t from_factor = m_scheduled.at(node).factor;
+    if (from_factor == to_factor) {
+        return outBuffer(node, pin);
+    }
+    auto it = m_resampled.find({&pin, to_factor});
+    if (it == m_resampled.end()) {
+        const bool up = to_factor > 1;
+        AuGraphLayout::ResampleStep step;
+        step.src = up ? resample(node, pin, 1) : outBuffer(node, pin);
+        step.dst = allocate(bufferSize(false) * to_factor);
+        step.factor = (uint32_t)(up ? to_factor : from_factor);
+        step.up = up;
+        addStep(AuGraphLayout::Step::Resample, m_layout.m_resamples.size());
+        m_layout.m_resamples.push_back(step);
+        it = m_resampled.emplace(std::make_pair(&pin, to_factor), step.dst).first;
+    } else {
+        if (to_factor > 1) {
+            resample(node, pin, 1);
+        }
+        hoist(AuGraphLayout::Step::Resample, it->second);
+    }
+    return it->second;
+}
+
+void AuGraphCompiler::hoist(AuGraphLayout::Step::Kind kind, uint32_t dst) {
+    using Step = AuGraphLayout::Step;
+    // A full compile emits conversions with their first reader.
+    std::vector<Step>& steps = m_layout.m_steps;
+    for (size_t i = m_insert; i < steps.size(); ++i) {
+        const Step step = steps[i];
+        const bool match = step.kind == kind && ((kind == Step::Ramp && m_layout.m_ramps[step.index].dst == dst) ||
+                                                 (kind == Step::Decimate && m_layout.m_decimates[step.index].dst == dst) ||
+                                                 (kind == Step::Resample && m_layout.m_resamples[step.index].dst == dst));
+        if (match) {
+            steps.erase(steps.begin() + i);
+            steps.insert(steps.begin() + m_insert++, step);
+            return;
+        }
+    }
+}
+
+void AuGraphCompiler::addProbes(AuNode* node) {
+    const Node& info = m_scheduled.at(node);
+    // At the end of the block, after everything that writes the buffer.
+    const size_t insert = m_insert;
+    m_insert = m_layout.m_steps.size();
+    for (size_t i = 0; i < node->outPins(); ++i) {
+        Pin& pin = node->outPin(i);
+        if (AuProbe* probe = pin.probe()) {
+            AuGraphLayout::ProbeStep step{probe, outBuffer(node, pin), info.factor, info.control};
+            addStep(AuGraphLayout::Step::Probe, m_layout.m_probes.size());
+            m_layout.m_probes.push_back(step);
+        }
+    }
+    m_insert = insert;
+}
+
+void AuGraphCompiler::markCaptureCopies() {
+    // Readers that take offsets rather than the pointers the plan redirects.
+    std::unordered_set<uint32_t> read = {m_layout.m_output_offset};
+    for (const AuGraphLayout::Step& step : m_layout.m_steps) {
+        switch (step.kind) {
+            case AuGraphLayout::Step::Ramp:
+                read.insert(m_layout.m_ramps[step.index].src);
+                break;
+            case AuGraphLayout::Step::Decimate:
+                read.insert(m_layout.m_decimates[step.index].src);
+                break;
+            case AuGraphLayout::Step::Latch:
+                read.insert(m_layout.m_latches[step.index].src);
+                break;
+            case AuGraphLayout::Step::Resample:
+                read.insert(m_layout.m_resamples[step.index].src);
+                break;
+            case AuGraphLayout::Step::Probe:
+                read.insert(m_layout.m_probes[step.index].src);
+                break;
+            default:
+                break;
+        }
+    }
+    for (AuGraphLayout::CaptureStep& step : m_layout.m_captures) {
+        step.copy = read.count(step.dst) > 0;
+    }
+}
+
+bool AuGraphCompiler::patch(const AuNodeGraph& graph, const AuGraphEdits& edits, bool& changed) {
+    AuJitCompiler* jit = graph.jit();
+    m_unread.clear();
+    m_new_reads.clear();
+    std::vector<uint32_t> respecialize;
+
+    for (const auto& [node, index] : edits.values) {
+        auto it = m_scheduled.find(node);
+        if (it == m_scheduled.end() || it->second.process < 0 || index >= node->inPins()) {
+            continue;
+        }
+        const int32_t constant = m_input_constants[m_layout.m_processes[it->second.process].first_input + index];
+        const float value = node->inPin(index).value();
+        if (constant < 0 || m_layout.m_constants[constant].compiled == value) {
+            continue;
+        }
+        m_layout.m_constants[constant].compiled = m_layout.m_constants[constant].value = value;
+        respecialize.push_back((uint32_t)it->second.process);
+    }
+
+    bool rewired = false;
+    std::vector<std::pair<uint32_t, uint32_t>> runs;
+    for (AuNode* node : edits.nodes) {
+        auto it = m_scheduled.find(node);
+        if (it == m_scheduled.end()) {
+            continue;
+        }
+        const Node& info = it->second;
+        const size_t f = node->oversampling();
+        const size_t factor = !info.control && (f == 2 || f == 4 || f == 8) ? f : 1;
+        if (info.capture >= 0 || factor != info.factor) {
+            return false;
+        }
+        for (size_t i = 0; i < node->outPins(); ++i) {
+            auto buffer = m_out_buffers.find(&node->outPin(i));
+            const bool probed = buffer != m_out_buffers.end() &&
+                                std::any_of(m_layout.m_probes.begin(), m_layout.m_probes.end(),
+                                            [&](const auto& step) { return step.src == buffer->second; });
+            if (probed != (node->outPin(i).probe() != nullptr)) {
+                return false;
+            }
+        }
+        const uint32_t p = (uint32_t)info.process;
+        bool edited = false;
+        for (size_t i = 0; i < node->inPins(); ++i) {
+            const size_t k = m_layout.m_processes[p].first_input + i;
+            const Pin& pin = node->inPin(i);
+            const bool same = pin.node() ? m_input_constants[k] < 0 && m_sources[k] == std::make_pair(pin.node().get(), pin.index())
+                                         : m_input_constants[k] >= 0;
+            if (same) {
+                continue;
+            }
+            if (!rewire(node, i)) {
+                return false;
+            }
+            edited = true;
+        }
+        if (edited) {
+            respecialize.push_back(p);
+            rewired = true;
+        }
+    }
+
+    if (rewired) {
+        while (!m_unread.empty()) {
+            AuNode* node = m_unread.back();
+            m_unread.pop_back();
+            // A node that lost all its readers and gained new ones runs at
+            // the rate they need, which may be lower than its old one.
+            auto it = m_scheduled.find(node);
+            if (it != m_scheduled.end() && it->second.readers > 0 && !keepsRate(node)) {
+                return false;
+            }
+            if (!drop(node)) {
+                return false;
+            }
+        }
+        dropUnread();
+        markCaptureCopies();
+        // Fused runs only write the outputs that were read when they were
+        // generated, so they are fused again.
+        for (const auto& [upstream, offset] : m_new_reads) {
+            auto it = m_scheduled.find(upstream);
+            const auto* run = it != m_scheduled.end() && it->second.process >= 0 ? runOf((uint32_t)it->second.process) : nullptr;
+            if (!run) {
+                continue;
+            }
+            for (const AuGraphLayout::FusedStep& step : m_layout.m_fused) {
+                if (step.processes && step.first_process == run->first) {
+                    auto outputs = m_layout.m_fused_output_offsets.begin() + step.first_output;
+                    if (std::find(outputs, outputs + step.outputs, offset) == outputs + step.outputs) {
+                        runs.push_back(*run);
+                    }
+                }
+            }
+        }
+        changed = true;
+    }
+
+    std::sort(respecialize.begin(), respecialize.end());
+    respecialize.erase(std::unique(respecialize.begin(), respecialize.end()), respecialize.end());
+    for (uint32_t p : respecialize) {
+        if (!m_layout.m_processes[p].node) {
+            continue;
+        }
+        specialize(p);
+        changed = true;
+        if (const auto* run = jit ? runOf(p) : nullptr) {
+            runs.push_back(*run);
+        }
+    }
+    if (jit && edits.jit_ready) {
+        runs.insert(runs.end(), m_waiting.begin(), m_waiting.end());
+    }
+    if (!runs.empty() && !jit) {
+        return false;
+    }
+    std::sort(runs.begin(), runs.end());
+    runs.erase(std::unique(runs.begin(), runs.end()), runs.end());
+    if (!runs.empty() && refuse(*jit, runs)) {
+        changed = true;
+    }
+    return true;
+}
+
+bool AuGraphCompiler::rewire(AuNode* node, size_t index) {
+    using Step = AuGraphLayout::Step;
+    Node& info = m_scheduled.at(node);
+    const uint32_t p = (uint32_t)info.process;
+    const size_t k = m_layout.m_processes[p].first_input + index;
+    Pin& pin = node->inPin(index);
+    // Whatever feeds the input goes right in front of the node, or of the
+    // kernel it is fused into.
+    const auto* run = runOf(p);
+    m_insert = findStep(Step::Process, p);
+    for (size_t f = 0; run && f < m_layout.m_fused.size(); ++f) {
+        if (m_layout.m_fused[f].processes && m_layout.m_fused[f].first_process == run->first) {
+            m_insert = findStep(Step::Fused, f);
+        }
+    }
+
+    if (m_input_constants[k] >= 0) {
+        removeStep(Step::Constant, m_input_constants[k]);
+    } else {
+        const Node& up = m_scheduled.at(m_sources[k].first);
+        // Dropping a resampled path could lower the node's latency.
+        if (up.latency > 0.0f || up.factor != info.factor || !unread(info, k)) {
+            return false;
+        }
+    }
+    m_sources[k] = {nullptr, 0};
+    m_input_constants[k] = -1;
+
+    AuRate need = pin.rate();
+    if (info.control && need == AuRate::Audio) {
+        need = AuRate::Control;
+    }
+    AuNodePtr upstream = pin.node();
+    if (!upstream) {
+        m_layout.m_input_offsets[k] = constant(info, pin, need);
+        m_input_constants[k] = (int32_t)m_layout.m_constants.size() - 1;
+        return true;
+    }
+    // New nodes would land between the members of a run.
+    if (!m_scheduled.count(upstream.get()) && (run || !plan(upstream, info, need))) {
+        return false;
+    }
+    const Node& up = m_scheduled.at(upstream.get());
+    // A run only passes audio between its members.
+    if (run && up.process >= (int32_t)run->first && up.process < (int32_t)(run->first + run->second) && need != AuRate::Audio) {
+        return false;
+    }
+    // Moving scheduled nodes, raising their rate or adding latency takes a
+    // full compile.
+    if (up.order >= info.order || (need == AuRate::Audio && up.control && upstream->rate() != AuRate::Control) ||
+        up.latency > 0.0f || (!up.control && need == AuRate::Audio && up.factor != info.factor)) {
+        return false;
+    }
+    m_layout.m_input_offsets[k] = input(info, pin, need);
+    m_sources[k] = {upstream.get(), pin.index()};
+    return true;
+}
+
+bool AuGraphCompiler::plan(const AuNodePtr& root, const Node& reader, AuRate need) {
+    using Step = AuGraphLayout::Step;
+    // Same order and rates as compile(), over the new nodes only.
+    std::vector<AuNodePtr> order;
+    std::unordered_map<AuNode*, size_t> position;
+    std::unordered_set<AuNode*> visiting;
+    bool ok = true;
+    auto visit = [&](auto& self, const AuNodePtr& node) -> void {
+        if (auto it = m_scheduled.find(node.get()); it != m_scheduled.end()) {
+            ok = ok && it->second.order < reader.order && it->second.latency == 0.0f;
+            return;
+        }
+        if (!visiting.insert(node.get()).second) {
+            return;
+        }
+        for (size_t i = 0; i < node->inPins(); ++i) {
+            if (AuNodePtr upstream = node->inPin(i).node()) {
+                self(self, upstream);
+            }
+        }
+        position[node.get()] = order.size();
+        order.push_back(node);
+    };
+    visit(visit, root);
+    if (!ok) {
+        return false;
+    }
+
+    std::vector<bool> audio(order.size());
+    for (size_t n = 0; n < order.size(); ++n) {
+        audio[n] = order[n]->rate() != AuRate::Control && order[n]->fixedRate();
+    }
+    if (need == AuRate::Audio && root->rate() != AuRate::Control) {
+        audio[position[root.get()]] = true;
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t n = order.size(); n-- > 0;) {
+            if (!audio[n]) {
+                continue;
+            }
+            const AuNodePtr& node = order[n];
+            for (size_t i = 0; i < node->inPins(); ++i) {
+                Pin& pin = node->inPin(i);
+                AuNodePtr upstream = pin.node();
+                if (!upstream || pin.rate() != AuRate::Audio || upstream->rate() == AuRate::Control) {
+                    continue;
+                }
+                auto u = position.find(upstream.get());
+                if (u == position.end()) {
+                    if (m_scheduled.at(upstream.get()).control) {
+                        return false;
+                    }
+                } else if (!audio[u->second]) {
+                    audio[u->second] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+    for (size_t n = 0; n < order.size(); ++n) {
+        const size_t f = order[n]->oversampling();
+        if (audio[n] && (f == 2 || f == 4 || f == 8) && order[n]->captureChannel() < 0) {
+            return false;
+        }
+    }
+
+    // Order keys between the node scheduled before the insertion point and
+    // the reader.
+    uint64_t previous = 0;
+    for (size_t i = m_insert; i-- > 0 && previous == 0;) {
+        const Step& step = m_layout.m_steps[i];
+        const AuNode* node = nullptr;
+        if (step.kind == Step::Process) {
+            node = m_layout.m_processes[step.index].node;
+        } else if (step.kind == Step::Fused) {
+            const AuGraphLayout::FusedStep& fused = m_layout.m_fused[step.index];
+            node = m_layout.m_processes[fused.first_process + fused.processes - 1].node;
+        }
+        if (node) {
+            previous = m_scheduled.at(node).order;
+        }
+    }
+    if (reader.order - previous <= order.size()) {
+        return false;
+    }
+    const uint64_t gap = (reader.order - previous) / (order.size() + 1);
+    for (size_t n = 0; n < order.size(); ++n) {
+        Node& info = m_scheduled[order[n].get()];
+        info.order = previous + gap * (n + 1);
+        info.control = !audio[n];
+    }
+    for (const AuNodePtr& node : order) {
+        emit(node);
+    }
+    for (const AuNodePtr& node : order) {
+        addProbes(node.get());
+    }
+    return true;
+}
+
+bool AuGraphCompiler::drop(AuNode* node) {
+    using Step = AuGraphLayout::Step;
+    auto it = m_scheduled.find(node);
+    if (it == m_scheduled.end() || it->second.readers > 0 || node == m_output.get()) {
+        return true;
+    }
+    const Node& info = it->second;
+    if (info.capture >= 0) {
+        removeStep(Step::Capture, info.capture);
+        m_layout.m_audio_nodes--;
+    } else {
+        if (runOf((uint32_t)info.process)) {
+            return false;
+        }
+        AuGraphLayout::ProcessStep& process = m_layout.m_processes[info.process];
+        for (size_t i = 0; i < node->inPins(); ++i) {
+            const size_t k = process.first_input + i;
+            if (m_input_constants[k] >= 0) {
+                removeStep(Step::Constant, m_input_constants[k]);
+            } else if (m_sources[k].first && !unread(info, k)) {
+                return false;
+            }
+        }
+        removeStep(Step::Process, info.process);
+        (process.control ? m_layout.m_control_nodes : m_layout.m_audio_nodes)--;
+        m_layout.m_specialized_nodes -= process.kernel != nullptr;
+        m_layout.m_oversampled_nodes -= process.factor > 1;
+        process.node = nullptr;
+    }
+    for (size_t i = 0; i < node->outPins(); ++i) {
+        auto buffer = m_out_buffers.find(&node->outPin(i));
+        if (buffer == m_out_buffers.end()) {
+            continue;
+        }
+        for (size_t s = 0; s < m_layout.m_probes.size(); ++s) {
+            if (m_layout.m_probes[s].src == buffer->second) {
+                removeStep(Step::Probe, s);
+            }
+        }
+        m_out_buffers.erase(buffer);
+    }
+    m_scheduled.erase(it);
+    return true;
+}
+
+bool AuGraphCompiler::unread(const Node& reader, size_t k) {
+    AuNode* upstream = m_sources[k].first;
+    Node& up = m_scheduled.at(upstream);
+    const AuGraphLayout::ProcessStep& process = m_layout.m_processes[reader.process];
+    const bool audio = !reader.control && process.node->inPin(k - process.first_input).rate() == AuRate::Audio;
+    up.audio_readers -= audio;
+    if (--up.readers == 0) {
+        // Dropped after the rewiring, or checked again if that reads it.
+        m_unread.push_back(upstream);
+        return true;
+    }
+    return keepsRate(upstream);
+}
+
+bool AuGraphCompiler::keepsRate(AuNode* node) const {
+    const Node& info = m_scheduled.at(node);
+    return info.control || info.audio_readers > 0 || node == m_output.get() || node->fixedRate();
+}
+
+void AuGraphCompiler::dropUnread() {
+    using Step = AuGraphLayout::Step;
+    std::unordered_set<uint32_t> read = {m_layout.m_output_offset};
+    for (const AuGraphLayout::ProcessStep& process : m_layout.m_processes) {
+        if (process.node) {
+            auto inputs = m_layout.m_input_offsets.begin() + process.first_input;
+            read.insert(inputs, inputs + process.node->inPins());
+        }
+    }
+    for (const Step& step : m_layout.m_steps) {
+        if (step.kind == Step::Probe) {
+            read.insert(m_layout.m_probes[step.index].src);
+        }
+    }
+    // Conversions come before their readers, so one backwards pass finds
+    // chains of them.
+    std::unordered_set<uint32_t> dropped;
+    std::vector<Step>& steps = m_layout.m_steps;
+    for (size_t i = steps.size(); i-- > 0;) {
+        const Step& step = steps[i];
+        uint32_t src = 0;
+        uint32_t dst = 0;
+        switch (step.kind) {
+            case Step::Ramp:
+                src = m_layout.m_ramps[step.index].src;
+                dst = m_layout.m_ramps[step.index].dst;
+                break;
+            case Step::Decimate:
+                src = m_layout.m_decimates[step.index].src;
+                dst = m_layout.m_decimates[step.index].dst;
+                break;
+            case Step::Latch:
+                src = m_layout.m_latches[step.index].src;
+                dst = m_layout.m_latches[step.index].dst;
+                break;
+            case Step::Resample:
+                src = m_layout.m_resamples[step.index].src;
+                dst = m_layout.m_resamples[step.index].dst;
+                break;
+            default:
+                continue;
+        }
+        if (read.count(dst)) {
+            read.insert(src);
+            continue;
+        }
+        if (step.kind == Step::Resample) {
+            m_layout.m_resamples[step.index].factor = 0;
+        }
+        dropped.insert(dst);
+        steps.erase(steps.begin() + i);
+    }
+    auto unread = [&](const auto& entry) { return dropped.count(entry.second) > 0; };
+    std::erase_if(m_ramped, unread);
+    std::erase_if(m_decimated, unread);
+    std::erase_if(m_resampled, unread);
+}
+
+void AuGraphCompiler::specialize(uint32_t p) {
+    AuGraphLayout::ProcessStep& process = m_layout.m_processes[p];
+    uint32_t constant_mask = 0;
+    for (size_t i = 0; i < process.node->inPins() && i < 32; ++i) {
+        if (m_input_constants[process.first_input + i] >= 0) {
+            constant_mask |= 1u << i;
+        }
+    }
+    m_layout.m_specialized_nodes -= process.kernel != nullptr;
+    process.kernel = process.node->specialize(constant_mask);
+    m_layout.m_specialized_nodes += process.kernel != nullptr;
+}
+
+// Adds process p to run, or returns false if it can't join it.
+bool AuGraphCompiler::extend(Run& run, size_t p, std::vector<bool>& internal) {
+    const AuGraphLayout::ProcessStep& process = m_layout.m_processes[p];
+    AuNode& node = *process.node;
+    const size_t code_size = run.gen.m_code.size();
+    const size_t states = run.gen.m_states.size();
+    const size_t inputs = run.inputs.size();
+    const size_t outputs = run.outputs.size();
+    const size_t internals = run.internal.size();
+    auto rollback = [&] {
+        run.gen.m_code.resize(code_size);
+        run.gen.m_states.resize(states);
+        run.inputs.resize(inputs);
+        run.outputs.resize(outputs);
+        for (size_t k = internals; k < run.internal.size(); ++k) {
+            internal[run.internal[k]] = false;
+        }
+        run.internal.resize(internals);
+        return false;
+    };
+
+    run.gen.m_sample_rate = m_layout.m_config.sample_rate;
+    run.gen.m_inputs.clear();
+    for (size_t i = 0; i < node.inPins(); ++i) {
+        const size_t k = process.first_input + i;
+        const uint32_t offset = m_layout.m_input_offsets[k];
+        const bool audio = node.inPin(i).rate() == AuRate::Audio;
+        const int32_t constant = m_input_constants[k];
+        if (constant >= 0 && isfinite(m_layout.m_constants[constant].compiled)) {
+            run.gen.m_inputs.push_back(AuCodegen::literal(m_layout.m_constants[constant].compiled));
+            continue;
+        }
+        auto local = std::find_if(run.outputs.begin(), run.outputs.end(), [&](const auto& o) { return o.first == offset; });
+        if (local != run.outputs.end()) {
+            // Per tick inputs are decimated by a step the run would skip.
+            if (!audio) {
+                return rollback();
+            }
+            run.gen.m_inputs.push_back(local->second);
+            run.internal.push_back(k);
+            internal[k] = true;
+            continue;
+        }
+        auto buffer = std::find(run.inputs.begin(), run.inputs.end(), offset);
+        const size_t j = buffer - run.inputs.begin();
+        if (buffer == run.inputs.end()) {
+            run.inputs.push_back(offset);
+        }
+        run.gen.m_inputs.push_back(audio ? std::format("in{}[i]", j) : std::format("in{}[i / {}]", j, m_layout.m_config.control_period));
+    }
+    run.gen.m_outputs.clear();
+    for (size_t o = 0; o < node.outPins(); ++o) {
+        std::string name = std::format("v{}", outputs + o);
+        run.gen.m_code += std::format("        float {};\n", name);
+        run.gen.m_outputs.push_back(name);
+    }
+    run.gen.m_code += "        {\n";
+    if (!node.emit(run.gen)) {
+        return rollback();
+    }
+    run.gen.m_code += "        }\n";
+    for (size_t o = 0; o < node.outPins(); ++o) {
+        run.outputs.emplace_back(m_layout.m_output_offsets[process.first_output + o], run.gen.m_outputs[o]);
+    }
+    if (run.count++ == 0) {
+        run.first = (uint32_t)p;
+    }
+    return true;
+}
+
+void AuGraphCompiler::fuse(AuJitCompiler& jit) {
+    std::vector<Run> runs;
+    std::vector<bool> internal(m_layout.m_input_offsets.size(), false);
+    Run run;
+    auto close = [&] {
+        if (run.count >= 2) {
+            runs.push_back(std::move(run));
+        } else {
+            for (size_t k : run.internal) {
+                internal[k] = false;
+            }
+        }
+        run = Run();
+    };
+    for (size_t p = 0; p < m_layout.m_processes.size(); ++p) {
+        const AuGraphLayout::ProcessStep& process = m_layout.m_processes[p];
+        if (process.control || process.factor != 1) {
+            close();
+            continue;
+        }
+        if (run.count == kMaxFusedNodes || !extend(run, p, internal)) {
+            close();
+            if (!extend(run, p, internal)) {
+                close();
+            }
+        }
+    }
+    close();
+
+    const std::unordered_set<uint32_t> read = reads(internal);
+    std::vector<int32_t> fused_by_process(m_layout.m_processes.size(), -1);
+    for (const Run& run : runs) {
+        const int32_t fused = install(jit, run, read);
+        if (fused < 0) {
+            m_waiting.emplace_back(run.first, run.count);
+            continue;
+        }
+        std::fill_n(fused_by_process.begin() + run.first, run.count, fused);
+        m_runs.emplace_back(run.first, run.count);
+    }
+    place(fused_by_process);
+}
+
+std::unordered_set<uint32_t> AuGraphCompiler::reads(const std::vector<bool>& internal) const {
+    std::unordered_set<uint32_t> read = {m_layout.m_output_offset};
+    for (size_t k = 0; k < m_layout.m_input_offsets.size(); ++k) {
+        if (!internal[k]) {
+            read.insert(m_layout.m_input_offsets[k]);
+        }
+    }
+    for (const AuGraphLayout::RampStep& step : m_layout.m_ramps) {
+        read.insert(step.src);
+    }
+    for (const AuGraphLayout::CopyStep& step : m_layout.m_decimates) {
+        read.insert(step.src);
+    }
+    for (const AuGraphLayout::CopyStep& step : m_layout.m_latches) {
+        read.insert(step.src);
+    }
+    for (const AuGraphLayout::ResampleStep& step : m_layout.m_resamples) {
+        read.insert(step.src);
+    }
+    for (const AuGraphLayout::ProbeStep& step : m_layout.m_probes) {
+        read.insert(step.src);
+    }
+    return read;
+}
+
+int32_t AuGraphCompiler::install(AuJitCompiler& jit, const Run& run, const std::unordered_set<uint32_t>& read) {
+    std::vector<uint32_t> outputs;
+    std::vector<std::string> values;
+    bool feedback = false;
+    for (const auto& [output, local] : run.outputs) {
+        if (read.count(output)) {
+            outputs.push_back(output);
+            values.push_back(local);
+            feedback = feedback || std::find(run.inputs.begin(), run.inputs.end(), output) != run.inputs.end();
+        }
+    }
+    std::shared_ptr<void> library;
+    AuFusedKernel kernel = jit.kernel(run.gen.source(run.inputs.size(), values, !feedback), library);
+    if (!kernel) {
+        return -1;
+    }
+    AuGraphLayout::FusedStep step{kernel, run.first, run.count};
+    step.first_input = (uint32_t)m_layout.m_fused_input_offsets.size();
+    step.inputs = (uint32_t)run.inputs.size();
+    step.first_output = (uint32_t)m_layout.m_fused_output_offsets.size();
+    step.outputs = (uint32_t)outputs.size();
+    step.first_state = (uint32_t)m_layout.m_fused_states.size();
+    m_layout.m_fused_input_offsets.insert(m_layout.m_fused_input_offsets.end(), run.inputs.begin(), run.inputs.end());
+    m_layout.m_fused_output_offsets.insert(m_layout.m_fused_output_offsets.end(), outputs.begin(), outputs.end());
+    m_layout.m_fused_states.insert(m_layout.m_fused_states.end(), run.gen.m_states.begin(), run.gen.m_states.end());
+    m_layout.m_fused.push_back(step);
+    m_layout.m_libraries.push_back(library);
+    m_layout.m_fused_nodes += run.count;
+    m_layout.m_fused_kernels++;
+    return (int32_t)m_layout.m_fused.size() - 1;
+}
+
+void AuGraphCompiler::place(const std::vector<int32_t>& fused_by_process) {
+    using Step = AuGraphLayout::Step;
+    // The steps between members only feed later members from outside the
+    // run, so the fused step can take the place of the last member.
+    std::vector<Step> steps;
+    for (const Step& step : m_layout.m_steps) {
+        const int32_t fused = step.kind == Step::Process ? fused_by_process[step.index] : -1;
+        if (fused < 0) {
+            steps.push_back(step);
+        } else if (step.index + 1 == m_layout.m_fused[fused].first_process + m_layout.m_fused[fused].processes) {
+            steps.push_back({Step::Fused, (uint32_t)fused});
+        }
+    }
+    m_layout.m_steps = std::move(steps);
+}
+
+bool AuGraphCompiler::refuse(AuJitCompiler& jit, const std::vector<std::pair<uint32_t, uint32_t>>& runs) {
+    using Step = AuGraphLayout::Step;
+    std::vector<Run> generated(runs.size());
+    std::vector<bool> internal(m_layout.m_input_offsets.size(), false);
+    for (size_t r = 0; r < runs.size(); ++r) {
+        for (uint32_t p = runs[r].first; p < runs[r].first + runs[r].second; ++p) {
+            if (!extend(generated[r], p, internal)) {
+                break;
+            }
+        }
+    }
+    const std::unordered_set<uint32_t> read = reads(internal);
+
+    bool changed = false;
+    std::vector<int32_t> fused_by_process;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const auto [first, count] = runs[r];
+        // Installing may reallocate m_fused, so keep an index.
+        const size_t f = std::find_if(m_layout.m_fused.begin(), m_layout.m_fused.end(),
+                                      [&](const auto& step) { return step.processes && step.first_process == first; }) -
+                         m_layout.m_fused.begin();
+        const bool fused = f < m_layout.m_fused.size();
+        const int32_t installed = generated[r].count == count ? install(jit, generated[r], read) : -1;
+        if (fused) {
+            m_layout.m_fused_nodes -= count;
+            m_layout.m_fused_kernels--;
+            if (installed >= 0) {
+                // The new kernel takes the place of the old one.
+                m_layout.m_fused[f] = m_layout.m_fused.back();
+                m_layout.m_fused.pop_back();
+                m_layout.m_libraries[f] = m_layout.m_libraries.back();
+                m_layout.m_libraries.pop_back();
+            } else {
+                // The interpreter runs the members where the fused step was
+                // until the kernel is compiled.
+                m_layout.m_fused[f].processes = 0;
+                auto step = m_layout.m_steps.begin() + findStep(Step::Fused, f);
+                step = m_layout.m_steps.erase(step);
+                for (uint32_t p = first; p < first + count; ++p) {
+                    step = m_layout.m_steps.insert(step, {Step::Process, p}) + 1;
+                }
+                std::erase(m_runs, runs[r]);
+                m_waiting.push_back(runs[r]);
+            }
+            changed = true;
+        } else if (installed >= 0) {
+            fused_by_process.resize(m_layout.m_processes.size(), -1);
+            std::fill_n(fused_by_process.begin() + first, count, installed);
+            std::erase(m_waiting, runs[r]);
+            m_runs.push_back(runs[r]);
+            changed = true;
+        }
+    }
+    if (!fused_by_process.empty()) {
+        place(fused_by_process);
+    }
+    return changed;
+}
+
+const std::pair<uint32_t, uint32_t>* AuGraphCompiler::runOf(uint32_t p) const {
+    for (const auto* runs : {&m_runs, &m_waiting}) {
+        for (const auto& run : *runs) {
+            if (p >= run.first && p < run.first + run.second) {
+                return &run;
+            }
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "audio_graph.h"
+#include "graph_jit.h"
+#include "oversampler.h"
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Compiles an AuNodeGraph into a plan of steps the audio thread walks every
+// block.
+//
+// Only nodes the output node depends on are scheduled, in dependency order.
+// Each node gets a rate: audio if any consumer needs audio rate values from
+// it, otherwise control. Edges between rates are bridged by ramp (control to
+// audio), decimate (audio to control) and latch (init rate inputs) steps.
+// Feedback loops read the upstream block from the previous process() call.
+//
+// Unconnected inputs are filled once at compile time and only refilled when
+// their value is edited. Edits ramp over a few blocks, see AuParam. Nodes get
+// to pick a kernel specialized for their constant inputs, which is used while
+// every one of those inputs still holds the value it was compiled for, see
+// AuNode::specialize().
+//
+// Audio rate nodes with AuNode::oversampling() > 1 run at that multiple of the
+// engine rate with the same kernels: frames, tick_frames and sample_rate are
+// all scaled. Edges between different factors go through halfband resampling
+// steps, so connected nodes with the same factor form an oversampled subgraph
+// that only converts where it meets the rest of the patch. Each conversion
+// delays the signal, see latency().
+//
+// With AuNodeGraph::setJit(), runs of consecutive audio rate nodes at the
+// engine rate that support AuNode::emit() are fused into one native kernel.
+// Values passed inside a run stay in locals, and buffers are only written for
+// outputs read outside the run. Unconnected inputs are baked in as literals,
+// so like a specialized kernel the run falls back to the interpreter while any
+// of them is being edited.
+//
+// Capture nodes (AuNode::captureChannel()) aren't processed. Their readers are
+// pointed at the engine's captured block each process() call, so a graph
+// reading the device input pays nothing for it. Only readers that take arena
+// offsets (decimation, resampling, the output itself) make the plan copy the
+// block into the node's buffer.
+//
+// Probed outputs (AuNodeGraph::setProbe()) get a step at the end of the block
+// that copies their buffer into the probe. Unprobed outputs have no step and
+// cost nothing. Fused runs write probed outputs to their buffers as if they
+// were read outside the run.
+//
+// All buffers the plan touches live in one cache line aligned arena, laid out
+// in schedule order.
+//
+// Edits don't recompile the whole graph, see AuGraphCompiler::recompile().
+// A plan patched from the one it replaces takes over its resampler history,
+// ramps and the buffers feedback edges read, see AuGraphPlan::adopt(). After
+// a full compile a feedback edge reads one block of silence.
+
+// Steps of a plan, with buffers as offsets into its arena. AuGraphCompiler
+// keeps the layout of the last plan to patch it, and every plan gets its own
+// copy plus an arena to run it.
+struct AuGraphLayout {
+    // The step list is what process() walks every block, so it only holds the
+    // kind and an index into the array for that kind.
+    struct Step {
+        enum Kind : uint8_t { Constant, Ramp, Decimate, Latch, Resample, Process, Fused, Capture, Probe };
+        Kind kind;
+        uint32_t index;
+    };
+
+    struct ProcessStep {
+        AuNode* node;           // nullptr once dropped by a patch
+        AuKernel kernel;        // Specialized kernel, or nullptr
+        uint32_t invalid;       // Constants that differ from the compiled value
+        uint32_t first_input;   // Offset into m_inputs
+        uint32_t first_output;  // Offset into m_outputs
+        uint32_t factor;        // Oversampling
+        bool control;           // Node runs at control rate
+    };
+
+    struct ConstantStep {
+        AuParam* param;
+        uint32_t dst;
+        uint32_t size;      // Floats in dst
+        uint32_t repeat;    // Samples per value, the consumer's oversampling
+        uint32_t consumer;  // Index of the ProcessStep reading it
+        float value;        // Value dst holds, NaN if not uniform
+        float compiled;     // Value the consumer was specialized for
+        bool valid;         // value == compiled
+        bool control;       // Read per tick
+    };
+
+    struct RampStep {
+        float* from;  // Last value the upstream output was ramped to, kept in its Pin or last
+        uint32_t src;
+        uint32_t dst;
+        uint32_t factor;  // Consumer oversampling
+        float last;
+    };
+
+    struct CopyStep {
+        uint32_t src;
+        uint32_t dst;
+        uint32_t stride;  // Decimate: source frames per tick
+        bool latched;     // Latch: value already taken
+    };
+
+    struct ResampleStep {
+        uint32_t src;
+        uint32_t dst;
+        uint32_t factor;  // 0 once dropped by a patch
+        bool up;
+    };
+
+    struct FusedStep {
+        AuFusedKernel kernel;
+        uint32_t first_process;  // Members in m_processes, for the fallback
+        uint32_t processes;
+        uint32_t first_input;  // Offset into m_fused_inputs
+        uint32_t inputs;
+        uint32_t first_output;  // Offset into m_fused_outputs
+        uint32_t outputs;
+        uint32_t first_state;  // Offset into m_fused_states
+    };
+
+    struct CaptureStep {
+        uint32_t channel;
+        uint32_t dst;         // The node's output buffer
+        uint32_t first_slot;  // Offset into m_capture_slots
+        uint32_t slots;
+        bool copy;  // Something reads dst by offset
+    };
+
+    struct ProbeStep {
+        AuProbe* probe;
+        uint32_t src;
+        uint32_t factor;  // Values per frame of an audio rate output
+        bool control;     // One value per tick
+    };
+
+    struct Span {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    AuGraphConfig m_config;
+    size_t m_max_ticks = 0;
+
+    // Hot, walked every block.
+    std::vector<Step> m_steps;
+    std::vector<ProcessStep> m_processes;
+    std::vector<ConstantStep> m_constants;
+    std::vector<RampStep> m_ramps;
+    std::vector<CopyStep> m_decimates;
+    std::vector<CopyStep> m_latches;
+    std::vector<ResampleStep> m_resamples;
+    std::vector<FusedStep> m_fused;
+    std::vector<CaptureStep> m_captures;
+    std::vector<ProbeStep> m_probes;
+    std::vector<float*> m_fused_states;
+
+    // Cold. Offsets the plan resolves to pointers.
+    std::vector<uint32_t> m_input_offsets;
+    std::vector<uint32_t> m_output_offsets;
+    std::vector<uint32_t> m_fused_input_offsets;
+    std::vector<uint32_t> m_fused_output_offsets;
+    uint32_t m_output_offset = 0;
+    size_t m_arena_size = 0;
+    std::vector<Span> m_feedback;  // Buffers read before they are written
+
+    std::vector<AuNodePtr> m_nodes;  // Keeps scheduled nodes alive
+    std::vector<std::shared_ptr<void>> m_libraries;  // Keeps fused kernels loaded
+    uint64_t m_generation = 0;  // Counts plans made by one compiler
+    uint64_t m_base = 0;  // Generation of the plan this one was patched from, or 0
+    size_t m_audio_nodes = 0;
+    size_t m_control_nodes = 0;
+    size_t m_specialized_nodes = 0;
+    size_t m_oversampled_nodes = 0;
+    size_t m_fused_nodes = 0;
+    size_t m_fused_kernels = 0;
+    float m_latency = 0.0f;
+};
+
+// Execution plan for one graph topology. Made by AuGraphCompiler on the UI
+// thread, then owned by the audio thread until AuNodeGraph retires it.
+class AuGraphPlan : private AuGraphLayout {
+   public:
+    // Allocates the arena and fills it with the constants.
+    explicit AuGraphPlan(const AuGraphLayout& layout);
+    // The same for a plan the audio thread is done with, reusing its memory.
+    void build(const AuGraphLayout& layout);
+
+    // Renders frames (<= max_frames) and returns the output node's first
+    // output at audio rate.
+    const float* process(size_t frames, const AuCaptureBlock& capture);
+    // Audio thread, when the plan replaces previous. If it was patched from
+    // previous, takes over the state of the steps they share. Doesn't
+    // allocate: resamplers are swapped, so previous frees the new plan's.
+    void adopt(AuGraphPlan& previous);
+
+    size_t audioNodes() const {
+        return m_audio_nodes;
+    }
+
+    size_t controlNodes() const {
+        return m_control_nodes;
+    }
+
+    size_t specializedNodes() const {
+        return m_specialized_nodes;
+    }
+
+    size_t oversampledNodes() const {
+        return m_oversampled_nodes;
+    }
+
+    size_t fusedNodes() const {
+        return m_fused_nodes;
+    }
+
+    size_t fusedKernels() const {
+        return m_fused_kernels;
+    }
+
+    // Frames the output is delayed by resampling, along the slowest path.
+    float latency() const {
+        return m_latency;
+    }
+
+   private:
+    void run(const ProcessStep& process, size_t frames, size_t ticks);
+    float* buffer(uint32_t offset) {
+        return m_arena + offset;
+    }
+
+    std::vector<const float*> m_inputs;
+    std::vector<float*> m_outputs;
+    std::vector<const float*> m_fused_inputs;
+    std::vector<float*> m_fused_outputs;
+    std::vector<const float**> m_capture_slots;  // Entries of m_inputs and m_fused_inputs
+    std::vector<std::unique_ptr<AuResampler>> m_resamplers;  // Per ResampleStep
+    float* m_arena = nullptr;
+    const float* m_output = nullptr;
+    std::vector<float> m_arena_storage;
+};
+
+// Builds plans for one AuNodeGraph, UI thread. Keeps the layout of the last
+// plan so edits can be patched into it instead of recompiling everything.
+class AuGraphCompiler {
+   public:
+    // Compiles the graph from scratch.
+    std::unique_ptr<AuGraphPlan> compile(const AuNodeGraph& graph);
+    // Applies edits made since the last plan. Edits to nodes the output
+    // doesn't reach are ignored. An edited constant re-specializes its node
+    // and re-fuses its run. A rewired input swaps the steps feeding it, nodes
+    // it now reaches are planned in front of it and nodes nothing reaches
+    // anymore are dropped with their steps. Everything else keeps its steps
+    // and buffer offsets. Runs that read a rewired input are fused again.
+    // Compiles from scratch when the edits would move scheduled nodes, change
+    // their rate, oversampling, latency or probes, plan new nodes into a run
+    // or drop nodes from one, so a patched plan computes the same as a
+    // compiled one.
+    //
+    // Returns nullptr if the plan doesn't change.
+    std::unique_ptr<AuGraphPlan> recompile(const AuNodeGraph& graph, const AuGraphEdits& edits);
+
+    // True if the last recompile() patched the plan.
+    bool patched() const {
+        return m_patched;
+    }
+
+    // Keeps a plan the audio thread is done with to build the next one in,
+    // so edits don't pay for a fresh arena.
+    void recycle(std::unique_ptr<AuGraphPlan> plan) {
+        m_spare = std::move(plan);
+    }
+
+   private:
+    // A node in the schedule.
+    struct Node {
+        uint64_t order = 0;  // Sorts like the schedule
+        int32_t process = -1;  // Index into m_processes
+        int32_t capture = -1;  // Index into m_captures, for capture nodes
+        uint32_t readers = 0;  // Connected inputs of scheduled nodes
+        uint32_t audio_readers = 0;  // The ones that need audio rate
+        uint32_t factor = 1;
+        float latency = 0.0f;
+        bool control = false;
+    };
+
+    // A run of processes fused into one kernel, see fuse().
+    struct Run {
+        uint32_t first = 0;
+        uint32_t count = 0;
+        AuCodegen gen;
+        std::vector<uint32_t> inputs;  // Buffers read from outside the run
+        std::vector<std::pair<uint32_t, std::string>> outputs;  // Member output buffers and their locals
+        std::vector<size_t> internal;  // m_input_offsets read from a local
+    };
+
+    std::unique_ptr<AuGraphPlan> instantiate(uint64_t base);
+    // Reserves an arena buffer of size floats and returns its offset.
+    uint32_t allocate(size_t size);
+    size_t bufferSize(bool control) const {
+        return control ? m_layout.m_max_ticks : m_layout.m_config.max_frames;
+    }
+    void addStep(AuGraphLayout::Step::Kind kind, size_t index);
+    void removeStep(AuGraphLayout::Step::Kind kind, size_t index);
+    size_t findStep(AuGraphLayout::Step::Kind kind, size_t index) const;
+
+    // Adds the steps of a node in m_scheduled at m_insert.
+    void emit(const AuNodePtr& node);
+    // The buffer an input reads, with the conversion steps it needs.
+    uint32_t input(Node& reader, const Pin& pin, AuRate need);
+    uint32_t outBuffer(AuNode* node, Pin& pin);
+    uint32_t ramp(AuNode* node, Pin& pin, size_t to_factor);
+    uint32_t decimate(AuNode* node, Pin& pin);
+    uint32_t resample(AuNode* node, Pin& pin, size_t to_factor);
+    // Moves a conversion step that writes dst in front of m_insert, for a
+    // reader patched in before it.
+    void hoist(AuGraphLayout::Step::Kind kind, uint32_t dst);
+    void addProbes(AuNode* node);
+    void markCaptureCopies();
+
+    // Patches m_layout in place. False if the edits need a full compile.
+    bool patch(const AuNodeGraph& graph, const AuGraphEdits& edits, bool& changed);
+    bool rewire(AuNode* node, size_t pin);
+    // Schedules the nodes root reaches that aren't scheduled yet in front of
+    // reader, which reads root through an input that needs rate need.
+    bool plan(const AuNodePtr& root, const Node& reader, AuRate need);
+    bool drop(AuNode* node);
+    // Removes a reader from the upstream of input k. False if the upstream
+    // would drop to control rate. One left without readers goes to m_unread.
+    bool unread(const Node& reader, size_t k);
+    // False if a full compile would run the scheduled node at control rate
+    // while it runs at audio rate.
+    bool keepsRate(AuNode* node) const;
+    // Drops conversion steps nothing reads anymore.
+    void dropUnread();
+    void specialize(uint32_t process);
+    uint32_t constant(const Node& reader, Pin& pin, AuRate need);
+
+    // Replaces runs of process steps with fused steps whose kernels are
+    // compiled, and remembers the others in m_waiting.
+    void fuse(AuJitCompiler& jit);
+    bool extend(Run& run, size_t p, std::vector<bool>& internal);
+    // Buffers read by anything but a local inside a run.
+    std::unordered_set<uint32_t> reads(const std::vector<bool>& internal) const;
+    // Adds the fused step of run and returns its index, or -1 if the kernel
+    // is still compiling.
+    int32_t install(AuJitCompiler& jit, const Run& run, const std::unordered_set<uint32_t>& read);
+    // Puts fused steps in place of their members' process steps.
+    void place(const std::vector<int32_t>& fused_by_process);
+    // Re-generates runs after their constants changed or kernels got
+    // compiled. Runs whose kernel isn't ready fall back to their members'
+    // steps until it is. Returns true if a step changed.
+    bool refuse(AuJitCompiler& jit, const std::vector<std::pair<uint32_t, uint32_t>>& runs);
+    // The run process p belongs to, fused or waiting, or nullptr.
+    const std::pair<uint32_t, uint32_t>* runOf(uint32_t p) const;
+
+    AuGraphLayout m_layout;
+    AuNodePtr m_output;
+    bool m_compiled = false;  // m_layout holds the last plan
+    bool m_patched = false;
+    uint64_t m_generation = 0;
+    size_t m_insert = 0;  // Where addStep() puts steps
+    size_t m_compiled_arena = 0;  // Arena size after the last full compile
+    std::unique_ptr<AuGraphPlan> m_spare;
+
+    std::unordered_map<const AuNode*, Node> m_scheduled;
+    std::unordered_map<const Pin*, uint32_t> m_out_buffers;
+    std::map<std::pair<const Pin*, size_t>, uint32_t> m_ramped;
+    std::unordered_map<const Pin*, uint32_t> m_decimated;
+    std::map<std::pair<const Pin*, size_t>, uint32_t> m_resampled;
+    // Per process input: the upstream node and output it was compiled with,
+    // and the ConstantStep feeding it or -1.
+    std::vector<std::pair<AuNode*, size_t>> m_sources;
+    std::vector<int32_t> m_input_constants;
+    // Runs as (first process, count): fused, and waiting for their kernel.
+    std::vector<std::pair<uint32_t, uint32_t>> m_runs;
+    std::vector<std::pair<uint32_t, uint32_t>> m_waiting;
+    // Patch state: nodes that lost a reader, and upstream outputs read by
+    // inputs rewired in this patch.
+    std::vector<AuNode*> m_unread;
+    std::vector<std::pair<AuNode*, uint32_t>> m_new_reads;
+};
@@ -0,0 +1,154 @@
+#include "graph_io.h"
+
+#include "node_registry.h"
+
+#include <format>
+#include <fstream>
+#include <print>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+const char* kHeader = "imsynth-graph 1";
+}  // namespace
+
+int saveGraph(const AuNodeGraph& graph, const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::print("Error: can't write {}\n", path);
+        return -1;
+    }
+    const auto& nodes = graph.nodes();
+    std::unordered_map<const AuNode*, int> index;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        index[nodes[i].get()] = (int)i;
+    }
+    auto indexOf = [&](const AuNodePtr& node) {
+        auto it = index.find(node.get());
+        return it != index.end() ? it->second : -1;
+    };
+    file << kHeader << "\n";
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        file << "node " << i << " " << nodes[i]->name() << " " << nodes[i]->id() << "\n";
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i]->oversampling() != 1) {
+            file << "oversample " << i << " " << nodes[i]->oversampling() << "\n";
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (!nodes[i]->settings().empty()) {
+            file << "settings " << i << " " << nodes[i]->settings() << "\n";
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto& node = nodes[i];
+        for (size_t pin = 0; pin < node->inPins(); ++pin) {
+            // Shortest form that reads back as the same float.
+            file << "value " << i << " " << pin << " " << std::format("{}", node->inPin(pin).value()) << "\n";
+        }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const auto& node = nodes[i];
+        for (size_t pin = 0; pin < node->inPins(); ++pin) {
+            int upstream = indexOf(node->inPin(pin).node());
+            if (upstream >= 0) {
+                file << "link " << i << " " << pin << " " << upstream << " " << node->inPin(pin).index() << "\n";
+            }
+        }
+    }
+    int output = indexOf(graph.getOutputNode());
+    if (output >= 0) {
+        file << "output " << output << "\n";
+    }
+    return file ? 0 : -1;
+}
+
+AuNodeGraphPtr loadGraph(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::print("Error: can't read {}\n", path);
+        return nullptr;
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != kHeader) {
+        std::print("Error: {} is not a graph file\n", path);
+        return nullptr;
+    }
+
+    auto graph = std::make_shared<AuNodeGraph>();
+    std::vector<AuNodePtr> nodes;
+    auto node_at = [&](size_t index) { return index < nodes.size() ? nodes[index] : nullptr; };
+    int line_number = 1;
+    while (std::getline(file, line)) {
+        line_number++;
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword)) {
+            continue;
+        }
+        bool ok = false;
+        if (keyword == "node") {
+            size_t index;
+            std::string type_id;
+            uint32_t id = 0;  // Files from before ids were saved have none
+            if (in >> index >> type_id && index == nodes.size()) {
+                in >> id;
+                AuNodePtr node = AuNodeRegistry::instance().create(type_id);
+                if (!node) {
+                    std::print("Error: {}:{}: unknown node type {}\n", path, line_number, type_id);
+                    return nullptr;
+                }
+                nodes.push_back(node);
+                graph->addNode(node, id);
+                ok = true;
+            }
+        } else if (keyword == "value") {
+            size_t index, pin;
+            float value;
+            if (in >> index >> pin >> value) {
+                AuNodePtr node = node_at(index);
+                if (node && pin < node->inPins()) {
+                    node->inPin(pin).set(value);
+                    ok = true;
+                }
+            }
+        } else if (keyword == "oversample") {
+            size_t index, factor;
+            if (in >> index >> factor && node_at(index)) {
+                graph->setOversampling(node_at(index), factor);
+                ok = true;
+            }
+        } else if (keyword == "settings") {
+            // The rest of the line. A file that can't be opened doesn't fail
+            // the load, the node keeps the setting.
+            size_t index;
+            std::string settings;
+            if (in >> index && node_at(index) && std::getline(in >> std::ws, settings)) {
+                node_at(index)->setSettings(settings);
+                ok = true;
+            }
+        } else if (keyword == "link") {
+            size_t index, pin, upstream_index, upstream_pin;
+            if (in >> index >> pin >> upstream_index >> upstream_pin) {
+                AuNodePtr node = node_at(index);
+                AuNodePtr upstream = node_at(upstream_index);
+                if (node && upstream && pin < node->inPins() && upstream_pin < upstream->outPins()) {
+                    node->inPin(pin).connect(upstream, upstream_pin);
+                    ok = true;
+                }
+            }
+        } else if (keyword == "output") {
+            size_t index;
+            if (in >> index && node_at(index)) {
+                graph->setOutputNode(node_at(index));
+                ok = true;
+            }
+        }
+        if (!ok) {
+            std::print("Error: {}:{}: can't parse '{}'\n", path, line_number, line);
+            return nullptr;
+        }
+    }
+    return graph;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "audio_graph.h"
+
+#include <string>
+
+// Plain text graph files. Nodes are stored by registry type id, followed by
+// their constant pin values, links and the output node.
+int saveGraph(const AuNodeGraph& graph, const std::string& path);
+
+// Returns nullptr and prints the reason if the file can't be loaded.
+AuNodeGraphPtr loadGraph(const std::string& path);
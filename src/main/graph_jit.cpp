@@ -0,0 +1,221 @@
+#include "graph_jit.h"
+
+#include "shared_library.h"
+
+#include <stdlib.h>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <print>
+
+namespace {
+const char* kSymbol = "imsynth_kernel";
+
+std::string compileCommand(const std::filesystem::path& source, const std::filesystem::path& library,
+                           const std::filesystem::path& log) {
+    const char* cxx = getenv("IMSYNTH_CXX");
+#if defined(_WIN32)
+    return std::format("{} /nologo /O2 /LD \"{}\" /Fe\"{}\" /Fo\"{}.obj\" > \"{}\" 2>&1", cxx ? cxx : "cl", source.string(),
+                       library.string(), library.string(), log.string());
+#else
+    return std::format("{} -std=c++17 -O3 -march=native -ffp-contract=off -shared -fPIC -o \"{}\" \"{}\" > \"{}\" 2>&1", cxx ? cxx : "c++",
+                       library.string(), source.string(), log.string());
+#endif
+}
+}  // namespace
+
+std::string AuCodegen::state(float& member) {
+    m_states.push_back(&member);
+    return std::format("s{}", m_states.size() - 1);
+}
+
+void AuCodegen::line(const std::string& code) {
+    m_code += "            " + code + "\n";
+}
+
+std::string AuCodegen::source(size_t inputs, const std::vector<std::string>& outputs, bool independent) const {
+    std::string source =
+        "// Generated by imsynth, see graph_jit.h.\n"
+        "#define _USE_MATH_DEFINES\n"
+        "#include <math.h>\n"
+        "#include <stddef.h>\n"
+        "\n"
+        "#if defined(_WIN32)\n"
+        "#define IMS_EXPORT extern \"C\" __declspec(dllexport)\n"
+        "#else\n"
+        "#define IMS_EXPORT extern \"C\" __attribute__((visibility(\"default\")))\n"
+        "#endif\n"
+        "#if defined(_MSC_VER)\n"
+        "#define IMS_IVDEP __pragma(loop(ivdep))\n"
+        "#elif defined(__clang__)\n"
+        "#define IMS_IVDEP _Pragma(\"clang loop vectorize(assume_safety)\")\n"
+        "#else\n"
+        "#define IMS_IVDEP _Pragma(\"GCC ivdep\")\n"
+        "#endif\n"
+        "\n";
+    source += std::format("IMS_EXPORT void {}(const float* const* in, float* const* out, float* const* state, size_t frames) {{\n",
+                          kSymbol);
+    for (size_t j = 0; j < inputs; ++j) {
+        source += std::format("    const float* in{0} = in[{0}];\n", j);
+    }
+    for (size_t j = 0; j < outputs.size(); ++j) {
+        source += std::format("    float* out{0} = out[{0}];\n", j);
+    }
+    for (size_t j = 0; j < m_states.size(); ++j) {
+        source += std::format("    float s{0} = *state[{0}];\n", j);
+    }
+    if (independent) {
+        source += "    IMS_IVDEP\n";
+    }
+    source += "    for (size_t i = 0; i < frames; ++i) {\n";
+    source += m_code;
+    for (size_t j = 0; j < outputs.size(); ++j) {
+        source += std::format("        out{}[i] = {};\n", j, outputs[j]);
+    }
+    source += "    }\n";
+    for (size_t j = 0; j < m_states.size(); ++j) {
+        source += std::format("    *state[{0}] = s{0};\n", j);
+    }
+    source += "}\n";
+    return source;
+}
+
+std::string AuCodegen::literal(float value) {
+    // Shortest round trip form, with a decimal point so the f suffix is valid.
+    return std::format("{:#}f", value);
+}
+
+AuJitCompiler::AuJitCompiler() : m_thread(&AuJitCompiler::run, this) {
+}
+
+AuJitCompiler::~AuJitCompiler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    if (!m_dir.empty()) {
+        std::error_code error;
+        std::filesystem::remove_all(m_dir, error);
+    }
+}
+
+AuFusedKernel AuJitCompiler::kernel(const std::string& source, std::shared_ptr<void>& library) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto [it, added] = m_entries.try_emplace(source);
+    if (added) {
+        m_queue.push_back(source);
+        m_pending++;
+        m_wake.notify_one();
+        return nullptr;
+    }
+    library = it->second.library;
+    return it->second.kernel;
+}
+
+bool AuJitCompiler::poll() {
+    return m_finished.exchange(false, std::memory_order_acquire);
+}
+
+size_t AuJitCompiler::pending() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+void AuJitCompiler::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_stop) {
+            return;
+        }
+        std::string source = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+        Entry entry = build(source);
+        lock.lock();
+        m_entries[source] = entry;
+        m_pending--;
+        m_finished.store(true, std::memory_order_release);
+    }
+}
+
+bool AuJitCompiler::createDirectory() {
+    // The libraries built here are loaded into the process, so nobody else
+    // may be able to write to the directory they are built in.
+    std::error_code error;
+    const std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+    if (error) {
+        std::print("Error: no temporary directory for JIT builds\n");
+        return false;
+    }
+#if defined(_WIN32)
+    // The temporary directory is in the user's profile. create_directory
+    // fails if the name exists, so the directory is always a new one.
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        const std::filesystem::path dir = temp / std::format("imsynth-jit-{}-{}", GetCurrentProcessId(), attempt);
+        if (std::filesystem::create_directory(dir, error)) {
+            m_dir = dir;
+            return true;
+        }
+    }
+    std::print("Error: can't create a JIT build directory in {}\n", temp.string());
+    return false;
+#else
+    std::string dir = (temp / "imsynth-jit-XXXXXX").string();
+    if (!mkdtemp(dir.data())) {
+        std::print("Error: can't create a JIT build directory in {}\n", temp.string());
+        return false;
+    }
+    struct stat info;
+    if (lstat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() || (info.st_mode & 077) != 0) {
+        std::print("Error: JIT build directory {} is not private\n", dir);
+        std::filesystem::remove(dir, error);
+        return false;
+    }
+    m_dir = dir;
+    return true;
+#endif
+}
+
+AuJitCompiler::Entry AuJitCompiler::build(const std::string& source) {
+    Entry entry;
+    if (m_dir.empty() && !createDirectory()) {
+        return entry;
+    }
+    const std::filesystem::path& dir = m_dir;
+    const std::string name = std::format("k{:016x}", std::hash<std::string>()(source));
+    const std::filesystem::path path = dir / (name + ".cpp");
+#if defined(_WIN32)
+    const std::filesystem::path library = dir / (name + ".dll");
+#else
+    const std::filesystem::path library = dir / (name + ".so");
+#endif
+    const std::filesystem::path log = dir / (name + ".log");
+
+    std::ofstream(path) << source;
+    if (system(compileCommand(path, library, log).c_str()) != 0) {
+        std::print("Error: JIT compile failed, see {}\n", log.string());
+        return entry;
+    }
+    void* handle = openLibrary(library.string());
+    if (!handle) {
+        std::print("Error: can't load {}\n", library.string());
+        return entry;
+    }
+    entry.library = std::shared_ptr<void>(handle, closeLibrary);
+    entry.kernel = (AuFusedKernel)findSymbol(handle, kSymbol);
+    if (!entry.kernel) {
+        std::print("Error: {} has no {}\n", library.string(), kSymbol);
+    }
+    return entry;
+}
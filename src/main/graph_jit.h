@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// A run of fused nodes compiled to native code. in and out are the buffers
+// the run reads from and writes to the rest of the plan, state points at the
+// node members the run carries from block to block.
+using AuFusedKernel = void (*)(const float* const* in, float* const* out, float* const* state, size_t frames);
+
+// Passed to AuNode::emit() to generate the C++ for one frame of a node. The
+// generated loop keeps values between fused nodes in locals, so only inputs
+// and outputs that cross the run boundary touch memory.
+class AuCodegen {
+   public:
+    // Expression for input index at the current frame i: a local of an
+    // upstream node, a buffer read, or a literal for unconnected inputs.
+    const std::string& in(size_t index) const {
+        return m_inputs[index];
+    }
+    // Local the node assigns output index to.
+    const std::string& out(size_t index) const {
+        return m_outputs[index];
+    }
+    // Local that holds member for the length of the block.
+    std::string state(float& member);
+    float sampleRate() const {
+        return m_sample_rate;
+    }
+    void line(const std::string& code);
+
+    // A float literal that reads back as exactly value.
+    static std::string literal(float value);
+
+   private:
+    friend class AuGraphCompiler;
+
+    // The kernel source around the generated frame code. Unless the run reads
+    // one of its own outputs, the loop is marked free of aliasing so it can
+    // vectorize no matter how many buffers it touches.
+    std::string source(size_t inputs, const std::vector<std::string>& outputs, bool independent) const;
+
+    float m_sample_rate = 0.0f;
+    std::vector<std::string> m_inputs;
+    std::vector<std::string> m_outputs;
+    std::vector<float*> m_states;
+    std::string m_code;
+};
+
+// Builds fused kernels with the installed compiler on a background thread and
+// keeps the libraries loaded. The compiler is $IMSYNTH_CXX, or c++ (cl on
+// Windows). Sources, build logs and libraries go to a directory under <temp>
+// that only this process's user can write, created on the first build and
+// removed with the compiler.
+class AuJitCompiler {
+   public:
+    AuJitCompiler();
+    ~AuJitCompiler();
+
+    // UI thread. Returns the kernel for source and the library it lives in,
+    // or nullptr while it's compiling or if it failed to compile. Queues the
+    // compile the first time a source is seen.
+    AuFusedKernel kernel(const std::string& source, std::shared_ptr<void>& library);
+    // True once after compiles finished, to trigger a recompile of the plan.
+    bool poll();
+    // Kernels queued or compiling.
+    size_t pending() const;
+
+   private:
+    struct Entry {
+        AuFusedKernel kernel = nullptr;
+        std::shared_ptr<void> library;
+    };
+
+    void run();
+    Entry build(const std::string& source);
+    bool createDirectory();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::deque<std::string> m_queue;
+    size_t m_pending = 0;
+    bool m_stop = false;
+    std::atomic<bool> m_finished{false};
+    std::filesystem::path m_dir;  // Compiler thread
+    std::thread m_thread;
+};
@@ -0,0 +1,77 @@
+/*
+ * imsynth engine C API.
+ *
+ * Embeds the node graph in a host that owns its own audio I/O: build a patch
+ * with the registered node types, then render it block by block into buffers
+ * the host provides. No window, audio device or MIDI driver is opened.
+ *
+ * Threading:
+ *   - Edits (add, connect, set_value, set_output) and ims_engine_commit() are
+ *     made from one control thread.
+ *   - ims_engine_render() runs on the host's audio thread, concurrently with
+ *     edits. It doesn't allocate, lock or block. Structural edits reach it
+ *     after the next ims_engine_commit(), constant edits right away.
+ *
+ * Functions returning int return 0 on success and -1 on error, with the reason
+ * printed to stdout.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* IMSYNTH_SHARED is defined while building the library. */
+#if defined(_WIN32) && defined(IMSYNTH_SHARED)
+#define IMS_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define IMS_API __declspec(dllimport)
+#else
+#define IMS_API __attribute__((visibility("default")))
+#endif
+
+typedef struct ImsEngine ImsEngine;
+
+/* Index of a node in its engine, in the order nodes were added. */
+typedef int32_t ImsNode;
+
+/* Node types, builtin and from loaded plugins. */
+IMS_API uint32_t ims_node_type_count(void);
+IMS_API const char* ims_node_type(uint32_t index);
+/* Registers the node types of a plugin library, see imsynth_plugin.h. */
+IMS_API int ims_load_plugin(const char* path);
+
+/* max_frames bounds the size of one render call's internal blocks, not of the
+ * buffers passed to ims_engine_render(). */
+IMS_API ImsEngine* ims_engine_create(float sample_rate, uint32_t max_frames);
+/* Loads a graph file saved by the imsynth app. NULL if it can't be read. */
+IMS_API ImsEngine* ims_engine_load(const char* path, float sample_rate, uint32_t max_frames);
+IMS_API void ims_engine_destroy(ImsEngine* engine);
+
+/* Returns the new node, or -1 if type_id is NULL or isn't registered. */
+IMS_API ImsNode ims_engine_add_node(ImsEngine* engine, const char* type_id);
+IMS_API int ims_engine_connect(ImsEngine* engine, ImsNode node, uint32_t input, ImsNode upstream, uint32_t output);
+IMS_API int ims_engine_disconnect(ImsEngine* engine, ImsNode node, uint32_t input);
+IMS_API int ims_engine_set_value(ImsEngine* engine, ImsNode node, uint32_t input, float value);
+IMS_API int ims_engine_set_output(ImsEngine* engine, ImsNode node);
+/* The node's text setting, like the file a SamplePlayer plays. -1 if the node
+ * has none or it can't be applied. */
+IMS_API int ims_engine_set_settings(ImsEngine* engine, ImsNode node, const char* settings);
+/* Recompiles the graph after edits. Control thread. */
+IMS_API void ims_engine_commit(ImsEngine* engine);
+
+/* A MIDI short message for MidiIn nodes. MIDI input is shared by all engines
+ * in the process. */
+IMS_API void ims_push_midi(uint8_t status, uint8_t data1, uint8_t data2);
+
+/* Renders frames of the output node into out, mono. inputs holds
+ * input_channels buffers of frames each, read by AudioInput nodes, and may be
+ * NULL. Audio thread. */
+IMS_API void ims_engine_render(ImsEngine* engine, const float* const* inputs, uint32_t input_channels, float* out, uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,154 @@
+#include "imsynth.h"
+
+#include "audio_graph.h"
+#include "graph_io.h"
+#include "midi_device.h"
+#include "node_registry.h"
+#include "realtime_guard.h"
+
+#include <algorithm>
+#include <print>
+#include <vector>
+
+struct ImsEngine {
+    AuNodeGraphPtr graph;
+    std::vector<AuNodePtr> nodes;  // Indexed by ImsNode
+    size_t max_frames;
+};
+
+namespace {
+// Input channels beyond this are ignored, render can't allocate.
+const size_t kMaxInputChannels = 64;
+
+ImsEngine* createEngine(AuNodeGraphPtr graph, float sample_rate, uint32_t max_frames) {
+    AuGraphConfig config;
+    config.sample_rate = sample_rate;
+    config.max_frames = std::max<uint32_t>(max_frames, 1);
+    graph->prepare(config);
+    return new ImsEngine{graph, graph->nodes(), config.max_frames};
+}
+
+AuNodePtr nodeAt(const ImsEngine* engine, ImsNode node) {
+    if (node < 0 || (size_t)node >= engine->nodes.size()) {
+        std::print("Error: no node {}\n", node);
+        return nullptr;
+    }
+    return engine->nodes[node];
+}
+}  // namespace
+
+uint32_t ims_node_type_count(void) {
+    return (uint32_t)AuNodeRegistry::instance().entries().size();
+}
+
+const char* ims_node_type(uint32_t index) {
+    const auto& entries = AuNodeRegistry::instance().entries();
+    return index < entries.size() ? entries[index].type_id.c_str() : nullptr;
+}
+
+int ims_load_plugin(const char* path) {
+    if (!path) {
+        return -1;
+    }
+    return AuNodeRegistry::instance().loadPlugin(path) < 0 ? -1 : 0;
+}
+
+ImsEngine* ims_engine_create(float sample_rate, uint32_t max_frames) {
+    return createEngine(std::make_shared<AuNodeGraph>(), sample_rate, max_frames);
+}
+
+ImsEngine* ims_engine_load(const char* path, float sample_rate, uint32_t max_frames) {
+    AuNodeGraphPtr graph = path ? loadGraph(path) : nullptr;
+    return graph ? createEngine(graph, sample_rate, max_frames) : nullptr;
+}
+
+void ims_engine_destroy(ImsEngine* engine) {
+    delete engine;
+}
+
+ImsNode ims_engine_add_node(ImsEngine* engine, const char* type_id) {
+    if (!type_id) {
+        return -1;
+    }
+    AuNodePtr node = AuNodeRegistry::instance().create(type_id);
+    if (!node) {
+        std::print("Error: unknown node type {}\n", type_id);
+        return -1;
+    }
+    engine->graph->addNode(node);
+    engine->nodes.push_back(node);
+    return (ImsNode)(engine->nodes.size() - 1);
+}
+
+int ims_engine_connect(ImsEngine* engine, ImsNode node, uint32_t input, ImsNode upstream, uint32_t output) {
+    AuNodePtr to = nodeAt(engine, node);
+    AuNodePtr from = nodeAt(engine, upstream);
+    if (!to || !from || input >= to->inPins() || output >= from->outPins()) {
+        std::print("Error: can't connect node {} output {} to node {} input {}\n", upstream, output, node, input);
+        return -1;
+    }
+    engine->graph->connect(to, input, from, output);
+    return 0;
+}
+
+int ims_engine_disconnect(ImsEngine* engine, ImsNode node, uint32_t input) {
+    AuNodePtr to = nodeAt(engine, node);
+    if (!to || input >= to->inPins()) {
+        return -1;
+    }
+    engine->graph->disconnect(to, input);
+    return 0;
+}
+
+int ims_engine_set_value(ImsEngine* engine, ImsNode node, uint32_t input, float value) {
+    AuNodePtr to = nodeAt(engine, node);
+    if (!to || input >= to->inPins()) {
+        return -1;
+    }
+    engine->graph->setValue(to, input, value);
+    return 0;
+}
+
+int ims_engine_set_settings(ImsEngine* engine, ImsNode node, const char* settings) {
+    AuNodePtr to = nodeAt(engine, node);
+    if (!to || to->settingsName().empty() || !settings) {
+        return -1;
+    }
+    return to->setSettings(settings) ? 0 : -1;
+}
+
+int ims_engine_set_output(ImsEngine* engine, ImsNode node) {
+    AuNodePtr output = nodeAt(engine, node);
+    if (!output) {
+        return -1;
+    }
+    engine->graph->setOutputNode(output);
+    return 0;
+}
+
+void ims_engine_commit(ImsEngine* engine) {
+    engine->graph->update();
+}
+
+void ims_push_midi(uint8_t status, uint8_t data1, uint8_t data2) {
+    MidiDevice::getInstance().handleMessage(status, data1, data2);
+}
+
+void ims_engine_render(ImsEngine* engine, const float* const* inputs, uint32_t input_channels, float* out, uint32_t frames) {
+    AuRealtimeScope realtime;
+    const float* channels[kMaxInputChannels];
+    const size_t count = inputs ? std::min<size_t>(input_channels, kMaxInputChannels) : 0;
+    for (uint32_t done = 0; done < frames;) {
+        const size_t n = std::min<size_t>(frames - done, engine->max_frames);
+        for (size_t c = 0; c < count; ++c) {
+            channels[c] = inputs[c] + done;
+        }
+        const float* block = engine->graph->process(n, AuCaptureBlock{channels, count});
+        if (block) {
+            std::copy_n(block, n, out + done);
+        } else {
+            std::fill_n(out + done, n, 0.0f);
+        }
+        done += (uint32_t)n;
+    }
+}
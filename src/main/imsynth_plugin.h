@@ -0,0 +1,68 @@
+/*
+ * imsynth node plugin ABI.
+ *
+ * A plugin is a shared library exporting IMS_PLUGIN_ENTRY_POINT, which returns
+ * an array of node descriptors. The host copies nothing but the descriptor
+ * pointers, so descriptors and the strings they reference must stay valid for
+ * as long as the library is loaded.
+ *
+ * Realtime contract:
+ *   - init() and destroy() are called off the audio thread.
+ *   - process() is called on the audio thread and must not allocate, lock,
+ *     block or perform I/O. All state lives in the state_size bytes the host
+ *     hands to init(), which the host allocates with state_alignment.
+ *
+ * This header is plain C so that plugins can be built with any toolchain.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMS_PLUGIN_ABI_VERSION 1
+
+#define IMS_PLUGIN_ENTRY_POINT "ims_get_node_descriptors"
+
+#if defined(_WIN32)
+#define IMS_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define IMS_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef struct ImsPinDescriptor {
+    const char* name;
+    float default_value;  /* Ignored for output pins. */
+    uint32_t flags;       /* Reserved, must be 0. */
+} ImsPinDescriptor;
+
+typedef struct ImsNodeDescriptor {
+    uint32_t abi_version; /* Must be IMS_PLUGIN_ABI_VERSION. */
+    const char* type_id;  /* Unique, stable id used for serialization. */
+    const char* display_name;
+
+    uint32_t input_count;
+    const ImsPinDescriptor* inputs;
+    uint32_t output_count;
+    const ImsPinDescriptor* outputs;
+
+    size_t state_size;
+    size_t state_alignment; /* Power of two, 0 means alignof(max_align_t). */
+
+    /* Receives zeroed state memory. May be NULL. */
+    void (*init)(void* state, float sample_rate);
+    /* inputs[i] and outputs[i] point to frames floats each. */
+    void (*process)(void* state, const float* const* inputs, float* const* outputs, uint32_t frames);
+    /* Called before the state memory is released. May be NULL. */
+    void (*destroy)(void* state);
+} ImsNodeDescriptor;
+
+/* Signature of IMS_PLUGIN_ENTRY_POINT. Writes the descriptor count to count. */
+typedef const ImsNodeDescriptor* const* (*ImsGetNodeDescriptorsFn)(uint32_t* count);
+
+#ifdef __cplusplus
+}
+#endif
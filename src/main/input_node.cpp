@@ -0,0 +1,17 @@
+#include "input_node.h"
+
+#include <algorithm>
+
+AuAudioInput::AuAudioInput() {
+    addInPin("channel", 0.0f, AuRate::Init);
+    addOutPin("out");
+}
+
+void AuAudioInput::process(const AuProcessContext& ctx) {
+    // Only reached if the plan couldn't treat the node as a capture.
+    std::fill_n(ctx.out(0), ctx.frames, 0.0f);
+}
+
+int AuAudioInput::captureChannel() const {
+    return std::max(0, (int)m_in_pins[0].value());
+}
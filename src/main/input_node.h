@@ -0,0 +1,18 @@
+#pragma once
+#include "audio_graph.h"
+
+// One channel of the capture device when the engine runs full duplex, silent
+// otherwise. The plan passes the captured block straight to readers, see
+// AuNode::captureChannel().
+class AuAudioInput : public AuNodeBase {
+   public:
+    AuAudioInput();
+    void process(const AuProcessContext& ctx) override;
+    bool fixedRate() const override {
+        return true;
+    }
+    int captureChannel() const override;
+    std::string_view name() const {
+        return "AudioInput";
+    }
+};
@@ -13,6 +13,7 @@
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include <stdio.h>
+#include <stdlib.h>
 #define GL_SILENCE_DEPRECATION
 #if defined(IMGUI_IMPL_OPENGL_ES2)
 #include <GLES2/gl2.h>
@@ -20,10 +21,14 @@
 #include <GLFW/glfw3.h> // Will drag system OpenGL headers
 
 #include "audio_engine.h"
+#include "device_window.h"
 #include "graph_window.h"
 #include "main_window.h"
-#include "midi_node.h"
+#include "midi_window.h"
+#include "node_registry.h"
 #include "node_window.h"
+#include "realtime_guard.h"
+#include "realtime_thread.h"
 
 // [Win32] Our example includes a copy of glfw3.lib pre-compiled with VS2010 to maximize ease of testing and compatibility with old VS compilers.
 // To link with VS2010-era libraries, VS2015+ requires linking with legacy_stdio_definitions.lib, which we do using this pragma.
@@ -43,7 +48,51 @@ static void glfw_error_callback(int error, const char* description)
 }
 
 // Main code
-int main(int, char**)
+// --realtime [priority]  Run the audio thread with SCHED_FIFO
+// --cpu <index>          Pin the audio thread to a core
+// --lock-memory          Lock the process in RAM
+// --keep-denormals       Don't set FTZ/DAZ on the audio thread
+// --device <index>       Playback device, -1 for the system default
+// --period <frames>      Device period size
+// --periods <count>      Device period count
+// --shared               Open the device in shared mode
+// --duplex [index]       Open a capture device too, for AudioInput nodes
+// --simulate             Drive the engine from a timer instead of a device
+static AudioEngineOptions parseEngineOptions(int argc, char** argv) {
+    AudioEngineOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc && argv[i + 1][0] != '-';
+        if (arg == "--realtime") {
+            options.thread.realtime = true;
+            if (has_value) options.thread.priority = atoi(argv[++i]);
+        } else if (arg == "--cpu" && has_value) {
+            options.thread.cpu = atoi(argv[++i]);
+        } else if (arg == "--lock-memory") {
+            options.lock_memory = true;
+        } else if (arg == "--keep-denormals") {
+            options.thread.flush_denormals = false;
+        } else if (arg == "--device" && i + 1 < argc) {
+            options.device.device = atoi(argv[++i]);
+        } else if (arg == "--period" && has_value) {
+            options.device.period_frames = atoi(argv[++i]);
+        } else if (arg == "--periods" && has_value) {
+            options.device.periods = atoi(argv[++i]);
+        } else if (arg == "--shared") {
+            options.device.exclusive = false;
+        } else if (arg == "--simulate") {
+            options.device.simulation.enabled = true;
+        } else if (arg == "--duplex") {
+            options.device.duplex = true;
+            if (has_value) options.device.capture_device = atoi(argv[++i]);
+        } else {
+            printf("Unknown option %s\n", argv[i]);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv)
 {
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
@@ -130,11 +179,13 @@ int main(int, char**)
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
     ImguiWindowVector windows;
 
-    auto audio = AudioEngine::create();
+    AuNodeRegistry::instance().loadPluginDirectory("plugins");
+    auto audio = AudioEngine::create(parseEngineOptions(argc, argv));
     windows.push_back(MainWindow::create(*audio));
     windows.push_back(MidiWindow::create());
     windows.push_back(NodeWindow::create(*audio));
     windows.push_back(GraphWindow::create(*audio));
+    windows.push_back(DeviceWindow::create(*audio));
     audio->init();
 
     // Main loop
@@ -166,6 +217,8 @@ int main(int, char**)
         for (const auto& window : windows) {
             window->frame();
         }
+        reportRealtimeViolations();
+        reportThreadSetup();
 
 #if 0
         float new_freq = 0.0f;
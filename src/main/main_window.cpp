@@ -1,94 +1,82 @@
 #include "main_window.h"
 
+#include <assert.h>
 #include <imgui.h>
 #include <imgui_node_editor.h>
+#include <misc/cpp/imgui_stdlib.h>
 
+#include <algorithm>
 #include <format>
 #include <iostream>
-#include <map>
 #include <string>
+#include <vector>
 
 #include "audio_engine.h"
 
 namespace ed = ax::NodeEditor;
 
+// Editor ids are computed from AuNode::id(), so they need no lookup tables
+// and stay the same across save and load, which keeps the editor's saved
+// layout attached to the right nodes. The low bits hold the kind and the pin.
 class EdIdMapper {
    public:
-    EdIdMapper() : m_next_free_index(100) {}
-
-    ed::NodeId getNodeId(AuNodePtr node) {
-        return (ed::NodeId)get(pt(node, 0, Node));
+    static ed::NodeId getNodeId(const AuNodePtr& node) {
+        return (ed::NodeId)make(node, 0, Node);
     }
 
-    ed::PinId getInPinId(AuNodePtr node, int index) {
-        return (ed::PinId)get(pt(node, index, InPin));
+    static ed::PinId getInPinId(const AuNodePtr& node, size_t index) {
+        return (ed::PinId)make(node, index, InPin);
     }
 
-    ed::PinId getOutPinId(AuNodePtr node, int index) {
-        return (ed::PinId)get(pt(node, index, OutPin));
+    static ed::PinId getOutPinId(const AuNodePtr& node, size_t index) {
+        return (ed::PinId)make(node, index, OutPin);
     }
 
-    ed::LinkId getLinkId(AuNodePtr node, int input_index) {
-        return (ed::LinkId)get(pt(node, input_index, Link));
+    static ed::LinkId getLinkId(const AuNodePtr& node, size_t input_index) {
+        return (ed::LinkId)make(node, input_index, Link);
     }
 
-    AuNodePtr getNode(ed::NodeId id) {
-        assert(m_id_to_ptr.count((size_t)id) > 0);
-        auto p = m_id_to_ptr[(size_t)id];
-        assert(p.second.second == Node);
-        return p.first;
+    static AuNodePtr getNode(const AuNodeGraph& graph, ed::NodeId id) {
+        return decode(graph, (uintptr_t)id, Node).first;
     }
 
-    std::pair<AuNodePtr, int> getInPin(ed::PinId id) {
-        assert(m_id_to_ptr.count((size_t)id) > 0);
-        auto p = m_id_to_ptr[(size_t)id];
-        assert(p.second.second == InPin);
-        return {p.first, p.second.first};
+    static std::pair<AuNodePtr, size_t> getInPin(const AuNodeGraph& graph, ed::PinId id) {
+        return decode(graph, (uintptr_t)id, InPin);
     }
 
-    std::pair<AuNodePtr, int> getOutPin(ed::PinId id) {
-        assert(m_id_to_ptr.count((size_t)id) > 0);
-        auto p = m_id_to_ptr[(size_t)id];
-        assert(p.second.second == OutPin);
-        return {p.first, p.second.first};
+    static std::pair<AuNodePtr, size_t> getOutPin(const AuNodeGraph& graph, ed::PinId id) {
+        return decode(graph, (uintptr_t)id, OutPin);
     }
 
-    std::pair<AuNodePtr, int> getLink(ed::LinkId id) {
-        assert(m_id_to_ptr.count((size_t)id) > 0);
-        auto p = m_id_to_ptr[(size_t)id];
-        assert(p.second.second == Link);
-        return {p.first, p.second.first};
+    static std::pair<AuNodePtr, size_t> getLink(const AuNodeGraph& graph, ed::LinkId id) {
+        return decode(graph, (uintptr_t)id, Link);
     }
 
-    bool isInPin(ed::PinId id) const {
-        return m_id_to_ptr.count((size_t)id) > 0 && m_id_to_ptr.at((size_t)id).second.second == InPin;
+    static bool isInPin(ed::PinId id) {
+        return ((uintptr_t)id & kKindMask) == InPin;
     }
 
-    bool isOutPin(ed::PinId id) const {
-        return m_id_to_ptr.count((size_t)id) > 0 && m_id_to_ptr.at((size_t)id).second.second == OutPin;
+    static bool isOutPin(ed::PinId id) {
+        return ((uintptr_t)id & kKindMask) == OutPin;
     }
 
    private:
-    enum Type { Node, InPin, OutPin, Link };
-    using PtrType = std::pair<AuNodePtr, std::pair<int, Type>>;
-    PtrType pt(AuNodePtr node, int index, Type type) {
-        return {node, {index, type}};
+    enum Kind { Node, InPin, OutPin, Link };
+    static const uintptr_t kKindMask = 3;
+    static const int kIndexShift = 2;
+    static const int kNodeShift = 18;  // Up to 65536 pins per node
+
+    static uintptr_t make(const AuNodePtr& node, size_t index, Kind kind) {
+        assert(node->id() != 0 && index < (1 << (kNodeShift - kIndexShift)));
+        return ((uintptr_t)node->id() << kNodeShift) | (index << kIndexShift) | kind;
     }
 
-    size_t get(PtrType p) {
-        if (m_ptr_to_id.count(p) == 0) {
-            size_t id = m_next_free_index++;
-            m_ptr_to_id[p] = id;
-            m_id_to_ptr[id] = p;
-            return id;
-        } else {
-            return m_ptr_to_id[p];
-        }
+    // The node is nullptr if the id doesn't belong to graph.
+    static std::pair<AuNodePtr, size_t> decode(const AuNodeGraph& graph, uintptr_t id, Kind kind) {
+        assert((id & kKindMask) == kind);
+        const size_t index = (id & ((1 << kNodeShift) - 1)) >> kIndexShift;
+        return {graph.findNode((uint32_t)(id >> kNodeShift)), index};
     }
-
-    std::map<PtrType, size_t> m_ptr_to_id;
-    std::map<size_t, PtrType> m_id_to_ptr;
-    size_t m_next_free_index;
 };
 
 class MainWindow_impl : public MainWindow {
@@ -98,11 +86,24 @@ class MainWindow_impl : public MainWindow {
     void frame() override;
 
    private:
+    // Canvas space rectangle of a node as of the last frame it was drawn.
+    struct NodeBounds {
+        ImVec2 min;
+        ImVec2 max;
+        bool known = false;
+    };
+
+    void cull(const AuNodeGraph& graph);
+    void drawNode(AuNodeGraph& graph, const AuNodePtr& node);
+
     ed::EditorContext* m_context = 0;
     int m_NextLinkId = 100;
     AudioEngine& m_audio;
-    AuNodeGraphPtr m_node_graph;
-    EdIdMapper m_id_mapper;
+    const Pin* m_editing = nullptr;
+    // Indexed by AuNode::id().
+    std::vector<NodeBounds> m_bounds;
+    std::vector<char> m_visible;
+    std::vector<ed::NodeId> m_selected;
 };
 
 std::unique_ptr<ImguiWindow> MainWindow::create(AudioEngine& audio) {
@@ -113,8 +114,7 @@ MainWindow_impl::MainWindow_impl(AudioEngine& audio) : m_audio(audio) {
     ed::Config config;
     config.SettingsFile = "imsynth-nodeed.json";
     m_context = ed::CreateEditor(&config);
-    m_node_graph = createTestGraph();
-    m_audio.setGraph(m_node_graph);
+    m_audio.setGraph(createTestGraph());
 }
 
 MainWindow_impl::~MainWindow_impl() {
@@ -123,69 +123,188 @@ MainWindow_impl::~MainWindow_impl() {
 
 // #define DEBUG_PINS
 
-void MainWindow_impl::frame() {
-    ImGui::Begin("ImSynth");
-    ed::SetCurrentEditor(m_context);
-    ed::Begin("My Editor", ImVec2(0.0, 0.0f));
+namespace {
+bool overlaps(const ImVec2& a_min, const ImVec2& a_max, const ImVec2& b_min, const ImVec2& b_max) {
+    return a_min.x <= b_max.x && b_min.x <= a_max.x && a_min.y <= b_max.y && b_min.y <= a_max.y;
+}
+
+// Last value and a scope of the last block, scaled from its min to its max.
+void drawProbe(AuProbe& probe) {
+    const AuProbeSnapshot& snapshot = probe.read();
+    ImGui::SameLine();
+    if (snapshot.block == 0) {
+        ImGui::TextDisabled("-");
+        return;
+    }
+    auto [min, max] = std::minmax_element(snapshot.data, snapshot.data + snapshot.count);
+    ImGui::Text("%6.2f", snapshot.last());
+    ImGui::SameLine();
+    ImGui::PlotLines("", snapshot.data, (int)snapshot.count, 0, nullptr, *min, *max, ImVec2(80, 20));
+}
+}  // namespace
+
+// Decides which nodes to submit this frame. The editor's per node cost is
+// high, so only nodes in view, selected nodes (they may be dragged), nodes not
+// drawn yet (their size is unknown) and both ends of links that may cross the
+// view are submitted. The rest keep their position in the editor.
+void MainWindow_impl::cull(const AuNodeGraph& graph) {
+    // The view is taken with last frame's pan and zoom, hence the margin.
+    const float margin = 64.0f;
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const ImVec2 size = ImGui::GetContentRegionAvail();
+    const ImVec2 view_min = ed::ScreenToCanvas(ImVec2(origin.x - margin, origin.y - margin));
+    const ImVec2 view_max = ed::ScreenToCanvas(ImVec2(origin.x + size.x + margin, origin.y + size.y + margin));
+
+    const auto& nodes = graph.nodes();
+    uint32_t max_id = 0;
+    for (const auto& node : nodes) {
+        max_id = std::max(max_id, node->id());
+    }
+    m_bounds.resize(max_id + 1);
+    m_visible.assign(max_id + 1, 0);
+    for (const auto& node : nodes) {
+        const NodeBounds& bounds = m_bounds[node->id()];
+        m_visible[node->id()] = !bounds.known || overlaps(bounds.min, bounds.max, view_min, view_max);
+    }
+    m_selected.resize(ed::GetSelectedObjectCount());
+    m_selected.resize(ed::GetSelectedNodes(m_selected.data(), (int)m_selected.size()));
+    for (ed::NodeId id : m_selected) {
+        if (AuNodePtr node = EdIdMapper::getNode(graph, id)) {
+            m_visible[node->id()] = 1;
+        }
+    }
+    // A link is drawn only if both its pins are, so submit both nodes when
+    // the box around them overlaps the view.
+    for (const auto& node : nodes) {
+        for (size_t pin = 0; pin < node->inPins(); ++pin) {
+            const AuNodePtr& upstream = node->inPin(pin).node();
+            if (!upstream || upstream->id() > max_id || (m_visible[node->id()] && m_visible[upstream->id()])) {
+                continue;
+            }
+            const NodeBounds& a = m_bounds[node->id()];
+            const NodeBounds& b = m_bounds[upstream->id()];
+            const ImVec2 min(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y));
+            const ImVec2 max(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y));
+            if (overlaps(min, max, view_min, view_max)) {
+                m_visible[node->id()] = m_visible[upstream->id()] = 1;
+            }
+        }
+    }
+}
 
-    int links = 0;
-    for (const auto& node : m_node_graph->nodes()) {
-        ImGui::PushID(node.get());
-        ed::NodeId node_id = m_id_mapper.getNodeId(node);
-        ed::BeginNode(node_id);
+void MainWindow_impl::drawNode(AuNodeGraph& graph, const AuNodePtr& node) {
+    ImGui::PushID(node.get());
+    ed::NodeId node_id = EdIdMapper::getNodeId(node);
+    ed::BeginNode(node_id);
 #if defined(DEBUG_PINS)
-        ImGui::Text(std::format("{} ({})", node->name(), (size_t)node_id).c_str());
+    ImGui::Text(std::format("{} ({})", node->name(), (size_t)node_id).c_str());
 #else
-        ImGui::Text(std::string(node->name()).c_str());
+    ImGui::Text(std::string(node->name()).c_str());
 #endif
-        if (node == m_node_graph->getOutputNode()) {
-            ImGui::Text("Output: %.0f dB", m_audio.getDb());
+    if (node == graph.getOutputNode()) {
+        ImGui::Text("Output: %.0f dB", m_audio.getDb());
+    }
+    // Click to cycle the oversampling factor 1x, 2x, 4x, 8x.
+    if (ImGui::SmallButton(std::format("{}x", node->oversampling()).c_str())) {
+        graph.setOversampling(node, node->oversampling() == 8 ? 1 : node->oversampling() * 2);
+    }
+    // Applied on enter, so a file path isn't opened at every key stroke.
+    if (std::string_view name = node->settingsName(); !name.empty()) {
+        std::string settings = node->settings();
+        ImGui::SetNextItemWidth(160);
+        if (ImGui::InputText(std::string(name).c_str(), &settings, ImGuiInputTextFlags_EnterReturnsTrue)) {
+            node->setSettings(settings);
         }
+    }
 
-        for (size_t i = 0; i < std::max(node->outPins(), node->inPins()); ++i) {
-            if (i < node->inPins()) {
-                ed::PinId in_pin = m_id_mapper.getInPinId(node, i);
-                ed::BeginPin(in_pin, ed::PinKind::Input);
-                Pin& inpin = node->inPin(i);
+    for (size_t i = 0; i < std::max(node->outPins(), node->inPins()); ++i) {
+        if (i < node->inPins()) {
+            ed::PinId in_pin = EdIdMapper::getInPinId(node, i);
+            ed::BeginPin(in_pin, ed::PinKind::Input);
+            Pin& inpin = node->inPin(i);
 #if defined(DEBUG_PINS)
-                ImGui::Text(std::format("{} ({})", node->inPin(i).name(), (size_t)in_pin).c_str());
+            ImGui::Text(std::format("{} ({})", node->inPin(i).name(), (size_t)in_pin).c_str());
 #else
-                ImGui::Text(inpin.name().c_str());
+            ImGui::Text(inpin.name().c_str());
 #endif
-                ed::EndPin();
-                ImGui::SameLine();
-                ImGui::SetNextItemWidth(50);
-                ImGui::PushID(i);
-                if (inpin.node()) {
-                    // ImGui::Text("%.1f", inpin.generate());
-                } else {
-                    ImGui::DragFloat("", &(node->inPin(i).value()), 0.1, 0, 100, "%.1f");
+            ed::EndPin();
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(50);
+            ImGui::PushID(i);
+            if (const AuNodePtr& upstream = inpin.node()) {
+                // The value read, when the output it comes from is probed.
+                if (AuProbe* probe = upstream->outPin(inpin.index()).probe()) {
+                    ImGui::Text("%.2f", probe->read().last());
                 }
-                ImGui::PopID();
             } else {
-                ImGui::Text("                   ");
+                // Show what the audio thread uses, except while dragging.
+                float value = m_editing == &inpin ? inpin.value() : inpin.published();
+                bool changed = ImGui::DragFloat("", &value, 0.1, 0, 100, "%.1f");
+                if (ImGui::IsItemActive()) {
+                    m_editing = &inpin;
+                } else if (m_editing == &inpin) {
+                    m_editing = nullptr;
+                }
+                if (changed) {
+                    graph.setValue(node, i, value);
+                }
             }
-            if (i < node->outPins()) {
-                ImGui::SameLine();
-                ed::PinId out_pin = m_id_mapper.getOutPinId(node, i);
-                ed::BeginPin(out_pin, ed::PinKind::Output);
+            ImGui::PopID();
+        } else {
+            ImGui::Text("                   ");
+        }
+        if (i < node->outPins()) {
+            ImGui::SameLine();
+            ed::PinId out_pin = EdIdMapper::getOutPinId(node, i);
+            ed::BeginPin(out_pin, ed::PinKind::Output);
 #if defined(DEBUG_PINS)
-                ImGui::Text(std::format("{} ({})", node->outPin(i).name(), (size_t)out_pin).c_str());
+            ImGui::Text(std::format("{} ({})", node->outPin(i).name(), (size_t)out_pin).c_str());
 #else
-                ImGui::Text(node->outPin(i).name().c_str());
+            ImGui::Text(node->outPin(i).name().c_str());
 #endif
-                ed::EndPin();
+            ed::EndPin();
+            // Click to probe the output, see AuNodeGraph::setProbe().
+            ImGui::SameLine();
+            ImGui::PushID(node->inPins() + i);
+            AuProbe* probe = node->outPin(i).probe();
+            if (ImGui::SmallButton(probe ? "x" : "~")) {
+                graph.setProbe(node, i, !probe);
+            }
+            if (probe) {
+                drawProbe(*probe);
             }
+            ImGui::PopID();
         }
-        ed::EndNode();
-        ImGui::PopID();
     }
-    for (const auto& node : m_node_graph->nodes()) {
+    ed::EndNode();
+    // The node's rectangle, in canvas space while the editor is drawing.
+    m_bounds[node->id()] = {ImGui::GetItemRectMin(), ImGui::GetItemRectMax(), true};
+    ImGui::PopID();
+}
+
+void MainWindow_impl::frame() {
+    ImGui::Begin("ImSynth");
+    ed::SetCurrentEditor(m_context);
+    AuNodeGraphPtr node_graph = m_audio.getGraph();
+    cull(*node_graph);
+    ed::Begin("My Editor", ImVec2(0.0, 0.0f));
+
+    const auto& nodes = node_graph->nodes();
+    for (const auto& node : nodes) {
+        if (node->id() < m_visible.size() && m_visible[node->id()]) {
+            drawNode(*node_graph, node);
+        }
+    }
+    for (const auto& node : nodes) {
+        if (node->id() >= m_visible.size() || !m_visible[node->id()]) {
+            continue;
+        }
         for (size_t pin = 0; pin < node->inPins(); ++pin) {
-            if (AuNodePtr upstream = node->inPin(pin).node()) {
-                ed::LinkId link_id = m_id_mapper.getLinkId(node, pin);
-                ed::PinId in_pin_id = m_id_mapper.getInPinId(node, pin);
-                ed::PinId out_pin_id = m_id_mapper.getOutPinId(upstream, node->inPin(pin).index());
+            const AuNodePtr& upstream = node->inPin(pin).node();
+            if (upstream && upstream->id() < m_visible.size() && m_visible[upstream->id()]) {
+                ed::LinkId link_id = EdIdMapper::getLinkId(node, pin);
+                ed::PinId in_pin_id = EdIdMapper::getInPinId(node, pin);
+                ed::PinId out_pin_id = EdIdMapper::getOutPinId(upstream, node->inPin(pin).index());
                 ed::Link(link_id, in_pin_id, out_pin_id);
             }
         }
@@ -209,21 +328,21 @@ void MainWindow_impl::frame() {
             if (inputPinId && outputPinId)  // both are valid, let's accept link
             {
                 bool is_ok = false;
-                if (m_id_mapper.isOutPin(inputPinId) && m_id_mapper.isInPin(outputPinId)) {
+                if (EdIdMapper::isOutPin(inputPinId) && EdIdMapper::isInPin(outputPinId)) {
                     std::swap(inputPinId, outputPinId);
                 }
-                if (m_id_mapper.isOutPin(outputPinId) && m_id_mapper.isInPin(inputPinId)) {
+                if (EdIdMapper::isOutPin(outputPinId) && EdIdMapper::isInPin(inputPinId)) {
                     is_ok = true;
                 }
                 // ed::AcceptNewItem() return true when user release mouse button.
                 if (is_ok) {
                     if (ed::AcceptNewItem()) {
-                        auto inpin = m_id_mapper.getInPin(inputPinId);
-                        auto outpin = m_id_mapper.getOutPin(outputPinId);
-                        if (inpin.first != outpin.first) {
-                            inpin.first->inPin(inpin.second).connect(outpin.first, outpin.second);
+                        auto inpin = EdIdMapper::getInPin(*node_graph, inputPinId);
+                        auto outpin = EdIdMapper::getOutPin(*node_graph, outputPinId);
+                        if (inpin.first && outpin.first && inpin.first != outpin.first) {
+                            node_graph->connect(inpin.first, inpin.second, outpin.first, outpin.second);
                             // Draw new link.
-                            ed::Link(m_id_mapper.getLinkId(inpin.first, inpin.second), inputPinId, outputPinId);
+                            ed::Link(EdIdMapper::getLinkId(inpin.first, inpin.second), inputPinId, outputPinId);
                         }
                     }
                 } else {
@@ -242,8 +361,10 @@ void MainWindow_impl::frame() {
             // If you agree that link can be deleted, accept deletion.
             if (ed::AcceptDeletedItem()) {
                 // Then remove link from your data.
-                auto link = m_id_mapper.getLink(deletedLinkId);
-                link.first->inPin(link.second).disconnect();
+                auto link = EdIdMapper::getLink(*node_graph, deletedLinkId);
+                if (link.first) {
+                    node_graph->disconnect(link.first, link.second);
+                }
             }
             // You may reject link deletion by calling:
             // ed::RejectDeletedItem();
@@ -253,6 +374,7 @@ void MainWindow_impl::frame() {
 
     ed::End();
     ed::SetCurrentEditor(nullptr);
+    m_audio.update();
 
     ImGui::End();
 }
@@ -0,0 +1,108 @@
+#include "midi_device.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <chrono>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+
+namespace {
+void CALLBACK MidiInProc(HMIDIIN hMidiIn, UINT wMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2) {
+    if (wMsg == MIM_DATA) {
+        ((MidiDevice*)dwInstance)->handleMessage(dwParam1 & 0xFF, (dwParam1 >> 8) & 0xFF, (dwParam1 >> 16) & 0xFF);
+    }
+}
+}  // namespace
+
+MidiDevice::MidiDevice() {
+    HMIDIIN hMidiIn = nullptr;
+    UINT numDevices = midiInGetNumDevs();
+    if (numDevices == 0) {
+        printf("No MIDI devices found\n");
+        return;
+    } else if (midiInOpen(&hMidiIn, 0, (DWORD_PTR)MidiInProc, (DWORD_PTR)this, CALLBACK_FUNCTION) != MMSYSERR_NOERROR) {
+        printf("Failed to open MIDI input device!");
+        return;
+    }
+    m_handle = hMidiIn;
+    midiInStart(hMidiIn);
+}
+
+MidiDevice::~MidiDevice() {
+    if (m_handle) {
+        midiInStop((HMIDIIN)m_handle);
+        midiInClose((HMIDIIN)m_handle);
+    }
+}
+#else
+MidiDevice::MidiDevice() {}
+
+MidiDevice::~MidiDevice() {}
+#endif
+
+MidiDevice& MidiDevice::getInstance() {
+    static MidiDevice midi;
+    return midi;
+}
+
+void MidiDevice::handleMessage(uint8_t status, uint8_t data1, uint8_t data2) {
+    const uint8_t type = status & 0xF0;
+    if (type != 0x90 && type != 0x80 && type != 0xE0) {
+        return;
+    }
+    // The message's channel and the omni channel both follow it.
+    Channel* channels[2] = {&m_channels[(status & 0x0F) + 1], &m_channels[0]};
+    if (type == 0x90) {
+        const float freq = map_midi_to_freq(data1);
+        const float amp = float(data2) / 127.0;
+        for (Channel* channel : channels) {
+            channel->freq = freq;
+            channel->amp = amp;
+        }
+        midi_keys[data1].amplitude = amp;
+        midi_keys[data1].is_pressed = true;
+        m_samples[m_sample_count % 8].amp = amp;
+        m_samples[m_sample_count % 8].freq = freq;
+
+        auto now = std::chrono::system_clock::now();
+        auto duration = now.time_since_epoch();
+        m_samples[m_sample_count % 8].start_time = std::chrono::duration<double>(duration).count();
+
+        m_sample_count++;
+
+    }
+    if (type == 0x80) {
+        for (Channel* channel : channels) {
+            channel->amp = 0.0f;
+        }
+        midi_keys[data1].is_pressed = false;
+        midi_keys[data1].amplitude = 0;
+
+        auto now = std::chrono::system_clock::now();
+        auto duration = now.time_since_epoch();
+        m_samples[(m_sample_count + 7) % 8].duration =
+            std::chrono::duration<double>(duration).count() - m_samples[(m_sample_count + 7) % 8].start_time;
+    }
+
+    if (type == 0xE0) {
+        int bend_val = (data2 << 8) + data1;
+       
+        const float pitch = (float)(bend_val - 16384) / 16384.0f;
+        for (Channel* channel : channels) {
+            channel->pitch = pitch;
+        }
+        //printf("bend_value %f\n", pitch);
+        
+    }
+
+    // printf("MIDI Message: Status= %x, Data1= %x, Data2= %x, \n", status, data1, data2);
+}
+
+float MidiDevice::map_midi_to_freq(uint8_t midi_in) {
+    float a = ((float)midi_in - 69.0) / 12.0;
+    float f = 440.0 * pow(2.0, a);
+    return f;
+}
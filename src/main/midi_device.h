@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+// The MIDI input MidiIn nodes read. On Windows it opens the first WinMM input
+// device. Elsewhere, or when the engine is embedded, the host pushes messages
+// with handleMessage().
+class MidiDevice {
+   public:
+    static constexpr int kChannels = 16;
+
+    static MidiDevice& getInstance();
+
+    // Of the last note on channel 1 to 16, or on any channel for 0.
+    float amp(int channel = 0) {
+        return m_channels[channel].amp;
+    }
+    float freq(int channel = 0) {
+        const Channel& c = m_channels[channel];
+        return c.freq + 0.5*c.freq*c.pitch;
+    }
+
+    struct midi_key_status {
+        float amplitude;
+        bool is_pressed;
+    };
+
+    const midi_key_status* status() const {
+        return midi_keys;
+    }
+
+    // A short message: note on and off and pitch bend are used.
+    void handleMessage(uint8_t status, uint8_t data1, uint8_t data2);
+
+   private:
+    MidiDevice();
+    ~MidiDevice();
+    float map_midi_to_freq(uint8_t midi_in);
+    void* m_handle = nullptr;  // HMIDIIN
+    struct Channel {
+        float freq = 0.0f;
+        float amp = 0.0f;
+        float pitch = 0.0f;
+    };
+    Channel m_channels[kChannels + 1];  // [0] follows every channel
+    midi_key_status midi_keys[256] = {0};
+
+    struct sample {
+        float amp;
+        float freq;
+        double start_time;
+        double duration;
+    };
+    int m_sample_count = 0;
+    sample m_samples[8] = {0};
+};
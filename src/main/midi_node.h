@@ -1,20 +1,31 @@
 #pragma once
 #include "audio_graph.h"
-#include "imgui_window.h"
 
+// Amplitude and frequency of the last note on the graph's MIDI channel, see
+// AuGraphConfig::midi_channel.
 class AuMidiSource : public AuNodeBase {
    public:
     AuMidiSource();
-    float generate(size_t index) override;
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    AuRate rate() const override {
+        return AuRate::Control;
+    }
     std::string_view name() const {
         return "MidiIn";
     }
+
+   private:
+    int m_channel = 0;
 };
 
 class AuMidiRepeater : public AuNodeBase {
    public:
     AuMidiRepeater();
-    float generate(size_t index) override;
+    void process(const AuProcessContext& ctx) override;
+    AuRate rate() const override {
+        return AuRate::Control;
+    }
     std::string_view name() const {
         return "MidiRepeat";
     }
@@ -28,10 +39,8 @@ class AuMidiRepeater : public AuNodeBase {
     int m_current_record = 0;
     double m_start_playback = -1.0;
     note m_notes[8];
-};
+    double m_time = 0.0;  // Seconds rendered
 
-class MidiWindow : public ImguiWindow {
-   public:
-    static std::unique_ptr<ImguiWindow> create();
-    void frame() override;
+   private:
+    void step(float amp, float freq, float speed, float& out_amp, float& out_freq);
 };
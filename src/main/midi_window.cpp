@@ -0,0 +1,44 @@
+#include "midi_window.h"
+
+#include "midi_device.h"
+
+#include <imgui.h>
+
+#include <string>
+
+std::unique_ptr<ImguiWindow> MidiWindow::create() {
+    return std::make_unique<MidiWindow>();
+}
+
+void MidiWindow::frame() {
+    ImGui::Begin("Input stats");
+    MidiDevice& midi = MidiDevice::getInstance();
+    float total_amp = 0.0f;
+    int nof_keys_pressed = 0;
+    for (int b_idx = 0; b_idx < 128; b_idx++) {
+        float amp = midi.status()[b_idx].amplitude;
+        total_amp += amp;
+        float r = amp * 0.4f + (1.0f - amp) * 0.7f;
+        float g = amp * 0.7f + (1.0f - amp) * 0.4f;
+        float b = 0.2f;
+        /*
+        if (midi_keys[b_idx].is_pressed) {
+            ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.4f, 0.7f, 0.2f, 1.0f));
+        } else {
+            ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(0.7f, 0.4f, 0.2f, 1.0f));
+        }
+        */
+        ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(r, g, b, 1.0f));
+
+        ImGui::Button(std::to_string(b_idx).c_str(), ImVec2(32, 32));
+        if ((b_idx + 1) % 8 != 0) {
+            ImGui::SameLine();
+        }
+        ImGui::PopStyleColor(1);
+
+        if (midi.status()[b_idx].is_pressed) {
+            nof_keys_pressed++;
+        }
+    }
+    ImGui::End();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "imgui_window.h"
+
+#include <memory>
+
+// Keys held on the MIDI input.
+class MidiWindow : public ImguiWindow {
+   public:
+    static std::unique_ptr<ImguiWindow> create();
+    void frame() override;
+};
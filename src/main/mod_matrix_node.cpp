@@ -0,0 +1,60 @@
+#include "mod_matrix_node.h"
+
+#include <algorithm>
+#include <format>
+
+AuModMatrix::AuModMatrix() {
+    for (size_t s = 0; s < kSources; ++s) {
+        addInPin(std::format("s{}", s + 1), 0.0f);
+    }
+    for (size_t s = 0; s < kSources; ++s) {
+        for (size_t d = 0; d < kDestinations; ++d) {
+            addInPin(std::format("s{}>d{}", s + 1, d + 1), 0.0f, AuRate::Control);
+        }
+    }
+    for (size_t d = 0; d < kDestinations; ++d) {
+        addOutPin(std::format("d{}", d + 1));
+    }
+}
+
+void AuModMatrix::process(const AuProcessContext& ctx) {
+    const size_t ticks = ctx.ticks();
+    size_t count = 0;
+    for (size_t d = 0; d < kDestinations; ++d) {
+        m_first[d] = (uint8_t)count;
+        for (size_t s = 0; s < kSources; ++s) {
+            const size_t route = s * kDestinations + d;
+            const float* amount = ctx.in(kSources + route);
+            if (m_amounts[route] != 0.0f || std::any_of(amount, amount + ticks, [](float a) { return a != 0.0f; })) {
+                m_routes[count++] = (uint8_t)route;
+            }
+        }
+    }
+    m_first[kDestinations] = (uint8_t)count;
+
+    const int32_t tick_frames = (int32_t)ctx.tick_frames;
+    for (size_t d = 0; d < kDestinations; ++d) {
+        float* out = ctx.out(d);
+        std::fill_n(out, ctx.frames, 0.0f);
+        for (size_t r = m_first[d]; r < m_first[d + 1]; ++r) {
+            const size_t route = m_routes[r];
+            const float* src = ctx.in(route / kDestinations);
+            const float* amount = ctx.in(kSources + route);
+            float from = m_amounts[route];
+            for (size_t t = 0, i = 0; i < ctx.frames; ++t) {
+                const float to = amount[t];
+                const float step = (to - from) / tick_frames;
+                const int32_t n = (int32_t)std::min(ctx.tick_frames, ctx.frames - i);
+                float* y = out + i;
+                const float* x = src + i;
+                for (int32_t k = 0; k < n; ++k) {
+                    y[k] += x[k] * (from + step * (float)(k + 1));
+                }
+                // A partial last tick ends partway up its ramp.
+                from = n == tick_frames ? to : from + step * (float)n;
+                i += n;
+            }
+            m_amounts[route] = from;
+        }
+    }
+}
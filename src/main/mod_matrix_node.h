@@ -0,0 +1,39 @@
+#pragma once
+#include "audio_graph.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Routes kSources modulators to kDestinations outputs, each destination the
+// sum of its sources scaled by their amounts. Amount "sN>dM" is an ordinary
+// control rate input, so it's edited through the graph's lock-free parameter
+// path or modulated itself.
+//
+// Only routes with a nonzero amount in the block, or still ramping down from
+// one, are evaluated: a list of them per destination is gathered each block
+// and each route is one vectorized pass over the block. Amounts ramp from
+// tick to tick per frame, so routes fade in and out without steps.
+class AuModMatrix : public AuNodeBase {
+   public:
+    static constexpr size_t kSources = 8;
+    static constexpr size_t kDestinations = 8;
+    static constexpr size_t kRoutes = kSources * kDestinations;
+
+    AuModMatrix();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "ModMatrix";
+    }
+
+    // Input pin of the amount from source to destination.
+    static size_t amountPin(size_t source, size_t destination) {
+        return kSources + source * kDestinations + destination;
+    }
+
+   private:
+    float m_amounts[kRoutes] = {};  // Reached at the end of the last block
+    // Active routes by destination: those of destination d are
+    // m_routes[m_first[d]] to m_routes[m_first[d + 1]].
+    uint8_t m_routes[kRoutes];
+    uint8_t m_first[kDestinations + 1];
+};
@@ -0,0 +1,104 @@
+#include "node_plugin.h"
+
+#include "shared_library.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <new>
+#include <print>
+
+namespace {
+size_t stateAlignment(const ImsNodeDescriptor* descriptor) {
+    return descriptor->state_alignment ? descriptor->state_alignment : alignof(max_align_t);
+}
+
+bool isValid(const ImsNodeDescriptor* d) {
+    if (!d || d->abi_version != IMS_PLUGIN_ABI_VERSION || !d->type_id || !d->process) {
+        return false;
+    }
+    if ((d->input_count && !d->inputs) || (d->output_count && !d->outputs)) {
+        return false;
+    }
+    size_t align = stateAlignment(d);
+    return (align & (align - 1)) == 0;
+}
+}  // namespace
+
+AuPluginLibrary::~AuPluginLibrary() {
+    if (m_handle) {
+        closeLibrary(m_handle);
+    }
+}
+
+std::shared_ptr<AuPluginLibrary> AuPluginLibrary::open(const std::string& path) {
+    void* handle = openLibrary(path);
+    if (!handle) {
+        std::print("Error: can't load plugin {}\n", path);
+        return nullptr;
+    }
+    std::shared_ptr<AuPluginLibrary> library(new AuPluginLibrary);
+    library->m_path = path;
+    library->m_handle = handle;
+
+    auto get_descriptors = (ImsGetNodeDescriptorsFn)findSymbol(handle, IMS_PLUGIN_ENTRY_POINT);
+    if (!get_descriptors) {
+        std::print("Error: plugin {} has no {}\n", path, IMS_PLUGIN_ENTRY_POINT);
+        return nullptr;
+    }
+    uint32_t count = 0;
+    const ImsNodeDescriptor* const* descriptors = get_descriptors(&count);
+    if (count && !descriptors) {
+        std::print("Error: plugin {} returned no descriptors for a count of {}\n", path, count);
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!isValid(descriptors[i])) {
+            std::print("Error: plugin {} has an invalid descriptor at index {}\n", path, i);
+            continue;
+        }
+        library->m_descriptors.push_back(descriptors[i]);
+    }
+    return library;
+}
+
+AuPluginNode::AuPluginNode(std::shared_ptr<AuPluginLibrary> library, const ImsNodeDescriptor* descriptor)
+    : m_library(library), m_descriptor(descriptor), m_state(nullptr) {
+    for (uint32_t i = 0; i < descriptor->input_count; ++i) {
+        addInPin(descriptor->inputs[i].name ? descriptor->inputs[i].name : "in", descriptor->inputs[i].default_value);
+    }
+    for (uint32_t i = 0; i < descriptor->output_count; ++i) {
+        addOutPin(descriptor->outputs[i].name ? descriptor->outputs[i].name : "out");
+    }
+    size_t size = descriptor->state_size ? descriptor->state_size : 1;
+    m_state = ::operator new(size, std::align_val_t(stateAlignment(descriptor)));
+    resetState(AuGraphConfig().sample_rate);
+}
+
+AuPluginNode::~AuPluginNode() {
+    if (m_descriptor->destroy) {
+        m_descriptor->destroy(m_state);
+    }
+    ::operator delete(m_state, std::align_val_t(stateAlignment(m_descriptor)));
+}
+
+void AuPluginNode::resetState(float sample_rate) {
+    if (m_sample_rate != 0.0f && m_descriptor->destroy) {
+        m_descriptor->destroy(m_state);
+    }
+    memset(m_state, 0, m_descriptor->state_size ? m_descriptor->state_size : 1);
+    if (m_descriptor->init) {
+        m_descriptor->init(m_state, sample_rate);
+    }
+    m_sample_rate = sample_rate;
+}
+
+void AuPluginNode::prepare(const AuGraphConfig& config) {
+    if (config.sample_rate != m_sample_rate) {
+        resetState(config.sample_rate);
+    }
+}
+
+void AuPluginNode::process(const AuProcessContext& ctx) {
+    m_descriptor->process(m_state, ctx.inputs, ctx.outputs, (uint32_t)ctx.frames);
+}
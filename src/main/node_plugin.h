@@ -0,0 +1,61 @@
+#pragma once
+
+#include "audio_graph.h"
+#include "imsynth_plugin.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// A loaded plugin shared library. Stays loaded while any node created from it
+// is alive.
+class AuPluginLibrary {
+   public:
+    ~AuPluginLibrary();
+
+    // Returns nullptr and prints the reason if the library can't be used.
+    static std::shared_ptr<AuPluginLibrary> open(const std::string& path);
+
+    const std::string& path() const {
+        return m_path;
+    }
+
+    const std::vector<const ImsNodeDescriptor*>& descriptors() const {
+        return m_descriptors;
+    }
+
+   private:
+    AuPluginLibrary() = default;
+
+    std::string m_path;
+    void* m_handle = nullptr;
+    std::vector<const ImsNodeDescriptor*> m_descriptors;
+};
+
+// Adapts a plugin node descriptor to AuNode. The plugin state is allocated
+// once at construction, with the size and alignment the plugin declared. It
+// lives with the node like the state of built-in nodes, not in the plan arena:
+// plans and their arenas are replaced on every edit, while plugin state may
+// hold pointers into itself and so can't be copied across.
+class AuPluginNode : public AuNodeBase {
+   public:
+    AuPluginNode(std::shared_ptr<AuPluginLibrary> library, const ImsNodeDescriptor* descriptor);
+    ~AuPluginNode();
+    void prepare(const AuGraphConfig& config) override;
+    void process(const AuProcessContext& ctx) override;
+    // Plugins are initialized for the audio rate they're prepared for.
+    bool fixedRate() const override {
+        return true;
+    }
+    std::string_view name() const {
+        return m_descriptor->type_id;
+    }
+
+   private:
+    void resetState(float sample_rate);
+
+    std::shared_ptr<AuPluginLibrary> m_library;
+    const ImsNodeDescriptor* m_descriptor;
+    void* m_state;
+    float m_sample_rate = 0.0f;
+};
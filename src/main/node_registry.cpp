@@ -0,0 +1,102 @@
+#include "node_registry.h"
+
+#include "convolution_node.h"
+#include "envelope_node.h"
+#include "filter_node.h"
+#include "input_node.h"
+#include "midi_node.h"
+#include "mod_matrix_node.h"
+#include "node_plugin.h"
+#include "noise_node.h"
+#include "sample_node.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <print>
+
+AuNodeRegistry& AuNodeRegistry::instance() {
+    static AuNodeRegistry registry;
+    return registry;
+}
+
+AuNodeRegistry::AuNodeRegistry() {
+    addBuiltinNodes();
+}
+
+void AuNodeRegistry::addBuiltinNodes() {
+    add("MidiIn", "Midi In", [] { return std::make_shared<AuMidiSource>(); });
+    add("MidiRepeat", "Midi Repeat", [] { return std::make_shared<AuMidiRepeater>(); });
+    add("ADSR", "ADSR", [] { return std::make_shared<AuADSR>(); });
+    add("ADSRBank", "ADSR Bank", [] { return std::make_shared<AuADSRBank>(); });
+    add("SineGenerator", "Sine", [] { return std::make_shared<AuSineGenerator>(); });
+    add("HexGenerator", "Hex", [] { return std::make_shared<AuHexGenerator>(); });
+    add("EMAGenerator", "EMA", [] { return std::make_shared<AuEMAGenerator>(); });
+    add("JitterGenerator", "Jitter", [] { return std::make_shared<AuJitterGenerator>(); });
+    add("Sub", "Sub", [] { return std::make_shared<AuSub>(); });
+    add("WhiteNoise", "White Noise", [] { return std::make_shared<AuWhiteNoise>(); });
+    add("PinkNoise", "Pink Noise", [] { return std::make_shared<AuPinkNoise>(); });
+    add("BrownNoise", "Brown Noise", [] { return std::make_shared<AuBrownNoise>(); });
+    add("SampleHold", "Sample & Hold", [] { return std::make_shared<AuSampleHoldNoise>(); });
+    add("SVF", "SVF", [] { return std::make_shared<AuSvf>(); });
+    add("SVFBank", "SVF Bank", [] { return std::make_shared<AuSvfBank>(); });
+    add("Biquad", "Biquad", [] { return std::make_shared<AuBiquad>(); });
+    add("AudioInput", "Audio In", [] { return std::make_shared<AuAudioInput>(); });
+    add("SamplePlayer", "Sample Player", [] { return std::make_shared<AuSamplePlayer>(); });
+    add("ConvolutionReverb", "Convolution Reverb", [] { return std::make_shared<AuConvolutionReverb>(); });
+    add("ModMatrix", "Mod Matrix", [] { return std::make_shared<AuModMatrix>(); });
+}
+
+bool AuNodeRegistry::add(const std::string& type_id, const std::string& display_name, AuNodeFactory factory) {
+    if (find(type_id)) {
+        std::print("Error: node type {} is already registered\n", type_id);
+        return false;
+    }
+    m_entries.push_back({type_id, display_name, std::move(factory)});
+    return true;
+}
+
+const AuNodeRegistry::Entry* AuNodeRegistry::find(std::string_view type_id) const {
+    for (const auto& entry : m_entries) {
+        if (entry.type_id == type_id) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+AuNodePtr AuNodeRegistry::create(std::string_view type_id) const {
+    const Entry* entry = find(type_id);
+    return entry ? entry->factory() : nullptr;
+}
+
+int AuNodeRegistry::loadPlugin(const std::string& path) {
+    auto library = AuPluginLibrary::open(path);
+    if (!library) {
+        return -1;
+    }
+    int count = 0;
+    for (const ImsNodeDescriptor* descriptor : library->descriptors()) {
+        std::string display_name = descriptor->display_name ? descriptor->display_name : descriptor->type_id;
+        if (add(descriptor->type_id, display_name, [library, descriptor] { return std::make_shared<AuPluginNode>(library, descriptor); })) {
+            count++;
+        }
+    }
+    m_libraries.push_back(library);
+    std::print("Loaded {} node types from {}\n", count, path);
+    return count;
+}
+
+int AuNodeRegistry::loadPluginDirectory(const std::string& dir) {
+    std::error_code ec;
+    if (!std::filesystem::is_directory(dir, ec)) {
+        return 0;
+    }
+    int count = 0;
+    for (const auto& file : std::filesystem::directory_iterator(dir, ec)) {
+        auto ext = file.path().extension();
+        if (ext == ".dll" || ext == ".so" || ext == ".dylib") {
+            count += std::max(0, loadPlugin(file.path().string()));
+        }
+    }
+    return count;
+}
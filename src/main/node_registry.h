@@ -0,0 +1,49 @@
+#pragma once
+
+#include "audio_graph.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using AuNodeFactory = std::function<AuNodePtr()>;
+
+class AuPluginLibrary;
+
+// Maps node type ids to factories. The type id of a node is the string
+// returned by AuNode::name(), which is what graph files store, so the UI and
+// serialization both create nodes through here.
+class AuNodeRegistry {
+   public:
+    struct Entry {
+        std::string type_id;
+        std::string display_name;
+        AuNodeFactory factory;
+    };
+
+    static AuNodeRegistry& instance();
+
+    // Returns false if type_id is already registered.
+    bool add(const std::string& type_id, const std::string& display_name, AuNodeFactory factory);
+    const Entry* find(std::string_view type_id) const;
+    AuNodePtr create(std::string_view type_id) const;
+
+    const std::vector<Entry>& entries() const {
+        return m_entries;
+    }
+
+    // Loads a node plugin library and registers all of its node types.
+    // Returns the number of registered types, or -1 on error.
+    int loadPlugin(const std::string& path);
+    // Loads every plugin library in dir. Returns the number of registered types.
+    int loadPluginDirectory(const std::string& dir);
+
+   private:
+    AuNodeRegistry();
+    void addBuiltinNodes();
+
+    std::vector<Entry> m_entries;
+    std::vector<std::shared_ptr<AuPluginLibrary>> m_libraries;
+};
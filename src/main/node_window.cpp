@@ -1,8 +1,13 @@
 #include "node_window.h"
 
 #include "audio_engine.h"
+#include "graph_io.h"
+#include "node_registry.h"
 
 #include <imgui.h>
+#include <misc/cpp/imgui_stdlib.h>
+
+#include <string>
 
 class NodeWindow_impl : public NodeWindow {
    public:
@@ -12,6 +17,8 @@ class NodeWindow_impl : public NodeWindow {
 
    private:
     AudioEngine& m_audio;
+    std::string m_graph_file = "imsynth-graph.txt";
+    std::string m_plugin_file;
 };
 
 std::unique_ptr<NodeWindow> NodeWindow::create(AudioEngine& audio_engine) {
@@ -27,9 +34,37 @@ NodeWindow_impl::~NodeWindow_impl() {
 
 void NodeWindow_impl::frame() {
     ImGui::Begin("Nodes");
-    if (ImGui::Button("ADSR")) m_audio.getGraph()->addNode(std::make_shared<AuADSR>());
-    if (ImGui::Button("Sine")) m_audio.getGraph()->addNode(std::make_shared<AuSineGenerator>());
-    if (ImGui::Button("Hex")) m_audio.getGraph()->addNode(std::make_shared<AuHexGenerator>());
-    if (ImGui::Button("Sub")) m_audio.getGraph()->addNode(std::make_shared<AuSub>());
+    for (const auto& entry : AuNodeRegistry::instance().entries()) {
+        if (ImGui::Button(entry.display_name.c_str())) m_audio.getGraph()->addNode(entry.factory());
+    }
+
+    ImGui::Separator();
+    ImGui::SetNextItemWidth(160);
+    ImGui::InputText("##graph_file", &m_graph_file);
+    ImGui::SameLine();
+    if (ImGui::Button("Save")) saveGraph(*m_audio.getGraph(), m_graph_file);
+    ImGui::SameLine();
+    if (ImGui::Button("Load")) {
+        if (AuNodeGraphPtr graph = loadGraph(m_graph_file)) {
+            m_audio.setGraph(graph);
+        }
+    }
+
+    ImGui::SetNextItemWidth(160);
+    ImGui::InputText("##plugin_file", &m_plugin_file);
+    ImGui::SameLine();
+    if (ImGui::Button("Load plugin")) AuNodeRegistry::instance().loadPlugin(m_plugin_file);
+
+    auto stats = m_audio.getGraph()->stats();
+    ImGui::Text("Audio rate nodes: %zu, control rate nodes: %zu", stats.audio_nodes, stats.control_nodes);
+    ImGui::Text("Specialized nodes: %zu", stats.specialized_nodes);
+    ImGui::Text("Oversampled nodes: %zu, latency: %.1f frames", stats.oversampled_nodes, stats.latency);
+    ImGui::Text("Last compile: %.3f ms, %s", stats.compile_ms, stats.patched ? "patched" : "full");
+    bool jit = m_audio.getGraph()->jit() != nullptr;
+    if (ImGui::Checkbox("JIT", &jit)) m_audio.getGraph()->setJit(jit);
+    if (jit) {
+        ImGui::SameLine();
+        ImGui::Text("%zu nodes fused in %zu kernels, %zu compiling", stats.fused_nodes, stats.fused_kernels, stats.jit_pending);
+    }
     ImGui::End();
 }
@@ -0,0 +1,170 @@
+#include "noise_node.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+
+namespace {
+
+uint64_t splitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+}  // namespace
+
+AuRandom::AuRandom(uint64_t seed) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        uint64_t a = splitMix64(seed);
+        uint64_t b = splitMix64(seed);
+        m_s0[lane] = (uint32_t)a;
+        m_s1[lane] = (uint32_t)(a >> 32);
+        m_s2[lane] = (uint32_t)b;
+        m_s3[lane] = (uint32_t)(b >> 32) | 1;  // Never all zero
+    }
+}
+
+uint64_t AuRandom::nextSeed() {
+    static std::atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, std::memory_order_relaxed) * 0x2545F4914F6CDD1Dull + 1;
+}
+
+void AuRandom::advance(float* out) {
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+        uint32_t result = m_s0[lane] + m_s3[lane];
+        uint32_t t = m_s1[lane] << 9;
+        m_s2[lane] ^= m_s0[lane];
+        m_s3[lane] ^= m_s1[lane];
+        m_s1[lane] ^= m_s2[lane];
+        m_s0[lane] ^= m_s3[lane];
+        m_s2[lane] ^= t;
+        m_s3[lane] = (m_s3[lane] << 11) | (m_s3[lane] >> 21);
+        // Top 23 bits as the mantissa of a float in [2, 4), shifted to [-1, 1).
+        out[lane] = std::bit_cast<float>((result >> 9) | 0x40000000u) - 3.0f;
+    }
+}
+
+void AuRandom::fill(float* out, size_t frames) {
+    size_t i = 0;
+    for (; i + kLanes <= frames; i += kLanes) {
+        advance(out + i);
+    }
+    if (i < frames) {
+        float tail[kLanes];
+        advance(tail);
+        memcpy(out + i, tail, (frames - i) * sizeof(float));
+    }
+}
+
+float AuRandom::next() {
+    if (m_spare_used == kLanes) {
+        advance(m_spare);
+        m_spare_used = 0;
+    }
+    return m_spare[m_spare_used++];
+}
+
+AuNoiseNode::AuNoiseNode() : m_random(AuRandom::nextSeed()) {}
+
+void AuNoiseNode::prepare(const AuGraphConfig& config) {
+    // Pink noise draws two values per frame.
+    m_block.resize(2 * config.max_frames);
+}
+
+const float* AuNoiseNode::random(size_t frames) {
+    m_random.fill(m_block.data(), frames);
+    return m_block.data();
+}
+
+AuWhiteNoise::AuWhiteNoise() {
+    addInPin("amplitude", 1.0);
+    addOutPin("out");
+}
+
+void AuWhiteNoise::process(const AuProcessContext& ctx) {
+    const float* amp = ctx.in(0);
+    float* out = ctx.out(0);
+    m_random.fill(out, ctx.frames);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] *= amp[i];
+    }
+}
+
+AuPinkNoise::AuPinkNoise() {
+    addInPin("amplitude", 1.0);
+    addOutPin("out");
+}
+
+void AuPinkNoise::process(const AuProcessContext& ctx) {
+    const float* amp = ctx.in(0);
+    float* out = ctx.out(0);
+    const float* rows = random(2 * ctx.frames);
+    const float* white = rows + ctx.frames;
+    // kRows + 1 uniform terms, scaled to the loudness of white noise.
+    const float scale = 1.0f / 4.1231f;
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        size_t row = std::countr_zero(++m_counter);
+        if (row < kRows) {
+            m_sum += rows[i] - m_rows[row];
+            m_rows[row] = rows[i];
+        }
+        out[i] = (m_sum + white[i]) * scale * amp[i];
+    }
+}
+
+AuBrownNoise::AuBrownNoise() {
+    addInPin("amplitude", 1.0);
+    addOutPin("out");
+}
+
+void AuBrownNoise::process(const AuProcessContext& ctx) {
+    const float* amp = ctx.in(0);
+    float* out = ctx.out(0);
+    const float* white = random(ctx.frames);
+    // Leaky integrator, the leak keeps it from drifting off.
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        m_previous = (m_previous + 0.02f * white[i]) * (1.0f / 1.02f);
+        out[i] = m_previous * 6.0f * amp[i];
+    }
+}
+
+AuSampleHoldNoise::AuSampleHoldNoise() {
+    addInPin("rate", 10.0, AuRate::Control);
+    addInPin("amplitude", 1.0);
+    addOutPin("out");
+}
+
+void AuSampleHoldNoise::process(const AuProcessContext& ctx) {
+    const float* rate = ctx.in(0);
+    const float* amp = ctx.in(1);
+    float* out = ctx.out(0);
+    const float dt = 1.0f / ctx.sample_rate;
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        m_phase += rate[i / ctx.tick_frames] * dt;
+        if (m_phase >= 1.0f) {
+            m_phase -= floorf(m_phase);
+            m_value = m_random.next();
+        }
+        out[i] = m_value * amp[i];
+    }
+}
+
+AuJitterGenerator::AuJitterGenerator() {
+    addInPin("input", 1.0);
+    addInPin("jitter", 0.1);
+    addOutPin("out");
+}
+
+void AuJitterGenerator::process(const AuProcessContext& ctx) {
+    const float* input = ctx.in(0);
+    const float* jitter = ctx.in(1);
+    float* out = ctx.out(0);
+    const float* white = random(ctx.frames);
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] = input[i] + 0.5f * jitter[i] * input[i] * white[i];
+    }
+}
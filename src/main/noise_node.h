@@ -0,0 +1,109 @@
+#pragma once
+#include "audio_graph.h"
+
+#include <stdint.h>
+
+#include <vector>
+
+// xoshiro128+ running kLanes independent streams side by side, so filling a
+// block is a plain loop over lanes the compiler turns into SIMD code. Each
+// node owns one, seeded from the order nodes are created in.
+class AuRandom {
+   public:
+    static const size_t kLanes = 8;
+
+    explicit AuRandom(uint64_t seed);
+
+    // Uniform values in [-1, 1).
+    void fill(float* out, size_t frames);
+    float next();
+
+    // A new seed on every call, for nodes that don't get one.
+    static uint64_t nextSeed();
+
+   private:
+    void advance(float* out);
+
+    alignas(32) uint32_t m_s0[kLanes];
+    alignas(32) uint32_t m_s1[kLanes];
+    alignas(32) uint32_t m_s2[kLanes];
+    alignas(32) uint32_t m_s3[kLanes];
+    alignas(32) float m_spare[kLanes];
+    size_t m_spare_used = kLanes;
+};
+
+// Base for noise nodes: the random block for the current process() call.
+class AuNoiseNode : public AuNodeBase {
+   public:
+    AuNoiseNode();
+    void prepare(const AuGraphConfig& config) override;
+
+   protected:
+    // Fills and returns frames random values, valid until the next call.
+    const float* random(size_t frames);
+
+    AuRandom m_random;
+    std::vector<float> m_block;
+};
+
+class AuWhiteNoise : public AuNoiseNode {
+   public:
+    AuWhiteNoise();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "WhiteNoise";
+    }
+};
+
+// Voss-McCartney: kRows white sources, row k redrawn every 2^k samples, so
+// each sample only updates one row and the running sum.
+class AuPinkNoise : public AuNoiseNode {
+   public:
+    AuPinkNoise();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "PinkNoise";
+    }
+
+   private:
+    static const size_t kRows = 16;
+    float m_rows[kRows] = {};
+    float m_sum = 0.0f;
+    uint32_t m_counter = 0;
+};
+
+class AuBrownNoise : public AuNoiseNode {
+   public:
+    AuBrownNoise();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "BrownNoise";
+    }
+
+   private:
+    float m_previous = 0.0f;
+};
+
+// A new random value rate times per second, held in between.
+class AuSampleHoldNoise : public AuNoiseNode {
+   public:
+    AuSampleHoldNoise();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "SampleHold";
+    }
+
+   private:
+    float m_phase = 1.0f;
+    float m_value = 0.0f;
+};
+
+// input plus up to +-jitter / 2 of itself in white noise.
+class AuJitterGenerator : public AuNoiseNode {
+   public:
+    AuJitterGenerator();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view name() const {
+        return "JitterGenerator";
+    }
+};
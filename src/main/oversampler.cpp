@@ -0,0 +1,112 @@
+#include "oversampler.h"
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <string.h>
+
+#include <array>
+
+namespace {
+
+const size_t kTaps = AuHalfband::kTaps;
+const size_t kUpHistory = 2 * kTaps - 1;
+const size_t kDownHistory = 4 * kTaps - 2;
+
+// Odd taps 1, 3, 5, ... of a Blackman windowed halfband sinc, normalized so
+// the filter has unity gain at DC.
+const std::array<float, kTaps>& coefficients() {
+    static const std::array<float, kTaps> c = [] {
+        std::array<float, kTaps> c;
+        double sum = 0.0;
+        for (size_t j = 0; j < kTaps; ++j) {
+            double m = 2.0 * j + 1.0;
+            double x = M_PI * m / (2.0 * kTaps);
+            double window = 0.42 + 0.5 * cos(x) + 0.08 * cos(2.0 * x);
+            double h = sin(M_PI * m / 2.0) / (M_PI * m) * window;
+            c[j] = (float)h;
+            sum += h;
+        }
+        for (float& v : c) {
+            v = (float)(v * 0.25 / sum);
+        }
+        return c;
+    }();
+    return c;
+}
+
+}  // namespace
+
+AuHalfband::AuHalfband(size_t max_frames) : m_work(kDownHistory + 2 * max_frames, 0.0f) {
+    coefficients();
+}
+
+void AuHalfband::up(const float* in, float* out, size_t frames) {
+    const auto& c = coefficients();
+    float* w = m_work.data();
+    memcpy(w + kUpHistory, in, frames * sizeof(float));
+    for (size_t i = 0; i < frames; ++i) {
+        const float* p = w + kTaps - 1 + i;
+        float odd = 0.0f;
+        for (size_t j = 0; j < kTaps; ++j) {
+            odd += c[j] * (p[-(ptrdiff_t)j] + p[1 + j]);
+        }
+        out[2 * i] = p[0];
+        out[2 * i + 1] = 2.0f * odd;
+    }
+    memmove(w, w + frames, kUpHistory * sizeof(float));
+}
+
+void AuHalfband::down(const float* in, float* out, size_t frames) {
+    const auto& c = coefficients();
+    float* w = m_work.data();
+    memcpy(w + kDownHistory, in, 2 * frames * sizeof(float));
+    for (size_t i = 0; i < frames; ++i) {
+        const float* q = w + 2 * kTaps + 2 * i;
+        float sum = 0.5f * q[0];
+        for (size_t j = 0; j < kTaps; ++j) {
+            sum += c[j] * (q[-(ptrdiff_t)(2 * j + 1)] + q[2 * j + 1]);
+        }
+        out[i] = sum;
+    }
+    memmove(w, w + 2 * frames, kDownHistory * sizeof(float));
+}
+
+AuResampler::AuResampler(size_t factor, bool up, size_t max_frames) : m_factor(factor), m_up(up) {
+    for (size_t s = 0; (size_t)2 << s <= factor; ++s) {
+        m_stages.emplace_back(max_frames * lowRate(s));
+    }
+    m_temp[0].resize(max_frames * factor);
+    m_temp[1].resize(max_frames * factor);
+}
+
+size_t AuResampler::lowRate(size_t stage, size_t factor, bool up) {
+    return up ? (size_t)1 << stage : factor >> (stage + 1);
+}
+
+void AuResampler::process(const float* in, float* out, size_t frames) {
+    const size_t stages = m_stages.size();
+    if (stages == 0) {
+        memcpy(out, in, frames * sizeof(float));
+        return;
+    }
+    // Ping-pong through the temp buffers, the last stage writes out.
+    const float* src = in;
+    for (size_t s = 0; s < stages; ++s) {
+        float* dst = s + 1 == stages ? out : m_temp[s % 2].data();
+        if (m_up) {
+            m_stages[s].up(src, dst, frames * lowRate(s));
+        } else {
+            m_stages[s].down(src, dst, frames * lowRate(s));
+        }
+        src = dst;
+    }
+}
+
+float AuResampler::latency(size_t factor, bool up) {
+    float latency = 0.0f;
+    for (size_t s = 0; (size_t)2 << s <= factor; ++s) {
+        float delay = up ? AuHalfband::upLatency() : AuHalfband::downLatency();
+        latency += delay / (float)lowRate(s, factor, up);
+    }
+    return latency;
+}
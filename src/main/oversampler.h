@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+// One 2x stage of a halfband FIR, run polyphase: only the odd taps are non
+// zero besides the centre, so upsampling copies the even phase and filters
+// the odd one, and downsampling only filters at the output rate.
+class AuHalfband {
+   public:
+    // Non zero odd taps on each side of the centre.
+    static const size_t kTaps = 8;
+
+    explicit AuHalfband(size_t max_frames);
+
+    // frames in, 2 * frames out.
+    void up(const float* in, float* out, size_t frames);
+    // 2 * frames in, frames out.
+    void down(const float* in, float* out, size_t frames);
+
+    // Delays in samples at the lower of the two rates.
+    static float upLatency() {
+        return (float)kTaps;
+    }
+    static float downLatency() {
+        return (float)(kTaps - 1);
+    }
+
+   private:
+    std::vector<float> m_work;  // History followed by the current block
+};
+
+// Cascade of 2x stages, from the engine rate up to factor times it or back.
+class AuResampler {
+   public:
+    AuResampler(size_t factor, bool up, size_t max_frames);
+
+    // frames are counted at the engine rate, the other side has
+    // frames * factor samples.
+    void process(const float* in, float* out, size_t frames);
+
+    // Delay in samples at the engine rate.
+    float latency() const {
+        return latency(m_factor, m_up);
+    }
+    static float latency(size_t factor, bool up);
+
+    size_t factor() const {
+        return m_factor;
+    }
+
+   private:
+    // Stage s runs between lowRate(s) and 2 * lowRate(s) times the engine rate.
+    size_t lowRate(size_t stage) const {
+        return lowRate(stage, m_factor, m_up);
+    }
+    static size_t lowRate(size_t stage, size_t factor, bool up);
+
+    size_t m_factor;
+    bool m_up;
+    std::vector<AuHalfband> m_stages;
+    std::vector<float> m_temp[2];
+};
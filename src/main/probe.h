@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+
+// The tail of one block of a probed output, see AuNodeGraph::setProbe().
+struct AuProbeSnapshot {
+    static constexpr size_t kMaxValues = 512;
+
+    uint64_t block = 0;  // Blocks published before this one, 0 if none was
+    size_t count = 0;  // Values in data, the last ones of the block
+    size_t frames = 0;  // Values in the whole block
+    float data[kMaxValues];
+
+    float last() const {
+        return count ? data[count - 1] : 0.0f;
+    }
+};
+
+// Receives every whole block a probe publishes, on the audio thread, see
+// AuProbe::setTap(). Must not block.
+class AuProbeTap {
+   public:
+    virtual ~AuProbeTap() {}
+    virtual void write(const float* values, size_t count, float sample_rate) = 0;
+};
+
+// Hands block snapshots from the audio thread to the UI without locks: a
+// triple buffer. The audio thread fills its own snapshot and swaps it with the
+// shared one, the UI swaps the shared one for its own when it's newer. Neither
+// side ever waits, and the UI sees whole blocks.
+class AuProbe {
+   public:
+    // Audio thread. One copy of at most kMaxValues floats, and the whole
+    // block to the tap if there is one. sample_rate is the block's own rate,
+    // oversampled or control.
+    void publish(const float* values, size_t count, float sample_rate) {
+        if (AuProbeTap* tap = m_tap.load(std::memory_order_acquire)) {
+            tap->write(values, count, sample_rate);
+        }
+        AuProbeSnapshot& snapshot = m_snapshots[m_back];
+        snapshot.block = ++m_blocks;
+        snapshot.frames = count;
+        snapshot.count = std::min(count, AuProbeSnapshot::kMaxValues);
+        std::copy_n(values + count - snapshot.count, snapshot.count, snapshot.data);
+        m_back = m_shared.exchange(m_back | kFresh, std::memory_order_acq_rel) & kIndex;
+    }
+
+    // UI thread. The latest published snapshot, or the one returned last time
+    // if nothing new was published.
+    const AuProbeSnapshot& read() {
+        if (m_shared.load(std::memory_order_relaxed) & kFresh) {
+            m_front = m_shared.exchange(m_front, std::memory_order_acq_rel) & kIndex;
+        }
+        return m_snapshots[m_front];
+    }
+
+    // Any thread. The tap may still be written to until the audio thread
+    // finishes the block it's in.
+    void setTap(AuProbeTap* tap) {
+        m_tap.store(tap, std::memory_order_release);
+    }
+
+   private:
+    static constexpr uint32_t kIndex = 3;
+    static constexpr uint32_t kFresh = 4;
+
+    AuProbeSnapshot m_snapshots[3];
+    alignas(64) std::atomic<uint32_t> m_shared{1};
+    std::atomic<AuProbeTap*> m_tap{nullptr};
+    alignas(64) uint32_t m_back = 0;  // Audio thread
+    uint64_t m_blocks = 0;  // Audio thread
+    alignas(64) uint32_t m_front = 2;  // UI thread
+};
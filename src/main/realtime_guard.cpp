@@ -0,0 +1,365 @@
+#include "realtime_guard.h"
+
+#if defined(IMSYNTH_REALTIME_GUARD)
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <print>
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void __libc_free(void* ptr);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+#elif defined(_WIN32)
+#include <Windows.h>
+#include <malloc.h>
+#endif
+
+namespace {
+
+const size_t kMaxRecords = 64;
+const int kMaxFrames = 32;
+
+struct Record {
+    const char* what;
+    void* frames[kMaxFrames];
+    int depth;
+    std::atomic<bool> ready;
+};
+
+// Records are written once and never reused, later violations are only
+// counted. Everything here has static storage so recording doesn't allocate.
+Record g_records[kMaxRecords];
+std::atomic<size_t> g_violations{0};
+size_t g_reported = 0;
+
+thread_local int t_realtime = 0;
+thread_local bool t_recording = false;
+
+int captureStack(void** frames, int size) {
+#if defined(__GLIBC__)
+    return backtrace(frames, size);
+#elif defined(_WIN32)
+    return CaptureStackBackTrace(1, size, frames, nullptr);
+#else
+    return 0;
+#endif
+}
+
+void printStack(void* const* frames, int depth) {
+#if defined(__GLIBC__)
+    fflush(stdout);
+    backtrace_symbols_fd(frames, depth, fileno(stdout));
+#else
+    for (int i = 0; i < depth; ++i) {
+        std::print("  {}\n", (const void*)frames[i]);
+    }
+#endif
+}
+
+void violation(const char* what) {
+    if (t_realtime == 0 || t_recording) {
+        return;
+    }
+    t_recording = true;
+    size_t index = g_violations.fetch_add(1, std::memory_order_relaxed);
+    if (index < kMaxRecords) {
+        Record& record = g_records[index];
+        record.what = what;
+        record.depth = captureStack(record.frames, kMaxFrames);
+        record.ready.store(true, std::memory_order_release);
+    }
+    t_recording = false;
+}
+
+void* rawMalloc(size_t size) {
+#if defined(__GLIBC__)
+    return __libc_malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+void rawFree(void* ptr) {
+#if defined(__GLIBC__)
+    __libc_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+void* rawAlignedMalloc(size_t size, size_t alignment) {
+#if defined(__GLIBC__)
+    return __libc_memalign(alignment, size);
+#elif defined(_WIN32)
+    return _aligned_malloc(size, alignment);
+#else
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+void rawAlignedFree(void* ptr) {
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    rawFree(ptr);
+#endif
+}
+
+void* checkedNew(size_t size) {
+    violation("operator new");
+    if (void* ptr = rawMalloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* checkedAlignedNew(size_t size, std::align_val_t alignment) {
+    violation("operator new");
+    if (void* ptr = rawAlignedMalloc(size ? size : 1, (size_t)alignment)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void checkedDelete(void* ptr) {
+    if (ptr) {
+        violation("operator delete");
+        rawFree(ptr);
+    }
+}
+
+void checkedAlignedDelete(void* ptr) {
+    if (ptr) {
+        violation("operator delete");
+        rawAlignedFree(ptr);
+    }
+}
+
+}  // namespace
+
+AuRealtimeScope::AuRealtimeScope() {
+    t_realtime++;
+}
+
+AuRealtimeScope::~AuRealtimeScope() {
+    t_realtime--;
+}
+
+size_t realtimeViolations() {
+    return g_violations.load(std::memory_order_relaxed);
+}
+
+size_t reportRealtimeViolations() {
+    const size_t total = g_violations.load(std::memory_order_relaxed);
+    if (total == g_reported) {
+        return 0;
+    }
+    size_t reported = g_reported;
+    for (; reported < std::min(total, kMaxRecords); ++reported) {
+        const Record& record = g_records[reported];
+        if (!record.ready.load(std::memory_order_acquire)) {
+            break;  // Still being written, pick it up next time
+        }
+        std::print("Error: realtime violation: {}\n", record.what);
+        printStack(record.frames, record.depth);
+    }
+    if (total > kMaxRecords && reported == kMaxRecords) {
+        std::print("Error: {} more realtime violations without stack traces\n", total - std::max(g_reported, kMaxRecords));
+        reported = total;
+    }
+    const size_t count = reported - g_reported;
+    g_reported = reported;
+    return count;
+}
+
+void* operator new(size_t size) {
+    return checkedNew(size);
+}
+
+void* operator new[](size_t size) {
+    return checkedNew(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    violation("operator new");
+    return rawMalloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    violation("operator new");
+    return rawMalloc(size ? size : 1);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return checkedAlignedNew(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return checkedAlignedNew(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    checkedDelete(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    checkedAlignedDelete(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    checkedAlignedDelete(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    checkedAlignedDelete(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    checkedAlignedDelete(ptr);
+}
+
+#if defined(__GLIBC__)
+
+// Interposed libc functions. The allocator has __libc_ entry points, the rest
+// are looked up with RTLD_NEXT, once at startup before any realtime thread
+// exists and again lazily for calls made before that.
+namespace {
+
+template <typename F>
+F next(std::atomic<F>& cache, const char* name) {
+    F f = cache.load(std::memory_order_relaxed);
+    if (!f) {
+        f = (F)dlsym(RTLD_NEXT, name);
+        cache.store(f, std::memory_order_relaxed);
+    }
+    return f;
+}
+
+std::atomic<int (*)(pthread_mutex_t*)> g_pthread_mutex_lock;
+std::atomic<ssize_t (*)(int, void*, size_t)> g_read;
+std::atomic<ssize_t (*)(int, const void*, size_t)> g_write;
+std::atomic<int (*)(const struct timespec*, struct timespec*)> g_nanosleep;
+std::atomic<int (*)(useconds_t)> g_usleep;
+std::atomic<int (*)(struct pollfd*, nfds_t, int)> g_poll;
+
+__attribute__((constructor)) void resolveNext() {
+    next(g_pthread_mutex_lock, "pthread_mutex_lock");
+    next(g_read, "read");
+    next(g_write, "write");
+    next(g_nanosleep, "nanosleep");
+    next(g_usleep, "usleep");
+    next(g_poll, "poll");
+    // backtrace() loads the unwinder on first use, which allocates.
+    void* frames[1];
+    backtrace(frames, 1);
+}
+
+}  // namespace
+
+extern "C" {
+
+void* malloc(size_t size) {
+    violation("malloc");
+    return rawMalloc(size);
+}
+
+void free(void* ptr) {
+    if (ptr) {
+        violation("free");
+    }
+    rawFree(ptr);
+}
+
+void* calloc(size_t count, size_t size) {
+    violation("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    violation("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    violation("aligned_alloc");
+    return rawAlignedMalloc(size, alignment);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    violation("posix_memalign");
+    *ptr = rawAlignedMalloc(size, alignment);
+    return *ptr ? 0 : ENOMEM;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+    violation("pthread_mutex_lock");
+    return next(g_pthread_mutex_lock, "pthread_mutex_lock")(mutex);
+}
+
+ssize_t read(int fd, void* buf, size_t count) {
+    violation("read");
+    return next(g_read, "read")(fd, buf, count);
+}
+
+ssize_t write(int fd, const void* buf, size_t count) {
+    violation("write");
+    return next(g_write, "write")(fd, buf, count);
+}
+
+int nanosleep(const struct timespec* duration, struct timespec* remaining) {
+    violation("nanosleep");
+    return next(g_nanosleep, "nanosleep")(duration, remaining);
+}
+
+int usleep(useconds_t usec) {
+    violation("usleep");
+    return next(g_usleep, "usleep")(usec);
+}
+
+int poll(struct pollfd* fds, nfds_t count, int timeout) {
+    violation("poll");
+    return next(g_poll, "poll")(fds, count, timeout);
+}
+
+}  // extern "C"
+
+#endif  // __GLIBC__
+
+#endif  // IMSYNTH_REALTIME_GUARD
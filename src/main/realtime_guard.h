@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+
+// Debug check that the audio thread stays realtime safe. When built with
+// IMSYNTH_REALTIME_GUARD, heap allocation, mutex locks and blocking syscalls
+// made while an AuRealtimeScope is alive on the calling thread are recorded
+// with a stack trace. Without it the scope compiles to nothing.
+//
+// operator new/delete are checked everywhere. malloc/free, pthread_mutex_lock
+// and the syscalls are only intercepted on glibc.
+
+#if defined(IMSYNTH_REALTIME_GUARD)
+
+class AuRealtimeScope {
+   public:
+    AuRealtimeScope();
+    ~AuRealtimeScope();
+    AuRealtimeScope(const AuRealtimeScope&) = delete;
+    AuRealtimeScope& operator=(const AuRealtimeScope&) = delete;
+};
+
+constexpr bool kRealtimeGuard = true;
+
+// Total number of violations since start, any thread.
+size_t realtimeViolations();
+
+// Prints violations recorded since the last call with their stack traces and
+// returns how many there were. Not realtime safe.
+size_t reportRealtimeViolations();
+
+#else
+
+class AuRealtimeScope {
+   public:
+    AuRealtimeScope() {}
+};
+
+constexpr bool kRealtimeGuard = false;
+
+inline size_t realtimeViolations() {
+    return 0;
+}
+
+inline size_t reportRealtimeViolations() {
+    return 0;
+}
+
+#endif
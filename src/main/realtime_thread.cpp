@@ -0,0 +1,166 @@
+#include "realtime_thread.h"
+
+#include <string.h>
+
+#include <atomic>
+#include <print>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+// Error codes of the last failed setup, 0 if it worked. GetLastError() on
+// Windows, errno elsewhere.
+std::atomic<int> g_priority_error{0};
+std::atomic<int> g_priority{0};
+std::atomic<int> g_affinity_error{0};
+std::atomic<int> g_cpu{0};
+
+const size_t kStackPrefault = 64 * 1024;
+
+// Touches the stack pages the callback is likely to use, so the first deep
+// call doesn't fault.
+#if defined(_MSC_VER)
+__declspec(noinline)
+#else
+__attribute__((noinline))
+#endif
+void prefaultStack() {
+    volatile char stack[kStackPrefault];
+    for (size_t i = 0; i < kStackPrefault; i += 4096) {
+        stack[i] = 0;
+    }
+    (void)stack[0];
+}
+
+bool setRealtimePriority(int priority) {
+#if defined(_WIN32)
+    if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+        g_priority_error.store((int)GetLastError(), std::memory_order_relaxed);
+        return false;
+    }
+#else
+    sched_param param = {};
+    param.sched_priority = priority;
+    if (int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param)) {
+        g_priority_error.store(error, std::memory_order_relaxed);
+        return false;
+    }
+#endif
+    return true;
+}
+
+bool setAffinity(int cpu) {
+#if defined(_WIN32)
+    if (!SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu)) {
+        g_affinity_error.store((int)GetLastError(), std::memory_order_relaxed);
+        return false;
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        g_affinity_error.store(error, std::memory_order_relaxed);
+        return false;
+    }
+#else
+    g_affinity_error.store(ENOTSUP, std::memory_order_relaxed);
+    return false;
+#endif
+    return true;
+}
+
+#if !defined(_WIN32)
+void printPriorityHint(int priority) {
+    rlimit limit = {};
+    getrlimit(RLIMIT_RTPRIO, &limit);
+    std::print("  RLIMIT_RTPRIO is {}. Run with CAP_SYS_NICE, or allow it in /etc/security/limits.conf:\n",
+               limit.rlim_cur == RLIM_INFINITY ? -1 : (long long)limit.rlim_cur);
+    std::print("    @audio - rtprio {}\n", priority);
+}
+#endif
+}  // namespace
+
+void setupAudioThread(const AuThreadOptions& options) {
+    setFlushDenormals(options.flush_denormals);
+    if (options.realtime) {
+        g_priority.store(options.priority, std::memory_order_relaxed);
+        setRealtimePriority(options.priority);
+    }
+    if (options.cpu >= 0) {
+        g_cpu.store(options.cpu, std::memory_order_relaxed);
+        setAffinity(options.cpu);
+    }
+    prefaultStack();
+}
+
+bool reportThreadSetup() {
+    bool ok = true;
+    if (int error = g_priority_error.exchange(0, std::memory_order_relaxed)) {
+        const int priority = g_priority.load(std::memory_order_relaxed);
+#if defined(_WIN32)
+        std::print("Error: can't raise the audio thread priority (error {})\n", error);
+#else
+        std::print("Error: can't run the audio thread with SCHED_FIFO priority {}: {}\n", priority, strerror(error));
+        if (error == EPERM) {
+            printPriorityHint(priority);
+        }
+#endif
+        ok = false;
+    }
+    if (int error = g_affinity_error.exchange(0, std::memory_order_relaxed)) {
+        const int cpu = g_cpu.load(std::memory_order_relaxed);
+#if defined(_WIN32)
+        std::print("Error: can't pin the audio thread to CPU {} (error {})\n", cpu, error);
+#else
+        std::print("Error: can't pin the audio thread to CPU {}: {}\n", cpu, strerror(error));
+#endif
+        ok = false;
+    }
+    return ok;
+}
+
+void setFlushDenormals(bool enable) {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    const unsigned int bits = _MM_FLUSH_ZERO_ON | 0x0040;  // FTZ and DAZ
+    _mm_setcsr(enable ? _mm_getcsr() | bits : _mm_getcsr() & ~bits);
+#elif defined(__aarch64__)
+    // FZ flushes both inputs and results on AArch64.
+    unsigned long long fpcr;
+    __asm__ volatile("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr = enable ? fpcr | (1ull << 24) : fpcr & ~(1ull << 24);
+    __asm__ volatile("msr fpcr, %0" : : "r"(fpcr));
+#endif
+}
+
+bool lockMemory() {
+#if defined(_WIN32)
+    std::print("Error: locking memory is not supported on Windows\n");
+    return false;
+#else
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        const int error = errno;
+        rlimit limit = {};
+        getrlimit(RLIMIT_MEMLOCK, &limit);
+        std::print("Error: can't lock memory: {}\n", strerror(error));
+        std::print("  RLIMIT_MEMLOCK is {} kB. Run with CAP_IPC_LOCK or raise it with ulimit -l or memlock in\n",
+                   limit.rlim_cur == RLIM_INFINITY ? -1 : (long long)(limit.rlim_cur / 1024));
+        std::print("  /etc/security/limits.conf.\n");
+        return false;
+    }
+    return true;
+#endif
+}
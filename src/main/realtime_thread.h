@@ -0,0 +1,27 @@
+#pragma once
+
+// Scheduling, memory and floating point setup for threads that render audio.
+
+struct AuThreadOptions {
+    bool realtime = false;  // SCHED_FIFO on Linux, time critical priority on Windows
+    int priority = 70;  // SCHED_FIFO priority, 1 to 99
+    int cpu = -1;  // Core to pin the thread to, or -1 for any
+    bool flush_denormals = true;  // FTZ and DAZ
+};
+
+// Applies options to the calling thread and pre-faults its stack. Meant to
+// run once when an audio thread starts. Nothing is printed here since audio
+// threads can't print; failures are kept for reportThreadSetup().
+void setupAudioThread(const AuThreadOptions& options);
+
+// Prints setup failures recorded since the last call, with what's missing to
+// fix them. Returns false if there were any. Not realtime safe.
+bool reportThreadSetup();
+
+// Sets FTZ and DAZ for the calling thread, or restores IEEE denormals.
+void setFlushDenormals(bool enable);
+
+// Locks current and future pages of the process in RAM so the audio thread
+// never waits for a page fault. Prints the reason and returns false if it
+// isn't permitted.
+bool lockMemory();
@@ -0,0 +1,348 @@
+#include "sample_node.h"
+
+#include <algorithm>
+#include <chrono>
+#include <print>
+#define NOMINMAX
+#include <miniaudio.h>
+
+namespace {
+
+// Catmull-Rom at x0 + k * step frames into src for each output frame k. src
+// must hold the frames up to 2 past the last position. Runs kLanes frames at
+// a time: only fetching the taps is per frame, positions and the polynomial
+// are plain loops over lanes the compiler turns into SIMD code.
+void interpolate(const float* src, float x0, float step, float* out, size_t frames) {
+    const size_t kLanes = 8;
+    for (size_t first = 0; first < frames; first += kLanes) {
+        const size_t lanes = std::min(kLanes, frames - first);
+        alignas(32) int32_t j[kLanes];
+        alignas(32) float t[kLanes];
+        for (size_t k = 0; k < kLanes; ++k) {
+            const float x = x0 + (float)(int32_t)(first + k) * step;
+            j[k] = (int32_t)x;
+            t[k] = x - (float)j[k];
+        }
+        alignas(32) float a[kLanes] = {};
+        alignas(32) float b[kLanes] = {};
+        alignas(32) float c[kLanes] = {};
+        alignas(32) float d[kLanes] = {};
+        for (size_t k = 0; k < lanes; ++k) {
+            a[k] = src[j[k] - 1];
+            b[k] = src[j[k]];
+            c[k] = src[j[k] + 1];
+            d[k] = src[j[k] + 2];
+        }
+        alignas(32) float y[kLanes];
+        for (size_t k = 0; k < kLanes; ++k) {
+            y[k] = b[k] + 0.5f * t[k] * (c[k] - a[k] + t[k] * (2.0f * a[k] - 5.0f * b[k] + 4.0f * c[k] - d[k] + t[k] * (3.0f * (b[k] - c[k]) + d[k] - a[k])));
+        }
+        std::copy_n(y, lanes, out + first);
+    }
+}
+
+}  // namespace
+
+std::shared_ptr<const AuSampleFile> AuSampleFile::open(const std::string& path) {
+    ma_decoder decoder;
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 1, 0);
+    if (ma_decoder_init_file(path.c_str(), &config, &decoder) != MA_SUCCESS) {
+        std::print("Error: can't decode {}\n", path);
+        return nullptr;
+    }
+    ma_uint64 length = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&decoder, &length) != MA_SUCCESS || length == 0) {
+        std::print("Error: {} is empty or has no known length\n", path);
+        ma_decoder_uninit(&decoder);
+        return nullptr;
+    }
+    auto file = std::make_shared<AuSampleFile>();
+    file->m_path = path;
+    file->m_sample_rate = (float)decoder.outputSampleRate;
+    file->m_frames = (int64_t)length;
+    file->m_head_frames = file->m_frames <= kResidentFrames ? file->m_frames : kHeadFrames;
+    file->m_head.assign(1 + file->m_head_frames + kMargin, 0.0f);
+    ma_decoder_read_pcm_frames(&decoder, file->m_head.data() + 1, file->m_head_frames, nullptr);
+    ma_decoder_uninit(&decoder);
+    return file;
+}
+
+struct AuSampleStream::Decoder {
+    ma_decoder decoder;
+    bool ok = false;
+};
+
+AuSampleStream::AuSampleStream(std::shared_ptr<const AuSampleFile> file)
+    : m_file(std::move(file)),
+      m_begin(m_file->headFrames() - AuSampleFile::kMargin),
+      m_end(m_file->frames() + AuSampleFile::kMargin),
+      m_ring(kRingFrames + AuSampleFile::kMargin, 0.0f),
+      m_written(m_begin),
+      m_needed(m_begin) {
+    AuSampleStreamer::instance().add(this);
+}
+
+AuSampleStream::~AuSampleStream() {
+    AuSampleStreamer::instance().remove(this);
+    if (m_decoder && m_decoder->ok) {
+        ma_decoder_uninit(&m_decoder->decoder);
+    }
+}
+
+const float* AuSampleStream::frames(int64_t first, int64_t& count) const {
+    const int64_t head = m_file->headFrames();
+    if (first + AuSampleFile::kMargin <= head) {
+        count = head - first;
+        return m_file->head() + first;
+    }
+    if (first < m_begin || m_started.load(std::memory_order_acquire) != m_pass) {
+        return nullptr;
+    }
+    const int64_t written = m_written.load(std::memory_order_acquire);
+    if (first + AuSampleFile::kMargin > written) {
+        return nullptr;
+    }
+    const int64_t index = first % kRingFrames;
+    count = std::min(written - first, kRingFrames + AuSampleFile::kMargin - index);
+    return m_ring.data() + index;
+}
+
+void AuSampleStream::consume(int64_t first) {
+    if (first <= m_begin || m_started.load(std::memory_order_acquire) != m_pass) {
+        return;
+    }
+    m_consumed = true;
+    m_needed.store(first, std::memory_order_release);
+    const int64_t written = m_written.load(std::memory_order_relaxed);
+    if (written < m_end && written - first < kRingFrames / 2) {
+        AuSampleStreamer::instance().wake();
+    }
+}
+
+void AuSampleStream::restart() {
+    // Until the ring moves on it still holds the frames after the head.
+    if (!m_consumed) {
+        return;
+    }
+    m_consumed = false;
+    m_needed.store(m_begin, std::memory_order_relaxed);
+    m_requested.store(++m_pass, std::memory_order_release);
+    AuSampleStreamer::instance().wake();
+}
+
+bool AuSampleStream::fill(std::vector<float>& scratch) {
+    if (!m_decoder) {
+        m_decoder = std::make_unique<Decoder>();
+        ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 1, 0);
+        m_decoder->ok = ma_decoder_init_file(m_file->path().c_str(), &config, &m_decoder->decoder) == MA_SUCCESS;
+        if (!m_decoder->ok) {
+            std::print("Error: can't stream {}\n", m_file->path());
+        }
+    }
+    if (!m_decoder->ok) {
+        return false;
+    }
+    int64_t written = m_written.load(std::memory_order_relaxed);
+    const uint32_t requested = m_requested.load(std::memory_order_acquire);
+    if (requested != m_started.load(std::memory_order_relaxed)) {
+        written = m_begin;
+        ma_decoder_seek_to_pcm_frame(&m_decoder->decoder, written);
+        m_written.store(written, std::memory_order_relaxed);
+        m_started.store(requested, std::memory_order_release);
+    }
+    // Skip what the audio thread played as silence.
+    const int64_t needed = m_needed.load(std::memory_order_acquire);
+    if (needed > written) {
+        written = needed;
+        ma_decoder_seek_to_pcm_frame(&m_decoder->decoder, std::min(written, m_file->frames()));
+        m_written.store(written, std::memory_order_release);
+    }
+    const int64_t room = kRingFrames - (written - needed);
+    const int64_t frames = std::min({room, kChunkFrames, m_end - written});
+    if (frames <= 0 || (frames < kChunkFrames && written + frames < m_end)) {
+        return false;
+    }
+
+    // Past the end of the file the decoder reads nothing, leaving zeros.
+    scratch.assign(frames, 0.0f);
+    ma_decoder_read_pcm_frames(&m_decoder->decoder, scratch.data(), frames, nullptr);
+    const int64_t index = written % kRingFrames;
+    const int64_t split = std::min(frames, kRingFrames - index);
+    std::copy_n(scratch.begin(), split, m_ring.begin() + index);
+    std::copy_n(scratch.begin() + split, frames - split, m_ring.begin());
+    // Frames that went to the start of the ring are copied past its end.
+    for (int64_t k = 0; k < AuSampleFile::kMargin; ++k) {
+        if ((k - index + kRingFrames) % kRingFrames < frames) {
+            m_ring[kRingFrames + k] = m_ring[k];
+        }
+    }
+    m_written.store(written + frames, std::memory_order_release);
+    return frames == kChunkFrames && room - frames >= kChunkFrames;
+}
+
+AuSampleStreamer& AuSampleStreamer::instance() {
+    static AuSampleStreamer streamer;
+    return streamer;
+}
+
+AuSampleStreamer::AuSampleStreamer() : m_thread(&AuSampleStreamer::run, this) {}
+
+AuSampleStreamer::~AuSampleStreamer() {
+    m_stop.store(true);
+    m_wake.release();
+    m_thread.join();
+}
+
+void AuSampleStreamer::add(AuSampleStream* stream) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_streams.push_back(stream);
+    }
+    wake();
+}
+
+void AuSampleStreamer::remove(AuSampleStream* stream) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::erase(m_streams, stream);
+}
+
+void AuSampleStreamer::wake() {
+    if (!m_woken.exchange(true, std::memory_order_acq_rel)) {
+        m_wake.release();
+    }
+}
+
+void AuSampleStreamer::run() {
+    std::vector<float> scratch;
+    while (!m_stop.load()) {
+        // The timeout catches up with streams whose wake came in while
+        // filling.
+        m_wake.try_acquire_for(std::chrono::milliseconds(20));
+        m_woken.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // A chunk per stream and round, so one stream can't hold up the rest.
+        for (bool more = true; more && !m_stop.load();) {
+            more = false;
+            for (AuSampleStream* stream : m_streams) {
+                more = stream->fill(scratch) || more;
+            }
+        }
+    }
+}
+
+AuSamplePlayer::AuSamplePlayer() {
+    addInPin("trigger", 1.0f, AuRate::Control);
+    addInPin("pitch", 0.0f, AuRate::Control);
+    addInPin("loop", 0.0f, AuRate::Control);
+    addInPin("amplitude", 1.0f);
+    addOutPin("out");
+}
+
+AuSamplePlayer::~AuSamplePlayer() {
+    delete m_pending.load();
+    delete m_retired.load();
+    delete m_source;
+}
+
+bool AuSamplePlayer::setSettings(const std::string& settings) {
+    m_path = settings;
+    delete m_retired.exchange(nullptr, std::memory_order_acquire);
+    // A file that can't be opened plays silence, like no file.
+    auto source = std::make_unique<Source>();
+    source->file = settings.empty() ? nullptr : AuSampleFile::open(settings);
+    if (source->file && source->file->streamed()) {
+        source->stream = std::make_unique<AuSampleStream>(source->file);
+    }
+    const bool ok = settings.empty() || source->file;
+    // A source the audio thread hasn't taken yet is replaced.
+    delete m_pending.exchange(source.release(), std::memory_order_acq_rel);
+    return ok;
+}
+
+void AuSamplePlayer::restart() {
+    m_position = 0.0;
+    m_playing = true;
+    if (m_source->stream) {
+        m_source->stream->restart();
+    }
+}
+
+void AuSamplePlayer::render(float* out, size_t frames, float step, bool loop) {
+    const AuSampleFile& file = *m_source->file;
+    AuSampleStream* stream = m_source->stream.get();
+    while (frames > 0) {
+        const int64_t i = (int64_t)m_position;
+        if (m_playing && i >= file.frames()) {
+            if (loop) {
+                restart();
+                continue;
+            }
+            m_playing = false;
+        }
+        if (!m_playing) {
+            std::fill_n(out, frames, 0.0f);
+            return;
+        }
+        // Frames from i - 1, which the interpolator reads first.
+        int64_t count = file.frames() + AuSampleFile::kMargin - (i - 1);
+        const float* src = stream ? stream->frames(i - 1, count) : file.head() + i - 1;
+        if (!src) {
+            // Keep time while the streamer catches up.
+            stream->underrun();
+            std::fill_n(out, frames, 0.0f);
+            m_position += frames * (double)step;
+            return;
+        }
+        const float x0 = (float)(m_position - (double)(i - 1));
+        // Up to the end of the file or of the frames at hand.
+        const int64_t end = std::min(count - 3, file.frames() - (i - 1));
+        size_t n = (size_t)std::min<double>(frames, std::ceil((end - x0) / step));
+        // Checked with the arithmetic interpolate() uses, so rounding can't
+        // read past count.
+        while (n > 1 && (int64_t)(x0 + (float)(n - 1) * step) + 3 >= count) {
+            n--;
+        }
+        interpolate(src, x0, step, out, n);
+        m_position += n * (double)step;
+        out += n;
+        frames -= n;
+    }
+}
+
+void AuSamplePlayer::process(const AuProcessContext& ctx) {
+    if (m_pending.load(std::memory_order_relaxed) && !m_retired.load(std::memory_order_acquire)) {
+        m_retired.store(m_source, std::memory_order_release);
+        m_source = m_pending.exchange(nullptr, std::memory_order_acq_rel);
+        m_gate = false;
+        m_playing = false;
+    }
+    float* out = ctx.out(0);
+    if (!m_source || !m_source->file) {
+        std::fill_n(out, ctx.frames, 0.0f);
+        return;
+    }
+    const float* trigger = ctx.in(0);
+    const float* pitch = ctx.in(1);
+    const float* loop = ctx.in(2);
+    const float* amp = ctx.in(3);
+    const float rate = m_source->file->sampleRate() / ctx.sample_rate;
+    for (size_t t = 0, i = 0; i < ctx.frames; ++t) {
+        const size_t frames = std::min(ctx.tick_frames, ctx.frames - i);
+        const bool gate = trigger[t] > 0.5f;
+        if (gate && !m_gate) {
+            restart();
+        }
+        m_gate = gate;
+        // A NaN step would index anywhere.
+        const float semitones = std::isnan(pitch[t]) ? 0.0f : std::clamp(pitch[t], -48.0f, 48.0f);
+        const float step = rate * exp2f(semitones / 12.0f);
+        render(out + i, frames, step, loop[t] > 0.5f);
+        i += frames;
+    }
+    for (size_t i = 0; i < ctx.frames; ++i) {
+        out[i] *= amp[i];
+    }
+    if (m_source->stream && m_playing) {
+        m_source->stream->consume((int64_t)m_position - 1);
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include "audio_graph.h"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A sample file opened for playback, decoded to mono with the vendored
+// miniaudio decoders (WAV, FLAC, MP3). Files up to kResidentFrames long are
+// decoded into memory whole. Longer ones only get their first kHeadFrames
+// decoded, which covers the start of playback while an AuSampleStream reads
+// the rest, so opening a file takes the same time whatever its length.
+class AuSampleFile {
+   public:
+    static const int64_t kResidentFrames = 1 << 19;  // About 11 s at 48 kHz
+    static const int64_t kHeadFrames = 1 << 16;
+    // Frames past the last one interpolated that a read must cover.
+    static const int64_t kMargin = 8;
+
+    // Prints the reason and returns nullptr if the file can't be decoded.
+    static std::shared_ptr<const AuSampleFile> open(const std::string& path);
+
+    const std::string& path() const {
+        return m_path;
+    }
+    float sampleRate() const {
+        return m_sample_rate;
+    }
+    int64_t frames() const {
+        return m_frames;
+    }
+    bool streamed() const {
+        return m_head_frames < m_frames;
+    }
+    // Frames -1 to headFrames() + kMargin - 1 of the file. Frames outside the
+    // file are 0, so interpolation needs no special case at either end.
+    const float* head() const {
+        return m_head.data() + 1;
+    }
+    int64_t headFrames() const {
+        return m_head_frames;
+    }
+
+   private:
+    std::string m_path;
+    float m_sample_rate = 0.0f;
+    int64_t m_frames = 0;
+    int64_t m_head_frames = 0;
+    std::vector<float> m_head;
+};
+
+// The part of a streamed AuSampleFile past its head, read ahead of playback
+// into a ring by AuSampleStreamer. The audio thread only touches the ring and
+// atomics, so it never waits for the disk: frames that haven't arrived yet
+// play as silence and count as an underrun.
+class AuSampleStream {
+   public:
+    static const int64_t kRingFrames = 1 << 15;
+
+    // Registers with AuSampleStreamer, which starts reading right away.
+    explicit AuSampleStream(std::shared_ptr<const AuSampleFile> file);
+    ~AuSampleStream();
+
+    const AuSampleFile& file() const {
+        return *m_file;
+    }
+
+    // Audio thread. Frames from first on, from the head or the ring, with
+    // count set to how many follow contiguously, at least kMargin. nullptr
+    // if they haven't been read yet.
+    const float* frames(int64_t first, int64_t& count) const;
+    // Audio thread. Frames before first won't be read again in this pass.
+    // Wakes the streamer once less than half the ring is read ahead.
+    void consume(int64_t first);
+    // Audio thread. Starts another pass from the beginning of the file.
+    void restart();
+    // Audio thread.
+    void underrun() {
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Any thread.
+    size_t underruns() const {
+        return m_underruns.load(std::memory_order_relaxed);
+    }
+
+   private:
+    friend class AuSampleStreamer;
+    struct Decoder;
+
+    // Streamer thread. Tops up the ring by one chunk and returns true if
+    // there's room for more.
+    bool fill(std::vector<float>& scratch);
+
+    static const int64_t kChunkFrames = 4096;
+
+    std::shared_ptr<const AuSampleFile> m_file;
+    const int64_t m_begin;  // First frame in the ring, kMargin into the head
+    const int64_t m_end;  // Past the file's last frame and kMargin zeros
+    // kRingFrames and a copy of the first kMargin past the end, so reads
+    // that wrap are contiguous.
+    std::vector<float> m_ring;
+    std::atomic<int64_t> m_written;  // End of the frames in the ring
+    std::atomic<int64_t> m_needed;  // Oldest frame the audio thread still reads
+    // Passes requested by the audio thread and passes the streamer started.
+    // The ring belongs to the current pass once they match.
+    std::atomic<uint32_t> m_requested{1};
+    std::atomic<uint32_t> m_started{0};
+    std::atomic<size_t> m_underruns{0};
+    uint32_t m_pass = 1;  // Audio thread
+    bool m_consumed = false;  // Audio thread, the ring moved on in this pass
+    std::unique_ptr<Decoder> m_decoder;  // Streamer thread
+};
+
+// Background thread that keeps the rings of all AuSampleStreams filled.
+class AuSampleStreamer {
+   public:
+    static AuSampleStreamer& instance();
+    ~AuSampleStreamer();
+
+    void add(AuSampleStream* stream);
+    // Returns once the streamer is done with the stream.
+    void remove(AuSampleStream* stream);
+    // Any thread, never blocks.
+    void wake();
+
+   private:
+    AuSampleStreamer();
+    void run();
+
+    std::mutex m_mutex;  // Held while filling
+    std::vector<AuSampleStream*> m_streams;
+    std::counting_semaphore<> m_wake{0};
+    std::atomic<bool> m_woken{false};
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
+
+// Plays a sample file from the start on each rising edge of trigger, pitched
+// by pitch semitones with 4 point interpolation, once or looped. The file
+// path is the node's settings().
+class AuSamplePlayer : public AuNodeBase {
+   public:
+    AuSamplePlayer();
+    ~AuSamplePlayer();
+    void process(const AuProcessContext& ctx) override;
+    std::string_view settingsName() const override {
+        return "file";
+    }
+    std::string settings() const override {
+        return m_path;
+    }
+    bool setSettings(const std::string& settings) override;
+    std::string_view name() const {
+        return "SamplePlayer";
+    }
+
+   private:
+    // A file and, if it's streamed, its stream.
+    struct Source {
+        std::shared_ptr<const AuSampleFile> file;
+        std::unique_ptr<AuSampleStream> stream;
+    };
+
+    void restart();
+    void render(float* out, size_t frames, float step, bool loop);
+
+    std::string m_path;
+    // Handed over like plans in AuNodeGraph: the audio thread takes
+    // m_pending once m_retired is free and retires the source it replaced.
+    std::atomic<Source*> m_pending{nullptr};
+    std::atomic<Source*> m_retired{nullptr};
+    Source* m_source = nullptr;  // Audio thread
+    double m_position = 0.0;  // Frames into the file
+    bool m_gate = false;
+    bool m_playing = false;
+};
@@ -0,0 +1,32 @@
+#include "shared_library.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+void* openLibrary(const std::string& path) {
+#if defined(_WIN32)
+    return LoadLibraryA(path.c_str());
+#else
+    return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void* findSymbol(void* handle, const char* name) {
+#if defined(_WIN32)
+    return (void*)GetProcAddress((HMODULE)handle, name);
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+void closeLibrary(void* handle) {
+#if defined(_WIN32)
+    FreeLibrary((HMODULE)handle);
+#else
+    dlclose(handle);
+#endif
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// dlopen / LoadLibrary behind one interface. Handles are nullptr on failure.
+void* openLibrary(const std::string& path);
+void* findSymbol(void* handle, const char* name);
+void closeLibrary(void* handle);
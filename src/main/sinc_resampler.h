@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <vector>
+
+enum class AuResampleQuality { Low, Medium, High };
+
+// Arbitrary ratio resampler: a Kaiser windowed sinc stored as a polyphase
+// table, interpolated linearly between phases. Each output sample is two dot
+// products over contiguous taps. When downsampling the cutoff moves down to
+// the output Nyquist.
+//
+// Pull model: ask inputNeeded() for the input that read() will consume, write()
+// it, then read().
+class AuSincResampler {
+   public:
+    AuSincResampler(double in_rate, double out_rate, AuResampleQuality quality, size_t max_out_frames);
+
+    size_t inputNeeded(size_t out_frames) const;
+    // in may be nullptr for silence.
+    void write(const float* in, size_t frames);
+    void read(float* out, size_t frames);
+
+    // How far input runs ahead of output, in input samples.
+    size_t latency() const {
+        return m_half;
+    }
+
+   private:
+    static const size_t kPhases = 256;
+
+    double m_step;  // Input samples per output sample
+    size_t m_half;  // Taps on each side of the centre
+    std::vector<float> m_table;  // (kPhases + 1) * 2 * m_half
+    std::vector<float> m_buffer;
+    size_t m_count = 0;  // Valid samples in m_buffer
+    double m_pos = 0.0;  // Position of the next output in m_buffer
+};
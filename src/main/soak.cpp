@@ -0,0 +1,199 @@
+// Runs a patch on a simulated audio device for a while, editing constants at
+// random like a user turning knobs, and reports callback timing every second.
+// Needs no sound card, so it can soak a graph for hours on a headless box.
+//
+//   imsynth_soak [options]
+//     --seconds <n>          How long to run, 10 by default
+//     --graph <file>         Patch to load instead of the test graph
+//     --parts <n>            Play n copies of the patch, on MIDI channels 1 to n
+//     --part-threads <n>     Threads rendering parts besides the audio thread
+//     --period <frames>      Device period, 256 by default
+//     --periods <count>
+//     --variation <f>        Block size variation, fraction of the period
+//     --jitter <ms>          Random wake up lateness
+//     --preempt <chance> <ms>
+//     --edits <per second>   Constant edits, 200 by default
+//     --realtime [priority]  Run the audio thread with SCHED_FIFO
+//     --cpu <index>          Pin the audio thread to a core
+//     --record <path>        Record the output to path-out.wav
+//     --direct               Record with O_DIRECT
+//     --sync                 Record with fdatasync() after each write
+//
+// Exits with 1 if a block missed its deadline, the recorder dropped a block
+// or, when built with IMSYNTH_REALTIME_GUARD, on any realtime violation.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <print>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_engine.h"
+#include "graph_io.h"
+#include "realtime_guard.h"
+#include "realtime_thread.h"
+
+namespace {
+
+struct SoakOptions {
+    AudioEngineOptions engine;
+    double seconds = 10.0;
+    std::string graph;
+    size_t parts = 1;
+    double edits = 200.0;
+    bool record = false;
+    AuRecorderSettings recorder;
+};
+
+SoakOptions parseOptions(int argc, char** argv) {
+    SoakOptions options;
+    AudioDeviceSettings& device = options.engine.device;
+    AudioSimulation& simulation = device.simulation;
+    simulation.enabled = true;
+    device.period_frames = 256;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc && argv[i + 1][0] != '-';
+        if (arg == "--seconds" && has_value) {
+            options.seconds = atof(argv[++i]);
+        } else if (arg == "--graph" && has_value) {
+            options.graph = argv[++i];
+        } else if (arg == "--parts" && has_value) {
+            options.parts = std::clamp<size_t>(atoi(argv[++i]), 1, AudioEngine::kMaxParts);
+        } else if (arg == "--part-threads" && has_value) {
+            options.engine.part_threads = atoi(argv[++i]);
+        } else if (arg == "--period" && has_value) {
+            device.period_frames = atoi(argv[++i]);
+        } else if (arg == "--periods" && has_value) {
+            device.periods = atoi(argv[++i]);
+        } else if (arg == "--variation" && has_value) {
+            simulation.period_variation = (float)atof(argv[++i]);
+        } else if (arg == "--jitter" && has_value) {
+            simulation.jitter_ms = (float)atof(argv[++i]);
+        } else if (arg == "--preempt" && i + 2 < argc) {
+            simulation.preempt_chance = (float)atof(argv[++i]);
+            simulation.preempt_ms = (float)atof(argv[++i]);
+        } else if (arg == "--edits" && has_value) {
+            options.edits = atof(argv[++i]);
+        } else if (arg == "--realtime") {
+            options.engine.thread.realtime = true;
+            if (has_value) options.engine.thread.priority = atoi(argv[++i]);
+        } else if (arg == "--cpu" && has_value) {
+            options.engine.thread.cpu = atoi(argv[++i]);
+        } else if (arg == "--record" && has_value) {
+            options.record = true;
+            options.recorder.path = argv[++i];
+        } else if (arg == "--direct") {
+            options.recorder.direct = true;
+        } else if (arg == "--sync") {
+            options.recorder.sync = true;
+        } else {
+            std::print("Unknown option {}\n", arg);
+        }
+    }
+    return options;
+}
+
+// An unconnected input and the value it was loaded with.
+struct Knob {
+    AuNodeGraphPtr graph;
+    AuNodePtr node;
+    size_t pin;
+    float value;
+};
+
+void findKnobs(const AuNodeGraphPtr& graph, std::vector<Knob>& knobs) {
+    for (const auto& node : graph->nodes()) {
+        for (size_t i = 0; i < node->inPins(); ++i) {
+            Pin& pin = node->inPin(i);
+            if (!pin.node() && pin.rate() != AuRate::Init) {
+                knobs.push_back({graph, node, i, pin.value()});
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    SoakOptions options = parseOptions(argc, argv);
+    auto audio = AudioEngine::create(options.engine);
+    std::vector<Knob> knobs;
+    for (size_t part = 0; part < options.parts; ++part) {
+        AuNodeGraphPtr graph = options.graph.empty() ? createTestGraph() : loadGraph(options.graph);
+        if (!graph) {
+            return 1;
+        }
+        AudioPartSettings settings;
+        settings.midi_channel = options.parts > 1 ? (int)part + 1 : 0;
+        settings.gain = 1.0f / options.parts;
+        audio->setPartSettings(part, settings);
+        audio->setPartGraph(part, graph);
+        findKnobs(graph, knobs);
+    }
+    if (audio->init() != 0) {
+        return 1;
+    }
+    audio->resetTimingStats();
+    if (options.record && audio->startRecording(options.recorder) != 0) {
+        return 1;
+    }
+
+    std::minstd_rand random(1);
+    std::uniform_real_distribution<float> scale(0.5f, 1.5f);
+    const auto edit_interval = std::chrono::duration<double>(options.edits > 0.0 ? 1.0 / options.edits : 1.0);
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+    Clock::time_point next_edit = start;
+    Clock::time_point next_report = start + std::chrono::seconds(1);
+    size_t edits = 0;
+    while (Clock::now() < end) {
+        if (options.edits > 0.0 && !knobs.empty() && Clock::now() >= next_edit) {
+            const Knob& knob = knobs[random() % knobs.size()];
+            knob.graph->setValue(knob.node, knob.pin, knob.value * scale(random));
+            next_edit += std::chrono::duration_cast<Clock::duration>(edit_interval);
+            edits++;
+        }
+        audio->update();
+        reportThreadSetup();
+        if (Clock::now() >= next_report) {
+            AudioTimingStats stats = audio->getTimingStats();
+            std::print("{:6.0f} s  {:8} blocks  {:4} missed  worst {:6.3f} ms ({:4.0f}%)  average {:6.3f} ms  {} edits\n",
+                       std::chrono::duration<double>(Clock::now() - start).count(), stats.callbacks, stats.deadline_misses, stats.worst_ms,
+                       100.0f * stats.worst_load, stats.average_ms, edits);
+            if (options.record) {
+                AuRecorderStats recorder = audio->getRecorderStats();
+                std::print("        recorder ring {:3.0f}%  peak {:3.0f}%  {} dropped  {:.1f} MB\n", 100.0f * recorder.fill,
+                           100.0f * recorder.peak_fill, recorder.dropped_blocks, recorder.written_bytes / 1e6);
+            }
+            next_report += std::chrono::seconds(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    AudioTimingStats stats = audio->getTimingStats();
+    audio->stopRecording();
+    AuRecorderStats recorder = audio->getRecorderStats();
+    audio.reset();
+    const size_t violations = reportRealtimeViolations();
+    std::print("Blocks:           {}\n", stats.callbacks);
+    std::print("Deadline misses:  {}\n", stats.deadline_misses);
+    std::print("Worst:            {:.3f} ms, {:.0f}% of a block\n", stats.worst_ms, 100.0f * stats.worst_load);
+    std::print("Average:          {:.3f} ms\n", stats.average_ms);
+    if constexpr (kRealtimeGuard) {
+        std::print("RT violations:    {}\n", violations);
+    }
+    if (options.record) {
+        std::print("Recorded:         {:.1f} MB, peak ring fill {:.0f}%, {} blocks dropped{}\n", recorder.written_bytes / 1e6,
+                   100.0f * recorder.peak_fill, recorder.dropped_blocks, recorder.failed ? ", write failed" : "");
+    }
+    const bool recorded = recorder.dropped_blocks == 0 && !recorder.failed;
+    return stats.deadline_misses == 0 && violations == 0 && recorded ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+// Bounded wait-free queue for one producer thread and one consumer thread.
+// Capacity must be a power of two; the queue holds Capacity - 1 items.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+   public:
+    // Producer thread. Returns false if the queue is full.
+    bool push(const T& item) {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) & (Capacity - 1);
+        if (next == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread. Returns false if the queue is empty.
+    bool pop(T& item) {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = m_items[tail];
+        m_tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    // Either thread, approximate.
+    size_t size() const {
+        return (m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+
+   private:
+    static constexpr size_t kCacheLine = 64;
+
+    alignas(kCacheLine) std::atomic<size_t> m_head{0};
+    alignas(kCacheLine) std::atomic<size_t> m_tail{0};
+    alignas(kCacheLine) T m_items[Capacity];
+};